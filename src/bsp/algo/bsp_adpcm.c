@@ -0,0 +1,89 @@
+/*
+    IMA-ADPCM encoder, 16 bit PCM -> 4 bit codes (4:1)
+
+    Standard IMA step/index tables, so any IMA decoder on the central side
+    works as long as it starts from the PRED/INDEX sent in each frame header.
+    Two codes per byte, first sample in the low nibble.
+*/
+#include "bsp.h"
+
+static const int16_t m_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8_t m_index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8};
+
+/**
+ * @brief encode one sample
+ *
+ * @param st        encoder state, updated
+ * @param sample    16 bit PCM
+ * @return uint8_t  4 bit code
+ */
+static uint8_t adpcm_encode_sample(ADPCM_STATE_ST *st, int16_t sample)
+{
+    int32_t step = m_step_table[st->index];
+    int32_t diff = sample - st->predictor;
+    int32_t delta = step >> 3;
+    uint8_t code = 0;
+    int32_t pred;
+
+    if (diff < 0)
+    {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step)
+    {
+        code |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 1;
+        delta += step;
+    }
+
+    /* Track the decoder's reconstruction, not the input */
+    pred = st->predictor + ((code & 8) ? -delta : delta);
+    st->predictor = (pred > INT16_MAX) ? INT16_MAX : ((pred < INT16_MIN) ? INT16_MIN : pred);
+
+    st->index += m_index_table[code];
+    st->index = (st->index < 0) ? 0 : ((st->index > 88) ? 88 : st->index);
+
+    return code;
+}
+
+/**
+ * @brief encode a block of samples
+ *
+ * @param st    encoder state, carried over between blocks
+ * @param in    PCM samples
+ * @param n     sample count, even
+ * @param out   n / 2 bytes
+ */
+void bsp_adpcm_encode(ADPCM_STATE_ST *st, const int16_t *in, int n, uint8_t *out)
+{
+    for (int i = 0; i < n; i += 2)
+    {
+        uint8_t lo = adpcm_encode_sample(st, in[i]);
+        uint8_t hi = adpcm_encode_sample(st, in[i + 1]);
+
+        *out++ = lo | (hi << 4);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+    Voice activity detector on 10 ms PCM blocks, integer only
+
+    Energy : mean square after DC removal (the PDM output has an offset),
+    compared to an adaptive noise floor (fast down, slow up).
+    ZCR    : zero crossings per block, broadband hiss crosses far more often
+    than voiced speech, so a high ZCR block needs more energy to count.
+    A hangover keeps the gate open over short pauses between words.
+*/
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(audio_vad, LOG_LEVEL_INF);
+
+extern BSP_ST g_Bsp;
+
+static uint32_t m_floor = 0; // 0 : take the first block
+static uint8_t m_hang = 0;
+
+/**
+ * @brief restart floor tracking, on stream start
+ *
+ */
+void bsp_audio_vad_reset(void)
+{
+    m_floor = 0;
+    m_hang = 0;
+    g_Bsp.audio.voice = 0;
+}
+
+/**
+ * @brief classify one block
+ *
+ * @param pcm       samples
+ * @param n         sample count
+ * @return uint8_t  1 : voice (or hangover), 0 : silence
+ */
+uint8_t bsp_audio_vad_process(const int16_t *pcm, int n)
+{
+    int32_t sum = 0;
+    int32_t mean;
+    uint64_t sq = 0;
+    uint32_t energy;
+    uint64_t thr;
+    uint16_t zcr = 0;
+    bool neg, prev_neg;
+    bool voice;
+
+    for (int i = 0; i < n; i++)
+    {
+        sum += pcm[i];
+    }
+    mean = sum / n;
+
+    prev_neg = (pcm[0] < mean);
+    for (int i = 0; i < n; i++)
+    {
+        int32_t x = pcm[i] - mean;
+
+        sq += (uint32_t)x * (uint32_t)x; // |x| <= 65535, fits
+        neg = (x < 0);
+        zcr += (neg != prev_neg);
+        prev_neg = neg;
+    }
+    energy = (uint32_t)(sq / n);
+
+    if (m_floor == 0)
+    {
+        m_floor = MAX(energy, 1);
+    }
+
+    /* 64 bit, a loud floor times the ratio (and 4x that) passes 32 bits */
+    thr = MAX((uint64_t)m_floor * BSP_AUDIO_VAD_THR, BSP_AUDIO_VAD_MIN_ENERGY);
+    voice = (energy > thr) && (zcr <= BSP_AUDIO_VAD_ZCR_MAX || energy > thr * 4);
+
+    /* Floor follows quiet blocks quickly, voice only pulls it up very slowly */
+    if (energy < m_floor)
+    {
+        m_floor -= (m_floor - energy) >> 2;
+    }
+    else
+    {
+        m_floor += (energy - m_floor) >> (voice ? 10 : 5);
+    }
+    m_floor = MAX(m_floor, 1);
+
+    if (voice)
+    {
+        m_hang = BSP_AUDIO_VAD_HANG;
+        g_Bsp.audio.voiceBlocks++;
+    }
+    else if (m_hang > 0)
+    {
+        m_hang--;
+    }
+
+    g_Bsp.audio.vadFloor = m_floor;
+    g_Bsp.audio.voice = (m_hang > 0);
+
+    return g_Bsp.audio.voice;
+}
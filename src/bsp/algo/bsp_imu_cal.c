@@ -0,0 +1,305 @@
+/*
+    IMU bias/scale calibration
+
+    Steps are triggered one by one (cli imu_cal or NUS_MSG_IMU_CAL) while the
+    board is held still:
+        0 : gyro bias, any orientation
+        1..6 : accel with +X, -X, +Y, -Y, +Z, -Z pointing up
+
+    Per axis, up/down means give
+        offset = (up + dn) / 2
+        gain   = 2 * G / (up - dn)      Q14
+
+    The result is kept in an own NVS record and applied by imu_task before the
+    ring push, integer only (64 bit product, any offset / gain):
+        acc  = ((acc - offset) * gain) >> 14
+        gyro = gyro - bias
+    g_Bsp.imuCal is only written and read under m_lock, imu_task never sees a
+    half updated calibration.
+*/
+#include <zephyr/sys/barrier.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(imu_cal, LOG_LEVEL_INF);
+
+#define CAL_G 981 // 1 G in IMU_SAMPLE_ST accel unit (m/s^2 x100)
+#define CAL_Q14_ONE (1 << 14)
+#define CAL_STEP_ALL 0x7F
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t cmd;    // BSP_IMU_CAL_xxx
+    int8_t status;  // 0 : OK, -1 : ERROR
+    uint8_t done;   // collected steps, bit per step
+} imu_cal_packet_t;
+
+/* Collection, consumer (imu_proc_task) owned while m_step >= 0 */
+static volatile int8_t m_step = -1;
+static uint16_t m_cnt;
+static int32_t m_sum[6];
+static int16_t m_gmin[3], m_gmax[3];
+
+static int16_t m_mean[BSP_IMU_CAL_STEPS][6]; // acc x/y/z, gyro x/y/z
+static uint8_t m_done = 0;
+static bool m_session = false;
+static IMU_CAL_ST m_prev; // applied calibration before the session started
+static struct k_spinlock m_lock;
+
+static void cal_set(const IMU_CAL_ST *cal)
+{
+    k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+    g_Bsp.imuCal = *cal;
+    k_spin_unlock(&m_lock, key);
+}
+
+static int16_t cal_clamp(int64_t v)
+{
+    return (v > INT16_MAX) ? INT16_MAX : ((v < INT16_MIN) ? INT16_MIN : (int16_t)v);
+}
+
+static void cal_notify(uint8_t cmd, int8_t status)
+{
+    imu_cal_packet_t packet;
+
+    packet.id = NUS_MSG_NOTIFY_IMU_CAL;
+    packet.len = sizeof(packet);
+    packet.cmd = cmd;
+    packet.status = status;
+    packet.done = m_done;
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+/**
+ * @brief check a finished step and keep its means
+ *
+ * @param step  step just collected
+ * @return int  0 : OK, -1 : ERROR
+ */
+static int cal_step_finish(int8_t step)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (m_gmax[i] - m_gmin[i] > BSP_IMU_CAL_STILL_THR)
+        {
+            LOG_ERR("Step %d, board moved (axis %d)", step, i);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        m_mean[step][i] = (int16_t)(m_sum[i] / m_cnt);
+    }
+
+    if (step != BSP_IMU_CAL_GYRO)
+    {
+        /* Step 1..6 : axis (step - 1) / 2 up (odd) or down (even) */
+        int axis = (step - 1) / 2;
+        int16_t v = m_mean[step][axis];
+
+        if ((step & 1) ? (v < CAL_G / 2) : (v > -CAL_G / 2))
+        {
+            LOG_ERR("Step %d, wrong orientation (%d)", step, v);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief run a calibration command
+ *
+ * @param cmd   BSP_IMU_CAL_xxx
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_imu_cal_cmd(uint8_t cmd)
+{
+    IMU_CAL_ST new_cal;
+    IMU_CAL_ST *cal = &new_cal;
+
+    if (cmd <= BSP_IMU_CAL_ACC_ZN)
+    {
+        if (m_step >= 0)
+        {
+            LOG_ERR("Step %d still running", m_step);
+            return -1;
+        }
+        if (!m_session)
+        {
+            /* New session, collect uncorrected data */
+            m_session = true;
+            m_prev = g_Bsp.imuCal;
+            new_cal = m_prev;
+            new_cal.valid = 0;
+            cal_set(&new_cal);
+        }
+
+        memset(m_sum, 0, sizeof(m_sum));
+        for (int i = 0; i < 3; i++)
+        {
+            m_gmin[i] = INT16_MAX;
+            m_gmax[i] = INT16_MIN;
+        }
+        m_cnt = 0;
+        barrier_dmem_fence_full();
+        m_step = cmd;
+
+        LOG_INF("Calibration step %d, keep still", cmd);
+        return 0;
+    }
+
+    switch (cmd)
+    {
+    case BSP_IMU_CAL_SAVE:
+        if (m_step >= 0 || !(m_done & BIT(BSP_IMU_CAL_GYRO)))
+        {
+            LOG_ERR("Calibration incomplete (0x%02x)", m_done);
+            cal_notify(cmd, -1);
+            return -1;
+        }
+
+        memset(cal, 0, sizeof(*cal));
+        for (int i = 0; i < 3; i++)
+        {
+            cal->gyroBias[i] = m_mean[BSP_IMU_CAL_GYRO][3 + i];
+            cal->accOffset[i] = 0;
+            cal->accGain[i] = CAL_Q14_ONE;
+        }
+
+        /* Accel only when all six orientations are there */
+        if ((m_done & CAL_STEP_ALL) == CAL_STEP_ALL)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                int32_t up = m_mean[1 + 2 * i][i];
+                int32_t dn = m_mean[2 + 2 * i][i];
+
+                cal->accOffset[i] = (int16_t)((up + dn) / 2);
+                cal->accGain[i] = (uint16_t)((2 * CAL_G * CAL_Q14_ONE) / (up - dn));
+            }
+        }
+
+        cal->valid = 1;
+        cal_set(cal);
+        m_done = 0;
+        m_session = false;
+
+        bsp_settings_touch(BSP_SET_IMU_CAL);
+        LOG_INF("Calibration saved, gyro %d %d %d, acc off %d %d %d, gain %d %d %d",
+                cal->gyroBias[0], cal->gyroBias[1], cal->gyroBias[2],
+                cal->accOffset[0], cal->accOffset[1], cal->accOffset[2],
+                cal->accGain[0], cal->accGain[1], cal->accGain[2]);
+        cal_notify(cmd, 0);
+        break;
+
+    case BSP_IMU_CAL_ABORT:
+        m_step = -1;
+        if (m_session)
+        {
+            cal_set(&m_prev);
+            m_done = 0;
+            m_session = false;
+        }
+        LOG_INF("Calibration aborted");
+        break;
+
+    case BSP_IMU_CAL_CLEAR:
+        m_step = -1;
+        m_done = 0;
+        m_session = false;
+        memset(cal, 0, sizeof(IMU_CAL_ST));
+        cal_set(cal);
+        bsp_settings_touch(BSP_SET_IMU_CAL);
+        LOG_INF("Calibration cleared");
+        break;
+
+    default:
+        LOG_ERR("Unknown calibration command %d", cmd);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief collect one sample for the running step, consumer side
+ *
+ * @param s sample from the IMU ring
+ */
+void bsp_imu_cal_process(const IMU_SAMPLE_ST *s)
+{
+    int8_t step = m_step;
+
+    if (step < 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        m_sum[i] += s->acc[i];
+        m_sum[3 + i] += s->gyro[i];
+        m_gmin[i] = MIN(m_gmin[i], s->gyro[i]);
+        m_gmax[i] = MAX(m_gmax[i], s->gyro[i]);
+    }
+
+    if (++m_cnt < BSP_IMU_CAL_SAMPLES)
+    {
+        return;
+    }
+
+    m_step = -1;
+    if (cal_step_finish(step) == 0)
+    {
+        m_done |= BIT(step);
+        LOG_INF("Calibration step %d done (0x%02x)", step, m_done);
+        cal_notify(step, 0);
+    }
+    else
+    {
+        cal_notify(step, -1);
+    }
+}
+
+/**
+ * @brief apply stored calibration, producer side (imu_task) fast path
+ *
+ * @param s sample, corrected in place
+ */
+void bsp_imu_cal_apply(IMU_SAMPLE_ST *s)
+{
+    k_spinlock_key_t key = k_spin_lock(&m_lock);
+    IMU_CAL_ST cal = g_Bsp.imuCal;
+
+    k_spin_unlock(&m_lock, key);
+
+    if (!cal.valid)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        s->acc[i] = cal_clamp((((int64_t)s->acc[i] - cal.accOffset[i]) * cal.accGain[i]) >> 14);
+        s->gyro[i] = cal_clamp((int32_t)s->gyro[i] - cal.gyroBias[i]);
+    }
+}
+
+/**
+ * @brief steps collected in the current session
+ *
+ * @return uint8_t bit per step, see BSP_IMU_CAL_xxx
+ */
+uint8_t bsp_imu_cal_done(void)
+{
+    return m_done;
+}
@@ -0,0 +1,335 @@
+/*
+    Multi-rate decimation filter bank on the IMU stream
+
+    Each subscriber gets the 6 axes at its own rate from the one acquisition
+    ODR, anti-aliased, integer only:
+
+        ODR --> CIC3 / R --> polyphase FIR / F --> sink      (M = R * F)
+
+    F is 4, 2 or 1 (largest that divides M), the FIR is a windowed sinc with
+    Q15 taps evaluated only at output instants (one dot product per output).
+    The CIC takes the rest of the decimation in uint64 integrators/combs,
+    which wrap (a gravity offset overflows 64 bits in the third integrator
+    after a while), the comb differences are exact modulo 2^64 and the
+    output is signed again. The FIR cutoff keeps the CIC droop out of the
+    pass band. M = 1 is a pass-through.
+
+    Rates that do not divide the ODR get the nearest integer M, the actual
+    rate is reported. Rate/ODR changes are applied by the consumer thread.
+*/
+#include <math.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(imu_decim, LOG_LEVEL_INF);
+
+#define DECIM_CH 6
+#define DECIM_TAPS_PER_PHASE 8
+#define DECIM_FIR_MAX_F 4
+#define DECIM_TAPS_MAX (DECIM_TAPS_PER_PHASE * DECIM_FIR_MAX_F)
+
+extern BSP_ST g_Bsp;
+
+typedef struct
+{
+    bsp_decim_sink_t sink;
+    void *ctx;
+    volatile uint16_t reqHz; // requested rate, 0 : subscriber off
+    uint16_t curHz;          // rate the state below was built for
+    uint16_t odrHz;          // input rate the state was built for
+
+    uint16_t r; // CIC factor
+    uint8_t f;  // FIR factor
+    uint16_t cicCnt;
+    uint64_t integ[DECIM_CH][3]; // modular, see header
+    uint64_t comb[DECIM_CH][3];
+    int64_t cicGain; // R^3
+
+    uint8_t ntaps;
+    uint8_t firCnt;
+    uint8_t pos;
+    int16_t taps[DECIM_TAPS_MAX];
+    int16_t hist[DECIM_CH][2 * DECIM_TAPS_MAX]; // mirrored delay line
+
+    uint16_t seq;
+} decim_sub_t;
+
+static decim_sub_t m_sub[BSP_DECIM_SUBS];
+
+static int16_t decim_sat16(int64_t v)
+{
+    return (v > INT16_MAX) ? INT16_MAX : ((v < INT16_MIN) ? INT16_MIN : (int16_t)v);
+}
+
+/**
+ * @brief windowed sinc (Hamming) low pass, Q15, unity DC gain
+ *
+ * @param d     subscriber, f and ntaps set
+ */
+static void decim_design_fir(decim_sub_t *d)
+{
+    float h[DECIM_TAPS_MAX];
+    float fc = 0.4f / d->f; // cutoff, fraction of the FIR input rate
+    float mid = (d->ntaps - 1) / 2.0f;
+    float sum = 0.0f;
+    int32_t qsum = 0;
+
+    for (int i = 0; i < d->ntaps; i++)
+    {
+        float x = i - mid;
+        float w = 0.54f - 0.46f * cosf(2.0f * 3.14159265f * i / (d->ntaps - 1));
+
+        h[i] = (x == 0.0f) ? 2.0f * fc : sinf(2.0f * 3.14159265f * fc * x) / (3.14159265f * x);
+        h[i] *= w;
+        sum += h[i];
+    }
+    for (int i = 0; i < d->ntaps; i++)
+    {
+        d->taps[i] = (int16_t)lroundf(h[i] / sum * 32768.0f);
+        qsum += d->taps[i];
+    }
+
+    /* Rounding leftover on the centre tap, DC gain exactly 1.0 */
+    d->taps[d->ntaps / 2] += (int16_t)(32768 - qsum);
+}
+
+/**
+ * @brief rebuild subscriber state for its rate and the current ODR
+ *
+ * @param d subscriber
+ */
+static void decim_setup(decim_sub_t *d)
+{
+    uint16_t odr = g_Bsp.imuPwr.odrHz;
+    uint16_t rate = MIN(d->reqHz, odr);
+    uint16_t m = (odr + rate / 2) / rate;
+
+    memset(d->integ, 0, sizeof(d->integ));
+    memset(d->comb, 0, sizeof(d->comb));
+    memset(d->hist, 0, sizeof(d->hist));
+    d->cicCnt = 0;
+    d->firCnt = 0;
+    d->pos = 0;
+
+    d->f = (m % 4 == 0) ? 4 : ((m % 2 == 0) ? 2 : 1);
+    d->r = m / d->f;
+    d->cicGain = (int64_t)d->r * d->r * d->r;
+    d->ntaps = (d->f > 1) ? DECIM_TAPS_PER_PHASE * d->f : 0;
+    if (d->ntaps)
+    {
+        decim_design_fir(d);
+    }
+
+    d->curHz = d->reqHz;
+    d->odrHz = odr;
+
+    LOG_INF("Decim sub %d, %d Hz -> %d.%02d Hz (CIC %d x FIR %d, %d taps)", (int)(d - m_sub), odr,
+            odr / m, (odr * 100 / m) % 100, d->r, d->f, d->ntaps);
+}
+
+/**
+ * @brief CIC3 stage, true when an output is ready in x
+ *
+ * @param d subscriber
+ * @param x in : 6 axes at ODR, out : 6 axes at ODR / R
+ */
+static bool decim_cic(decim_sub_t *d, int32_t x[DECIM_CH])
+{
+    if (d->r == 1)
+    {
+        return true;
+    }
+
+    for (int c = 0; c < DECIM_CH; c++)
+    {
+        d->integ[c][0] += (uint64_t)(int64_t)x[c];
+        d->integ[c][1] += d->integ[c][0];
+        d->integ[c][2] += d->integ[c][1];
+    }
+    if (++d->cicCnt < d->r)
+    {
+        return false;
+    }
+    d->cicCnt = 0;
+
+    for (int c = 0; c < DECIM_CH; c++)
+    {
+        uint64_t v = d->integ[c][2];
+
+        for (int k = 0; k < 3; k++)
+        {
+            uint64_t t = v - d->comb[c][k];
+
+            d->comb[c][k] = v;
+            v = t;
+        }
+        x[c] = (int32_t)((int64_t)v / d->cicGain);
+    }
+
+    return true;
+}
+
+/**
+ * @brief polyphase FIR stage, only every F-th input is filtered
+ *
+ * @param d subscriber
+ * @param x in : 6 axes, out : filtered 6 axes
+ */
+static bool decim_fir(decim_sub_t *d, int32_t x[DECIM_CH])
+{
+    if (d->f == 1)
+    {
+        return true;
+    }
+
+    for (int c = 0; c < DECIM_CH; c++)
+    {
+        int16_t v = decim_sat16(x[c]);
+
+        d->hist[c][d->pos] = v;
+        d->hist[c][d->pos + d->ntaps] = v;
+    }
+    d->pos = (d->pos + 1) % d->ntaps;
+
+    if (++d->firCnt < d->f)
+    {
+        return false;
+    }
+    d->firCnt = 0;
+
+    for (int c = 0; c < DECIM_CH; c++)
+    {
+        const int16_t *h = &d->hist[c][d->pos]; // oldest first
+        int32_t acc = 0;
+
+        for (int i = 0; i < d->ntaps; i++)
+        {
+            acc += (int32_t)h[i] * d->taps[i];
+        }
+        x[c] = (acc + (1 << 14)) >> 15;
+    }
+
+    return true;
+}
+
+/**
+ * @brief feed one ODR sample to every subscriber
+ *
+ * @param s sample from the IMU ring
+ */
+void bsp_imu_decim_process(const IMU_SAMPLE_ST *s)
+{
+    for (int i = 0; i < BSP_DECIM_SUBS; i++)
+    {
+        decim_sub_t *d = &m_sub[i];
+        IMU_SAMPLE_ST out;
+        int32_t x[DECIM_CH];
+
+        if (d->sink == NULL || d->reqHz == 0)
+        {
+            continue;
+        }
+        if (d->reqHz != d->curHz || d->odrHz != g_Bsp.imuPwr.odrHz)
+        {
+            decim_setup(d);
+        }
+
+        if (d->r == 1 && d->f == 1)
+        {
+            d->sink(s, d->ctx);
+            continue;
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            x[c] = s->acc[c];
+            x[3 + c] = s->gyro[c];
+        }
+        if (!decim_cic(d, x) || !decim_fir(d, x))
+        {
+            continue;
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            out.acc[c] = decim_sat16(x[c]);
+            out.gyro[c] = decim_sat16(x[3 + c]);
+        }
+        out.ts = s->ts;
+        out.seq = d->seq++;
+        d->sink(&out, d->ctx);
+    }
+}
+
+/**
+ * @brief attach a sink to a subscriber slot
+ *
+ * @param sub       BSP_DECIM_SUB_xxx
+ * @param rate_hz   output rate, 0 : off, >= ODR : every sample
+ * @param sink      called from imu_proc_task for every output sample
+ * @param ctx       passed to sink
+ * @return int      0 : OK, -1 : ERROR
+ */
+int bsp_imu_decim_subscribe(uint8_t sub, uint16_t rate_hz, bsp_decim_sink_t sink, void *ctx)
+{
+    if (sub >= BSP_DECIM_SUBS || sink == NULL)
+    {
+        return -1;
+    }
+
+    m_sub[sub].ctx = ctx;
+    m_sub[sub].sink = sink;
+    m_sub[sub].curHz = 0;
+    m_sub[sub].reqHz = rate_hz;
+
+    return 0;
+}
+
+/**
+ * @brief change a subscriber rate, applied on the next sample
+ *
+ * @param sub       BSP_DECIM_SUB_xxx
+ * @param rate_hz   output rate, 0 : off
+ * @return int      0 : OK, -1 : ERROR
+ */
+int bsp_imu_decim_set_rate(uint8_t sub, uint16_t rate_hz)
+{
+    if (sub >= BSP_DECIM_SUBS || m_sub[sub].sink == NULL)
+    {
+        LOG_ERR("No decim subscriber %d", sub);
+        return -1;
+    }
+
+    m_sub[sub].reqHz = rate_hz;
+
+    return 0;
+}
+
+/**
+ * @brief subscriber configuration
+ *
+ * @param sub   BSP_DECIM_SUB_xxx
+ * @param st    copy destination
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_imu_decim_get(uint8_t sub, IMU_DECIM_STAT_ST *st)
+{
+    const decim_sub_t *d;
+
+    if (sub >= BSP_DECIM_SUBS)
+    {
+        return -1;
+    }
+
+    d = &m_sub[sub];
+    st->used = (d->sink != NULL);
+    st->reqHz = d->reqHz;
+    st->odrHz = d->odrHz;
+    st->factor = d->r * d->f;
+    st->cic = d->r;
+    st->fir = d->f;
+    st->taps = d->ntaps;
+    st->outputs = d->seq;
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+    On-device orientation fusion (Madgwick IMU filter, accel + gyro)
+
+    Runs at the sensor ODR in single precision (nRF52840 has an FPU).
+    Accel may be in any unit (it is normalized), gyro must be rad/s.
+    Results are published to g_Bsp.fusion and sent over NUS at the
+    lower fusionRateHz, so centrals get attitude without raw streaming.
+*/
+#include <math.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(imu_fusion, LOG_LEVEL_INF);
+
+#define RAD_TO_CDEG (18000.0f / 3.14159265f) // radian to 0.01 degree
+#define Q14_ONE 16384.0f
+
+extern BSP_ST g_Bsp;
+
+static float m_q0 = 1.0f, m_q1 = 0.0f, m_q2 = 0.0f, m_q3 = 0.0f;
+static float m_beta = BSP_DEFAULT_FUSION_BETA;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    int16_t q[4];
+} quat_packet_t;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    int16_t euler[3];
+} euler_packet_t;
+
+/**
+ * @brief reset filter state to identity orientation
+ *
+ * @param beta Madgwick gain, 0 or less keeps the default
+ */
+void bsp_imu_fusion_init(float beta)
+{
+    m_q0 = 1.0f;
+    m_q1 = 0.0f;
+    m_q2 = 0.0f;
+    m_q3 = 0.0f;
+
+    m_beta = (beta > 0.0f) ? beta : BSP_DEFAULT_FUSION_BETA;
+
+    g_Bsp.fusion.count = 0;
+
+    LOG_INF("Fusion init, beta %d/1000", (int)(m_beta * 1000.0f));
+}
+
+/**
+ * @brief one Madgwick filter step, call for every IMU sample
+ *
+ * @param acc   accel x/y/z, any unit
+ * @param gyro  gyro x/y/z in rad/s
+ * @param dt    time since previous sample in seconds
+ */
+void bsp_imu_fusion_update(const float acc[3], const float gyro[3], float dt)
+{
+    float q0 = m_q0, q1 = m_q1, q2 = m_q2, q3 = m_q3;
+    float ax = acc[0], ay = acc[1], az = acc[2];
+    float norm;
+
+    /* Rate of change of quaternion from gyroscope */
+    float qDot1 = 0.5f * (-q1 * gyro[0] - q2 * gyro[1] - q3 * gyro[2]);
+    float qDot2 = 0.5f * (q0 * gyro[0] + q2 * gyro[2] - q3 * gyro[1]);
+    float qDot3 = 0.5f * (q0 * gyro[1] - q1 * gyro[2] + q3 * gyro[0]);
+    float qDot4 = 0.5f * (q0 * gyro[2] + q1 * gyro[1] - q2 * gyro[0]);
+
+    /* Accel feedback only when the measurement is valid (avoids NaN on free fall) */
+    norm = ax * ax + ay * ay + az * az;
+    if (norm > 0.0f)
+    {
+        norm = 1.0f / sqrtf(norm);
+        ax *= norm;
+        ay *= norm;
+        az *= norm;
+
+        float _2q0 = 2.0f * q0;
+        float _2q1 = 2.0f * q1;
+        float _2q2 = 2.0f * q2;
+        float _2q3 = 2.0f * q3;
+        float _4q0 = 4.0f * q0;
+        float _4q1 = 4.0f * q1;
+        float _4q2 = 4.0f * q2;
+        float _8q1 = 8.0f * q1;
+        float _8q2 = 8.0f * q2;
+        float q0q0 = q0 * q0;
+        float q1q1 = q1 * q1;
+        float q2q2 = q2 * q2;
+        float q3q3 = q3 * q3;
+
+        /* Gradient descent corrective step */
+        float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+
+        norm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+        if (norm > 0.0f)
+        {
+            norm = 1.0f / sqrtf(norm);
+            qDot1 -= m_beta * s0 * norm;
+            qDot2 -= m_beta * s1 * norm;
+            qDot3 -= m_beta * s2 * norm;
+            qDot4 -= m_beta * s3 * norm;
+        }
+    }
+
+    /* Integrate and normalise */
+    q0 += qDot1 * dt;
+    q1 += qDot2 * dt;
+    q2 += qDot3 * dt;
+    q3 += qDot4 * dt;
+
+    norm = 1.0f / sqrtf(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    m_q0 = q0 * norm;
+    m_q1 = q1 * norm;
+    m_q2 = q2 * norm;
+    m_q3 = q3 * norm;
+
+    g_Bsp.fusion.count++;
+}
+
+/**
+ * @brief publish current orientation to g_Bsp.fusion and send it via NUS
+ *
+ * @param mask  BSP_IMU_OUT_QUAT and/or BSP_IMU_OUT_EULER
+ * @return int  0 : OK
+ */
+int bsp_imu_fusion_notify(uint8_t mask)
+{
+    float q0 = m_q0, q1 = m_q1, q2 = m_q2, q3 = m_q3;
+    float sinp;
+
+    g_Bsp.fusion.q[0] = (int16_t)(q0 * Q14_ONE);
+    g_Bsp.fusion.q[1] = (int16_t)(q1 * Q14_ONE);
+    g_Bsp.fusion.q[2] = (int16_t)(q2 * Q14_ONE);
+    g_Bsp.fusion.q[3] = (int16_t)(q3 * Q14_ONE);
+
+    /* Z-Y-X (yaw, pitch, roll) */
+    sinp = 2.0f * (q0 * q2 - q3 * q1);
+    sinp = (sinp > 1.0f) ? 1.0f : ((sinp < -1.0f) ? -1.0f : sinp);
+
+    g_Bsp.fusion.euler[0] = (int16_t)(atan2f(2.0f * (q0 * q1 + q2 * q3), 1.0f - 2.0f * (q1 * q1 + q2 * q2)) * RAD_TO_CDEG);
+    g_Bsp.fusion.euler[1] = (int16_t)(asinf(sinp) * RAD_TO_CDEG);
+    g_Bsp.fusion.euler[2] = (int16_t)(atan2f(2.0f * (q0 * q3 + q1 * q2), 1.0f - 2.0f * (q2 * q2 + q3 * q3)) * RAD_TO_CDEG);
+
+    if (mask & BSP_IMU_OUT_QUAT)
+    {
+        quat_packet_t packet;
+
+        packet.id = NUS_MSG_NOTIFY_QUAT;
+        packet.len = sizeof(packet);
+        memcpy(packet.q, g_Bsp.fusion.q, sizeof(packet.q));
+        ble_nus_send_data((char *)&packet, sizeof(packet));
+    }
+
+    if (mask & BSP_IMU_OUT_EULER)
+    {
+        euler_packet_t packet;
+
+        packet.id = NUS_MSG_NOTIFY_EULER;
+        packet.len = sizeof(packet);
+        memcpy(packet.euler, g_Bsp.fusion.euler, sizeof(packet.euler));
+        ble_nus_send_data((char *)&packet, sizeof(packet));
+    }
+
+    return 0;
+}
@@ -0,0 +1,427 @@
+/*
+    int8 gesture / activity classifier on sliding IMU windows
+
+    Hand written int8 dense kernels (no TFLite Micro, the models we run are a
+    few small fully connected layers). The model is a blob uploaded over NUS
+    (NUS_MSG_ML_MODEL) and kept in NVS, so it can be swapped without a new
+    firmware.
+
+    Blob, little endian, 4 byte aligned sections:
+        ML_MODEL_HDR_ST
+        per layer: ML_LAYER_HDR_ST | int8 weights[out][in] (padded to 4) | int32 bias[out]
+
+    Input window: winLen samples x inCh (6 : acc x/y/z, gyro x/y/z), each value
+    IMU_SAMPLE_ST unit >> accShift/gyroShift and saturated to int8.
+    Layer: y = sat8(((bias + sum(w * x)) * mult) >> (31 - shift)), optional ReLU.
+    Last layer gives int8 logits (value / 2^logitQ), softmax gives confidence.
+*/
+#include <math.h>
+#include <zephyr/sys/crc.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(imu_ml, LOG_LEVEL_INF);
+
+#define ML_MAGIC 0x4C4D // "ML"
+#define ML_COMMIT 0xFFFFFFFF
+#define ML_NVS_ID 0x100
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED ML_MODEL_HDR_S
+{
+    uint16_t magic; // ML_MAGIC
+    uint8_t version;
+    uint8_t layers;
+    uint16_t winLen; // samples per window
+    uint16_t hop;    // samples between inferences
+    uint8_t inCh;    // 6
+    uint8_t classes;
+    uint8_t accShift;  // acc (m/s^2 x100) >> accShift -> int8, 0..15
+    uint8_t gyroShift; // gyro (rad/s x1000) >> gyroShift -> int8, 0..15
+    uint8_t logitQ;    // logit = int8 / 2^logitQ, 0..30
+    uint8_t reserved[3];
+    uint32_t size; // whole blob including this header
+    uint32_t crc;  // crc32_ieee of the bytes after this header
+} ML_MODEL_HDR_ST;
+
+typedef struct PACKED ML_LAYER_HDR_S
+{
+    uint16_t in;
+    uint16_t out;
+    int32_t mult; // requantize multiplier, Q31
+    int8_t shift; // requantize shift, -30..30
+    uint8_t relu;
+    uint16_t reserved;
+} ML_LAYER_HDR_ST;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t cls;
+    uint8_t conf;   // %
+    uint16_t latUs; // inference time
+    uint32_t ts;    // device us of the last sample in the window
+} ml_class_packet_t;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint32_t offset; // acked offset, ML_COMMIT for the commit
+    int8_t status;   // 0 : OK, -1 : ERROR
+} ml_model_packet_t;
+
+/* Model image, weights are used in place */
+static uint32_t m_model_buf[BSP_ML_MODEL_MAX / 4];
+static uint8_t *const m_model = (uint8_t *)m_model_buf;
+
+/* Arena: input history (2 x winLen rows, mirrored) + 2 activation buffers */
+static int8_t m_arena[BSP_ML_ARENA_SIZE];
+static int8_t *m_hist;
+static int8_t *m_act[2];
+static uint16_t m_row = 0;
+static uint16_t m_filled = 0;
+static uint16_t m_since = 0;
+
+/* Upload vs inference */
+K_MUTEX_DEFINE(ml_mutex);
+
+static inline const ML_MODEL_HDR_ST *ml_hdr(void)
+{
+    return (const ML_MODEL_HDR_ST *)m_model;
+}
+
+static int8_t ml_sat8(int32_t v)
+{
+    return (v > INT8_MAX) ? INT8_MAX : ((v < INT8_MIN) ? INT8_MIN : (int8_t)v);
+}
+
+/**
+ * @brief check model image and lay out the arena
+ *
+ * @return int  0 : OK, -1 : ERROR
+ */
+static int ml_prepare(void)
+{
+    const ML_MODEL_HDR_ST *hdr = ml_hdr();
+    uint32_t off = sizeof(ML_MODEL_HDR_ST);
+    uint16_t prev_out, max_w = 0;
+    uint32_t in_bytes, used;
+
+    if (hdr->magic != ML_MAGIC || hdr->size > BSP_ML_MODEL_MAX || hdr->size <= off)
+    {
+        LOG_ERR("Model header invalid");
+        return -1;
+    }
+    if (crc32_ieee(m_model + off, hdr->size - off) != hdr->crc)
+    {
+        LOG_ERR("Model crc mismatch");
+        return -1;
+    }
+    if (hdr->layers == 0 || hdr->inCh != 6 || hdr->winLen == 0 || hdr->hop == 0 || hdr->classes == 0)
+    {
+        LOG_ERR("Model shape invalid");
+        return -1;
+    }
+    /* Shift counts from the upload, out of range is undefined behaviour */
+    if (hdr->logitQ > 30 || hdr->accShift > 15 || hdr->gyroShift > 15)
+    {
+        LOG_ERR("Model scaling invalid");
+        return -1;
+    }
+
+    prev_out = hdr->winLen * hdr->inCh;
+    for (int i = 0; i < hdr->layers; i++)
+    {
+        const ML_LAYER_HDR_ST *l = (const ML_LAYER_HDR_ST *)(m_model + off);
+
+        if (off + sizeof(ML_LAYER_HDR_ST) > hdr->size || l->in != prev_out)
+        {
+            LOG_ERR("Layer %d shape invalid", i);
+            return -1;
+        }
+        if (l->shift < -30 || l->shift > 30)
+        {
+            LOG_ERR("Layer %d shift %d invalid", i, l->shift);
+            return -1;
+        }
+        off += sizeof(ML_LAYER_HDR_ST) + ROUND_UP((uint32_t)l->in * l->out, 4) + 4U * l->out;
+        if (off > hdr->size)
+        {
+            LOG_ERR("Layer %d truncated", i);
+            return -1;
+        }
+        prev_out = l->out;
+        max_w = MAX(max_w, l->out);
+    }
+    if (prev_out != hdr->classes)
+    {
+        LOG_ERR("Model output %d != classes %d", prev_out, hdr->classes);
+        return -1;
+    }
+
+    in_bytes = (uint32_t)hdr->winLen * hdr->inCh;
+    used = 2 * in_bytes + 2 * ROUND_UP(max_w, 4);
+    if (used > BSP_ML_ARENA_SIZE)
+    {
+        LOG_ERR("Arena %d > %d", used, BSP_ML_ARENA_SIZE);
+        return -1;
+    }
+
+    m_hist = m_arena;
+    m_act[0] = m_arena + 2 * in_bytes;
+    m_act[1] = m_act[0] + ROUND_UP(max_w, 4);
+    m_row = 0;
+    m_filled = 0;
+    m_since = 0;
+
+    g_Bsp.ml.classes = hdr->classes;
+    g_Bsp.ml.winLen = hdr->winLen;
+    g_Bsp.ml.hop = hdr->hop;
+    g_Bsp.ml.modelSize = hdr->size;
+    g_Bsp.ml.arenaUsed = used;
+    g_Bsp.ml.arenaSize = BSP_ML_ARENA_SIZE;
+
+    LOG_INF("Model %d bytes, %d layers, %d classes, window %d/%d, arena %d",
+            hdr->size, hdr->layers, hdr->classes, hdr->winLen, hdr->hop, used);
+
+    return 0;
+}
+
+/**
+ * @brief int8 fully connected layer
+ *
+ * @param l     layer header, weights and bias follow it
+ * @param x     input, l->in values
+ * @param y     output, l->out values
+ * @return const uint8_t* next layer header
+ */
+static const uint8_t *ml_dense(const ML_LAYER_HDR_ST *l, const int8_t *x, int8_t *y)
+{
+    const int8_t *w = (const int8_t *)(l + 1);
+    const int32_t *bias = (const int32_t *)((const uint8_t *)w + ROUND_UP((uint32_t)l->in * l->out, 4));
+    int rshift = 31 - l->shift;
+
+    for (int o = 0; o < l->out; o++)
+    {
+        const int8_t *wr = w + o * l->in;
+        int32_t acc = bias[o];
+        int64_t p;
+
+        for (int i = 0; i < l->in; i++)
+        {
+            acc += wr[i] * x[i];
+        }
+
+        p = ((int64_t)acc * l->mult + ((int64_t)1 << (rshift - 1))) >> rshift;
+        if (l->relu && p < 0)
+        {
+            p = 0;
+        }
+        y[o] = (int8_t)CLAMP(p, INT8_MIN, INT8_MAX);
+    }
+
+    return (const uint8_t *)(bias + l->out);
+}
+
+/**
+ * @brief run the model on the current window and notify the result
+ *
+ * @param ts    timestamp of the newest sample
+ */
+static void ml_infer(uint32_t ts)
+{
+    const ML_MODEL_HDR_ST *hdr = ml_hdr();
+    const uint8_t *p = m_model + sizeof(ML_MODEL_HDR_ST);
+    const int8_t *x = m_hist + (uint32_t)m_row * hdr->inCh; // oldest row first
+    ml_class_packet_t packet;
+    uint32_t start = k_cycle_get_32();
+    float sum = 0.0f, best_e = 0.0f;
+    int best = 0;
+    int8_t *y;
+
+    for (int i = 0; i < hdr->layers; i++)
+    {
+        y = m_act[i & 1];
+        p = ml_dense((const ML_LAYER_HDR_ST *)p, x, y);
+        x = y;
+    }
+
+    /* x : int8 logits */
+    for (int c = 1; c < hdr->classes; c++)
+    {
+        if (x[c] > x[best])
+        {
+            best = c;
+        }
+    }
+    for (int c = 0; c < hdr->classes; c++)
+    {
+        float e = expf((float)(x[c] - x[best]) / (float)(1 << hdr->logitQ));
+
+        sum += e;
+        if (c == best)
+        {
+            best_e = e;
+        }
+    }
+
+    g_Bsp.ml.latUs = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    g_Bsp.ml.latMaxUs = MAX(g_Bsp.ml.latMaxUs, g_Bsp.ml.latUs);
+    g_Bsp.ml.inferences++;
+    g_Bsp.ml.lastClass = best;
+    g_Bsp.ml.lastConf = (uint8_t)(best_e / sum * 100.0f);
+
+    packet.id = NUS_MSG_NOTIFY_ML_CLASS;
+    packet.len = sizeof(packet);
+    packet.cls = g_Bsp.ml.lastClass;
+    packet.conf = g_Bsp.ml.lastConf;
+    packet.latUs = (uint16_t)MIN(g_Bsp.ml.latUs, UINT16_MAX);
+    packet.ts = ts;
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+/**
+ * @brief add one sample to the window, classify every hop samples
+ *
+ * @param s sample from the IMU ring
+ */
+void bsp_imu_ml_process(const IMU_SAMPLE_ST *s)
+{
+    const ML_MODEL_HDR_ST *hdr = ml_hdr();
+    int8_t row[6];
+    uint16_t ch;
+
+    if (!g_Bsp.ml.loaded || k_mutex_lock(&ml_mutex, K_NO_WAIT) != 0)
+    {
+        return;
+    }
+
+    ch = hdr->inCh;
+    for (int i = 0; i < 3; i++)
+    {
+        row[i] = ml_sat8(s->acc[i] >> hdr->accShift);
+        row[3 + i] = ml_sat8(s->gyro[i] >> hdr->gyroShift);
+    }
+
+    /* Mirrored history, rows [m_row, m_row + winLen) are always contiguous */
+    memcpy(m_hist + (uint32_t)m_row * ch, row, ch);
+    memcpy(m_hist + (uint32_t)(m_row + hdr->winLen) * ch, row, ch);
+    m_row = (m_row + 1) % hdr->winLen;
+
+    if (m_filled < hdr->winLen)
+    {
+        m_filled++;
+    }
+    if (m_filled >= hdr->winLen && ++m_since >= hdr->hop)
+    {
+        m_since = 0;
+        ml_infer(s->ts);
+    }
+
+    k_mutex_unlock(&ml_mutex);
+}
+
+static void ml_model_ack(uint32_t offset, int8_t status)
+{
+    ml_model_packet_t packet;
+
+    packet.id = NUS_MSG_NOTIFY_ML_MODEL;
+    packet.len = sizeof(packet);
+    packet.offset = offset;
+    packet.status = status;
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+/**
+ * @brief NUS_MSG_ML_MODEL, model upload chunk or commit
+ *
+ * @param p received packet, OFFSET(4) big endian then blob bytes
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_imu_ml_upload(const struct nus_msg_packet *p)
+{
+    uint32_t offset = ((uint32_t)(uint8_t)p->message[0] << 24) | ((uint32_t)(uint8_t)p->message[1] << 16) |
+                      ((uint32_t)(uint8_t)p->message[2] << 8) | (uint8_t)p->message[3];
+    int len = p->len - 8; // id + len + offset, p->len is checked against the bytes received (bt_receive_cb)
+    int rc = 0;
+
+    k_mutex_lock(&ml_mutex, K_FOREVER);
+
+    if (p->len < 8)
+    {
+        rc = -1;
+    }
+    else if (offset == ML_COMMIT)
+    {
+        rc = ml_prepare();
+        if (rc == 0)
+        {
+            rc = bsp_nvs_write_blob(ML_NVS_ID, m_model, ml_hdr()->size);
+        }
+        if (rc != 0)
+        {
+            /* Never run a half written image, fall back to the stored model */
+            LOG_ERR("Model commit failed, reloading the stored one");
+            rc = -1;
+            if (bsp_nvs_read_blob(ML_NVS_ID, m_model, BSP_ML_MODEL_MAX) > 0 && ml_prepare() == 0)
+            {
+                g_Bsp.ml.loaded = 1;
+            }
+        }
+        else
+        {
+            g_Bsp.ml.loaded = 1;
+        }
+    }
+    else if (len <= 0 || len > BSP_MAX_MSG_LEN - 4 || offset > BSP_ML_MODEL_MAX - len)
+    {
+        LOG_ERR("Model chunk %d bytes at %u rejected", len, offset);
+        rc = -1;
+    }
+    else
+    {
+        /* Any chunk changes the image in place, no inference until the commit */
+        g_Bsp.ml.loaded = 0;
+        memcpy(m_model + offset, &p->message[4], len);
+    }
+
+    k_mutex_unlock(&ml_mutex);
+
+    ml_model_ack(offset, (rc == 0) ? 0 : -1);
+
+    return (rc == 0) ? 0 : -1;
+}
+
+/**
+ * @brief load the stored model from NVS, call after bsp_nvs_init()
+ *
+ * @return int  0 : OK, -1 : no or invalid model
+ */
+int bsp_imu_ml_load(void)
+{
+    int rc;
+
+    k_mutex_lock(&ml_mutex, K_FOREVER);
+
+    g_Bsp.ml.arenaSize = BSP_ML_ARENA_SIZE;
+    rc = bsp_nvs_read_blob(ML_NVS_ID, m_model, BSP_ML_MODEL_MAX);
+    if (rc <= 0)
+    {
+        LOG_INF("No classifier model");
+        rc = -1;
+    }
+    else
+    {
+        rc = ml_prepare();
+    }
+    g_Bsp.ml.loaded = (rc == 0);
+
+    k_mutex_unlock(&ml_mutex);
+
+    return rc;
+}
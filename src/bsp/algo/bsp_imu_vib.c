@@ -0,0 +1,193 @@
+/*
+    Vibration features on IMU accel windows (machine monitoring)
+
+    Runs in imu_proc_task, non overlapping windows of vib.win samples per axis.
+    Per axis and window:
+        RMS, peak (DC removed), crest factor = peak / RMS, kurtosis = m4 / m2^2
+        BSP_VIB_BANDS equal width bands from the CMSIS-DSP real FFT (Hann),
+        reported as band RMS so sum(band^2) ~ RMS^2
+    Only the feature vector goes out (NUS_MSG_NOTIFY_VIB, one per axis), so the
+    IMU can run at a high ODR (cli imu_mode 0 416) with raw notify off.
+*/
+#include <math.h>
+#include <arm_math.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(imu_vib, LOG_LEVEL_INF);
+
+#define HANN_POWER 0.375f // mean of w^2 for the Hann window
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t axis;  // 0 : X, 1 : Y, 2 : Z
+    uint16_t win;  // samples per window
+    uint16_t odr;  // Hz, band width is odr / 2 / BSP_VIB_BANDS
+    uint32_t ts;   // device us of the last sample in the window
+    VIB_FEAT_ST feat;
+} vib_packet_t;
+
+static float32_t m_buf[3][BSP_VIB_MAX_WIN];
+static float32_t m_fft[BSP_VIB_MAX_WIN];
+static float32_t m_hann[BSP_VIB_MAX_WIN];
+static arm_rfft_fast_instance_f32 m_rfft;
+static uint16_t m_win = 0; // active window, 0 until set up by the consumer
+static uint16_t m_cnt = 0;
+static volatile uint16_t m_new_win = BSP_DEFAULT_VIB_WIN;
+
+static uint16_t vib_u16(float v)
+{
+    return (v >= 65535.0f) ? 65535 : (uint16_t)(v + 0.5f);
+}
+
+/**
+ * @brief (re)build FFT instance and window table, consumer side only
+ *
+ * @param win   window length, power of 2
+ * @return int  0 : OK, -1 : ERROR
+ */
+static int vib_setup(uint16_t win)
+{
+    if (arm_rfft_fast_init_f32(&m_rfft, win) != ARM_MATH_SUCCESS)
+    {
+        LOG_ERR("RFFT init failed (%d)", win);
+        return -1;
+    }
+
+    for (int i = 0; i < win; i++)
+    {
+        m_hann[i] = 0.5f - 0.5f * cosf(2.0f * PI * i / (win - 1));
+    }
+
+    m_win = win;
+    m_cnt = 0;
+    g_Bsp.vib.win = win;
+
+    LOG_INF("Vibration window %d", win);
+
+    return 0;
+}
+
+/**
+ * @brief features of one axis, the buffer is used as scratch
+ *
+ * @param x     window samples in m/s^2
+ * @param f     result
+ */
+static void vib_axis(float32_t *x, VIB_FEAT_ST *f)
+{
+    uint16_t n = m_win;
+    uint16_t per_band = (n / 2) / BSP_VIB_BANDS;
+    float32_t mean, rms, peak;
+    float32_t m2 = 0.0f, m4 = 0.0f;
+    uint32_t idx;
+
+    arm_mean_f32(x, n, &mean);
+    arm_offset_f32(x, -mean, x, n);
+    arm_rms_f32(x, n, &rms);
+    arm_absmax_f32(x, n, &peak, &idx);
+
+    for (int i = 0; i < n; i++)
+    {
+        float32_t d2 = x[i] * x[i];
+
+        m2 += d2;
+        m4 += d2 * d2;
+    }
+
+    f->rms = vib_u16(rms * BSP_IMU_ACC_SCALE);
+    f->peak = vib_u16(peak * BSP_IMU_ACC_SCALE);
+    f->crest = (rms > 0.0f) ? vib_u16(peak / rms * 100.0f) : 0;
+    f->kurt = (m2 > 0.0f) ? vib_u16((float)n * m4 / (m2 * m2) * 100.0f) : 0;
+
+    /* Spectrum, one sided power per bin, DC/Nyquist (packed in bin 0) dropped */
+    arm_mult_f32(x, m_hann, x, n);
+    arm_rfft_fast_f32(&m_rfft, x, m_fft, 0);
+    arm_cmplx_mag_squared_f32(m_fft, m_fft, n / 2);
+    m_fft[0] = 0.0f;
+
+    for (int b = 0; b < BSP_VIB_BANDS; b++)
+    {
+        float32_t e = 0.0f;
+
+        for (int k = b * per_band; k < (b + 1) * per_band; k++)
+        {
+            e += m_fft[k];
+        }
+
+        /* Mean square contribution of the band, Hann power corrected */
+        e = 2.0f * e / ((float)n * n * HANN_POWER);
+        f->band[b] = vib_u16(sqrtf(e) * BSP_IMU_ACC_SCALE);
+    }
+}
+
+/**
+ * @brief change the window length, applied at the next window start
+ *
+ * @param win   BSP_VIB_MIN_WIN..BSP_VIB_MAX_WIN, power of 2
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_imu_vib_set_win(uint16_t win)
+{
+    if (win < BSP_VIB_MIN_WIN || win > BSP_VIB_MAX_WIN || !IS_POWER_OF_TWO(win))
+    {
+        LOG_ERR("Vibration window %d not supported", win);
+        return -1;
+    }
+
+    m_new_win = win;
+
+    return 0;
+}
+
+/**
+ * @brief add one sample, emits features when the window is full
+ *
+ * @param s sample from the IMU ring
+ */
+void bsp_imu_vib_process(const IMU_SAMPLE_ST *s)
+{
+    vib_packet_t packet;
+
+    if (m_new_win != m_win)
+    {
+        if (vib_setup(m_new_win) < 0)
+        {
+            m_new_win = m_win;
+            return;
+        }
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        m_buf[i][m_cnt] = (float)s->acc[i] / BSP_IMU_ACC_SCALE;
+    }
+
+    if (++m_cnt < m_win)
+    {
+        return;
+    }
+    m_cnt = 0;
+
+    packet.id = NUS_MSG_NOTIFY_VIB;
+    packet.len = sizeof(packet);
+    packet.win = m_win;
+    packet.odr = g_Bsp.imuPwr.odrHz;
+    packet.ts = s->ts;
+
+    for (int i = 0; i < 3; i++)
+    {
+        vib_axis(m_buf[i], &g_Bsp.vib.feat[i]);
+
+        packet.axis = i;
+        packet.feat = g_Bsp.vib.feat[i];
+        ble_nus_send_data((char *)&packet, sizeof(packet));
+    }
+
+    g_Bsp.vib.windows++;
+}
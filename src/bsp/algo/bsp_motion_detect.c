@@ -0,0 +1,255 @@
+/*
+    Rule based motion events on the IMU stream (tap/double tap, free fall, step, shake)
+
+    Runs in imu_proc_task for every sample, integer only, units are the
+    IMU_SAMPLE_ST ones (accel m/s^2 x100, time from the sample ts in us).
+    Only small NUS_MSG_NOTIFY_MOTION_EVT messages go out, so a central that
+    only needs events can switch raw streaming off.
+*/
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(motion, LOG_LEVEL_INF);
+
+#define MS_TO_US(ms) ((uint32_t)(ms) * 1000U)
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t evt;  // MOTION_EVT_xxx
+    uint16_t arg; // step count, shake count, free fall ms...
+    uint32_t ts;  // device us of the sample that raised the event
+} motion_packet_t;
+
+typedef struct
+{
+    bool init;
+    int32_t prevMag;
+    int32_t gravity; // slow low pass of |a|, Q4
+
+    uint32_t lastTapTs;
+    bool tapPending;
+
+    bool ffActive;
+    bool ffSent;
+    uint32_t ffStartTs;
+
+    bool stepArmed;
+    uint32_t lastStepTs;
+
+    int8_t shakeSign;
+    uint8_t shakeCnt;
+    uint32_t shakeStartTs;
+    uint32_t lastShakeTs;
+} motion_state_t;
+
+static motion_state_t m_st;
+
+/**
+ * @brief integer square root
+ *
+ * @param v         input
+ * @return int32_t  floor(sqrt(v))
+ */
+static int32_t isqrt32(uint32_t v)
+{
+    uint32_t res = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > v)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (v >= res + bit)
+        {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+        {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (int32_t)res;
+}
+
+static void motion_emit(uint8_t evt, uint16_t arg, uint32_t ts)
+{
+    motion_packet_t packet;
+
+    packet.id = NUS_MSG_NOTIFY_MOTION_EVT;
+    packet.len = sizeof(packet);
+    packet.evt = evt;
+    packet.arg = arg;
+    packet.ts = ts;
+
+    g_Bsp.motion.lastEvt = evt;
+    g_Bsp.motion.evtCount++;
+
+    LOG_INF("Motion event %d, arg %d", evt, arg);
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+    bsp_tslog_append(BSP_TSLOG_T_MOTION, &packet.evt, sizeof(packet.evt) + sizeof(packet.arg));
+
+    /* Shock (impact or drop), keep the audio around it when the recorder is armed */
+    if (evt == MOTION_EVT_TAP || evt == MOTION_EVT_FREE_FALL)
+    {
+        bsp_audio_clip_trigger(BSP_CLIP_TRIG_SHOCK);
+    }
+}
+
+/**
+ * @brief set defaults and clear detector state
+ *
+ */
+void bsp_motion_detect_init(void)
+{
+    MOTION_CFG_ST *cfg = &g_Bsp.motion.cfg;
+
+    cfg->tapThr = BSP_DEFAULT_TAP_THR;
+    cfg->tapQuietMs = BSP_DEFAULT_TAP_QUIET_MS;
+    cfg->doubleTapMs = BSP_DEFAULT_DOUBLE_TAP_MS;
+    cfg->ffThr = BSP_DEFAULT_FF_THR;
+    cfg->ffMinMs = BSP_DEFAULT_FF_MIN_MS;
+    cfg->stepThr = BSP_DEFAULT_STEP_THR;
+    cfg->stepMinMs = BSP_DEFAULT_STEP_MIN_MS;
+    cfg->shakeThr = BSP_DEFAULT_SHAKE_THR;
+    cfg->shakeCount = BSP_DEFAULT_SHAKE_COUNT;
+    cfg->shakeWinMs = BSP_DEFAULT_SHAKE_WIN_MS;
+
+    memset(&m_st, 0, sizeof(m_st));
+}
+
+/**
+ * @brief change detection thresholds, 0 keeps the current value
+ *
+ * @param tap       tap jerk threshold, m/s^2 x100 per sample
+ * @param ff        free fall |a| threshold, m/s^2 x100
+ * @param step      step peak above gravity, m/s^2 x100
+ * @param shake     shake swing above gravity, m/s^2 x100
+ */
+void bsp_motion_detect_set_thr(uint16_t tap, uint16_t ff, uint16_t step, uint16_t shake)
+{
+    MOTION_CFG_ST *cfg = &g_Bsp.motion.cfg;
+
+    cfg->tapThr = tap ? tap : cfg->tapThr;
+    cfg->ffThr = ff ? ff : cfg->ffThr;
+    cfg->stepThr = step ? step : cfg->stepThr;
+    cfg->shakeThr = shake ? shake : cfg->shakeThr;
+
+    LOG_INF("Motion thr tap %d, ff %d, step %d, shake %d", cfg->tapThr, cfg->ffThr, cfg->stepThr, cfg->shakeThr);
+}
+
+/**
+ * @brief run all detectors on one sample
+ *
+ * @param s sample from the IMU ring
+ */
+void bsp_motion_detect_process(const IMU_SAMPLE_ST *s)
+{
+    const MOTION_CFG_ST *cfg = &g_Bsp.motion.cfg;
+    int32_t ax = s->acc[0], ay = s->acc[1], az = s->acc[2];
+    int32_t mag = isqrt32((uint32_t)(ax * ax) + (uint32_t)(ay * ay) + (uint32_t)(az * az));
+    int32_t dyn, jerk;
+    uint32_t ts = s->ts;
+
+    if (!m_st.init)
+    {
+        m_st.init = true;
+        m_st.prevMag = mag;
+        m_st.gravity = mag << 4;
+        m_st.stepArmed = true;
+        return;
+    }
+
+    /* Gravity tracker, ~16 sample time constant */
+    m_st.gravity += mag - (m_st.gravity >> 4);
+    dyn = mag - (m_st.gravity >> 4);
+    jerk = mag - m_st.prevMag;
+    m_st.prevMag = mag;
+
+    /* Tap / double tap: sharp jerk, single tap reported once the double tap window is over */
+    if (m_st.tapPending && (ts - m_st.lastTapTs) > MS_TO_US(cfg->doubleTapMs))
+    {
+        m_st.tapPending = false;
+        motion_emit(MOTION_EVT_TAP, 1, m_st.lastTapTs);
+    }
+    if ((jerk > cfg->tapThr || jerk < -cfg->tapThr) &&
+        (m_st.lastTapTs == 0 || (ts - m_st.lastTapTs) > MS_TO_US(cfg->tapQuietMs)))
+    {
+        if (m_st.tapPending)
+        {
+            m_st.tapPending = false;
+            motion_emit(MOTION_EVT_DOUBLE_TAP, 2, ts);
+        }
+        else
+        {
+            m_st.tapPending = true;
+        }
+        m_st.lastTapTs = ts;
+    }
+
+    /* Free fall: |a| near zero for ffMinMs */
+    if (mag < cfg->ffThr)
+    {
+        if (!m_st.ffActive)
+        {
+            m_st.ffActive = true;
+            m_st.ffSent = false;
+            m_st.ffStartTs = ts;
+        }
+        else if (!m_st.ffSent && (ts - m_st.ffStartTs) >= MS_TO_US(cfg->ffMinMs))
+        {
+            m_st.ffSent = true;
+            motion_emit(MOTION_EVT_FREE_FALL, (uint16_t)((ts - m_st.ffStartTs) / 1000), m_st.ffStartTs);
+        }
+    }
+    else
+    {
+        m_st.ffActive = false;
+    }
+
+    /* Step: peak above gravity with hysteresis and a minimum interval */
+    if (dyn < 0)
+    {
+        m_st.stepArmed = true;
+    }
+    else if (m_st.stepArmed && dyn > cfg->stepThr &&
+             (ts - m_st.lastStepTs) >= MS_TO_US(cfg->stepMinMs))
+    {
+        m_st.stepArmed = false;
+        m_st.lastStepTs = ts;
+        g_Bsp.motion.stepCount++;
+        motion_emit(MOTION_EVT_STEP, (uint16_t)g_Bsp.motion.stepCount, ts);
+    }
+
+    /* Shake: enough large swings with alternating sign inside the window */
+    if (dyn > cfg->shakeThr || dyn < -cfg->shakeThr)
+    {
+        int8_t sign = (dyn > 0) ? 1 : -1;
+
+        if (m_st.shakeCnt == 0 || (ts - m_st.shakeStartTs) > MS_TO_US(cfg->shakeWinMs))
+        {
+            m_st.shakeCnt = 1;
+            m_st.shakeStartTs = ts;
+            m_st.shakeSign = sign;
+        }
+        else if (sign != m_st.shakeSign)
+        {
+            m_st.shakeSign = sign;
+            m_st.shakeCnt++;
+            if (m_st.shakeCnt >= cfg->shakeCount &&
+                (ts - m_st.lastShakeTs) > MS_TO_US(cfg->shakeWinMs))
+            {
+                m_st.lastShakeTs = ts;
+                motion_emit(MOTION_EVT_SHAKE, m_st.shakeCnt, ts);
+                m_st.shakeCnt = 0;
+            }
+        }
+    }
+}
@@ -14,10 +14,19 @@ BSP_ST g_Bsp = {0};
 int bsp_init(void)
 {
     g_Bsp.prdTick = BSP_DEFAULT_PRD_TICK_COUNT;
+    g_Bsp.prdPeriodMs[BSP_PRD_JOB_HEARTBEAT] = BSP_DEFAULT_PRD_TICK_COUNT;
+    g_Bsp.prdPeriodMs[BSP_PRD_JOB_BATT] = BSP_DEFAULT_PRD_BATT_MS;
+    g_Bsp.prdPeriodMs[BSP_PRD_JOB_WALL] = BSP_WALL_RESYNC_S * 1000;
+    g_Bsp.prdPeriodMs[BSP_PRD_JOB_STATS] = BSP_RET_SNAPSHOT_S * 1000;
+    g_Bsp.prdPeriodMs[BSP_PRD_JOB_ADV] = BSP_DEFAULT_PRD_ADV_MS;
+    g_Bsp.prdPeriodMs[BSP_PRD_JOB_ALIVE] = BSP_DEFAULT_PRD_ALIVE_MS;
 
     bsp_gpio_init();
     bsp_key_init();
     bsp_lsm6ds3tr_init(NULL);
+    bsp_batt_init();
+    bsp_wall_init();
+    bsp_rtc_sched_init();
 
     return 0;
 }
@@ -51,3 +60,14 @@ void bsp_sleep_us(int us)
 {
     k_sleep(K_USEC(us));
 }
+
+/**
+ * @brief monotonic device time in usec since boot
+ *        base of sample timestamps and central time sync
+ *
+ * @return int64_t usec
+ */
+int64_t bsp_time_us(void)
+{
+    return (int64_t)k_ticks_to_us_floor64(k_uptime_ticks());
+}
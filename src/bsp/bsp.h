@@ -35,6 +35,7 @@
 #define BSP_CLI_ENABLED
 #define BSP_PRD_TASK_ENABLED
 #define BSP_LCD_SSD1306_ENABLED
+#define BSP_IMU_RTIO_ENABLED // async read-and-decode IMU path, undef for blocking sensor_sample_fetch()
 /******************************************/
 
 /**** LEDs ****/
@@ -52,14 +53,239 @@
 #define BSP_DEFAULT_BOOT_COUNT 0
 #define BSP_DEFAULT_PRD_TICK_COUNT 1000 // ms
 
+// Periodic jobs (bsp_periodic_task.c), period 0 : off
+#define BSP_PRD_JOB_HEARTBEAT 0 // period is prdTick
+#define BSP_PRD_JOB_BATT 1
+#define BSP_PRD_JOB_WALL 2  // RTC resync
+#define BSP_PRD_JOB_STATS 3 // retained RAM snapshot
+#define BSP_PRD_JOB_ADV 4   // advertising data refresh
+#define BSP_PRD_JOB_ALIVE 5 // NUS alive message, was the main loop
+#define BSP_PRD_JOBS 6
+#define BSP_DEFAULT_PRD_BATT_MS 60000
+#define BSP_DEFAULT_PRD_ADV_MS 30000
+#define BSP_DEFAULT_PRD_ALIVE_MS 5000
+
+// Application event queue (bsp_event.c), one thread for the non-realtime work
+#define BSP_EVQ_STACK_SIZE 2048
+#define BSP_EVQ_PRIO 7
+#define BSP_EVT_NUS_RX 0 // NUS messages queued by the BT RX callback
+#define BSP_EVT_BUTTON 1
+#define BSP_EVT_PING 2 // latency probe, cli evq ping
+#define BSP_EVTS 3
+
 #define BSP_MAX_MSG_LEN 128 // used to communicate with app via NUS
 
+/**** IMU ****/
+#define BSP_IMU_ODR_HZ 26 // default streaming ODR, fusion runs at this rate
+
+#define BSP_IMU_ACC_SCALE 100   // IMU_SAMPLE_ST accel unit, m/s^2 x100
+#define BSP_IMU_GYRO_SCALE 1000 // IMU_SAMPLE_ST gyro unit, rad/s x1000
+#define BSP_IMU_RING_SIZE 64    // acquisition -> consumer ring, power of 2
+
+#define BSP_IMU_OUT_RAW (1 << 0)   // NUS_MSG_NOTIFY_IMU every sample
+#define BSP_IMU_OUT_QUAT (1 << 1)  // NUS_MSG_NOTIFY_QUAT at fusionRate
+#define BSP_IMU_OUT_EULER (1 << 2) // NUS_MSG_NOTIFY_EULER at fusionRate
+#define BSP_IMU_OUT_MOTION (1 << 3) // tap/free fall/step/shake events
+#define BSP_IMU_OUT_VIB (1 << 4)    // NUS_MSG_NOTIFY_VIB per window and axis
+#define BSP_IMU_OUT_CLASS (1 << 5)  // NUS_MSG_NOTIFY_ML_CLASS every model hop
+#define BSP_IMU_OUT_FUSION (BSP_IMU_OUT_QUAT | BSP_IMU_OUT_EULER)
+
+#define BSP_DEFAULT_IMU_OUT_MASK BSP_IMU_OUT_RAW
+#define BSP_DEFAULT_FUSION_RATE_HZ 5
+#define BSP_DEFAULT_FUSION_BETA 0.1f // Madgwick gain
+
+/* Motion event defaults, accel in m/s^2 x100 (981 = 1 G) */
+#define BSP_DEFAULT_TAP_THR 800 // |a| change between two samples
+#define BSP_DEFAULT_TAP_QUIET_MS 80
+#define BSP_DEFAULT_DOUBLE_TAP_MS 400
+#define BSP_DEFAULT_FF_THR 300 // |a| below ~0.3 G
+#define BSP_DEFAULT_FF_MIN_MS 150
+#define BSP_DEFAULT_STEP_THR 250 // peak above gravity
+#define BSP_DEFAULT_STEP_MIN_MS 300
+#define BSP_DEFAULT_SHAKE_THR 800
+#define BSP_DEFAULT_SHAKE_COUNT 4 // swings with alternating sign
+#define BSP_DEFAULT_SHAKE_WIN_MS 1000
+
+// IMU power mode
+#define BSP_IMU_MODE_CONTINUOUS 0 // accel + gyro streaming on data-ready
+#define BSP_IMU_MODE_WOM 1        // accel only at low ODR + slope irq, streams while moving
+
+#define BSP_IMU_STATE_SLEEP 0  // wake-on-motion armed, gyro powered down
+#define BSP_IMU_STATE_STREAM 1 // data-ready streaming
+
+#define BSP_IMU_WOM_ODR_HZ 12 // 12.5 Hz accel while armed
+#define BSP_DEFAULT_IMU_MODE BSP_IMU_MODE_CONTINUOUS
+#define BSP_DEFAULT_IMU_IDLE_MS 10000  // no activity for this long -> back to sleep
+#define BSP_DEFAULT_IMU_WAKE_THR 50    // slope threshold, m/s^2 x100
+#define BSP_DEFAULT_IMU_ACT_GYRO_THR 150 // keeps streaming while |gyro| above, rad/s x1000
+
+// IMU calibration commands, 0..6 collect one step
+#define BSP_IMU_CAL_GYRO 0   // still, any orientation
+#define BSP_IMU_CAL_ACC_XP 1 // +X up
+#define BSP_IMU_CAL_ACC_XN 2
+#define BSP_IMU_CAL_ACC_YP 3
+#define BSP_IMU_CAL_ACC_YN 4
+#define BSP_IMU_CAL_ACC_ZP 5
+#define BSP_IMU_CAL_ACC_ZN 6
+#define BSP_IMU_CAL_SAVE 7
+#define BSP_IMU_CAL_ABORT 8
+#define BSP_IMU_CAL_CLEAR 9
+#define BSP_IMU_CAL_STEPS 7
+
+#define BSP_IMU_CAL_SAMPLES 64    // samples averaged per step
+#define BSP_IMU_CAL_STILL_THR 50  // max gyro swing during a step, rad/s x1000
+
+// Vibration features
+#define BSP_VIB_MIN_WIN 64
+#define BSP_VIB_MAX_WIN 512 // float buffers are 3 x this, RAM
+#define BSP_VIB_BANDS 8
+#define BSP_DEFAULT_VIB_WIN 256
+
+// IMU history, RAM budget (16 bytes per sample, ~78 s at 26 Hz)
+#define BSP_IMU_HIST_RAM (32 * 1024)
+
+// IMU decimation filter bank subscribers
+#define BSP_DECIM_SUB_RAW 0  // NUS_MSG_NOTIFY_IMU stream
+#define BSP_DECIM_SUB_HIST 1 // RAM history
+#define BSP_DECIM_SUBS 4
+#define BSP_DECIM_FULL_RATE 0xFFFF // every ODR sample
+#define BSP_DEFAULT_DECIM_RAW_HZ BSP_IMU_ODR_HZ
+#define BSP_DEFAULT_DECIM_HIST_HZ BSP_DECIM_FULL_RATE
+
+// Bulk transfer
+#define BSP_BULK_FRAME_MAX 244 // ATT MTU 247 - 3
+#define BSP_BULK_STREAM_IMU_HIST 1
+#define BSP_BULK_STREAM_AUDIO_CLIP 2
+#define BSP_BULK_STREAM_TSLOG 3
+
+#define BSP_BULK_EVT_START 0
+#define BSP_BULK_EVT_END 1
+#define BSP_BULK_EVT_ABORT 2
+
+// IMU classifier
+#define BSP_ML_MODEL_MAX 4096  // model blob RAM copy, also stored in NVS
+#define BSP_ML_ARENA_SIZE 1024 // input history + activations
+
+// Microphone streaming, IMA-ADPCM 4:1
+#define BSP_AUDIO_RATE_HZ 16000
+#define BSP_AUDIO_BLOCK_SAMPLES 160 // 10 ms PCM block, 80 bytes once encoded
+#define BSP_AUDIO_MAX_BLOCKS_PER_FRAME 2 // (BSP_BULK_FRAME_MAX - header) / 80
+
+// Audio pipeline sinks, each holds a reference on the PCM blocks it has queued
+#define BSP_AUDIO_SINK_BLE 0
+#define BSP_AUDIO_SINK_FLASH 1 // clip recorder
+#define BSP_AUDIO_SINK_SLM 2   // sound level meter
+#define BSP_AUDIO_SINK_AED 3   // acoustic event detector
+#define BSP_AUDIO_SINKS 4
+
+// Voice activity detector, per 10 ms block
+#define BSP_AUDIO_VAD_THR 4         // energy over the noise floor, x4 = 6 dB
+#define BSP_AUDIO_VAD_MIN_ENERGY 64 // mean square, below is silence whatever the floor
+#define BSP_AUDIO_VAD_ZCR_MAX 60    // zero crossings per block, above needs 4x the energy (hiss)
+#define BSP_AUDIO_VAD_HANG 30       // blocks kept open after the last voice block
+
+// Sound level meter
+#define BSP_SLM_BANDS 7             // octave bands 63 Hz .. 4 kHz
+#define BSP_SLM_SPL_AT_0DBFS 120.0f // MSM261D -26 dBFS at 94 dB SPL
+#define BSP_SLM_MIN_INTERVAL_MS 100
+#define BSP_DEFAULT_SLM_INTERVAL_MS 0 // off, the mic only runs when asked
+
+// Audio clips on the external QSPI flash (P25Q16H, 2 MB)
+#define BSP_QSPI_SECTOR 4096
+#define BSP_CLIP_REGION_OFF 0x000000
+#define BSP_CLIP_REGION_SIZE 0x100000 // first 1 MB
+#define BSP_CLIP_SLOT_SIZE 0x10000    // 16 slots, header page + ~8 s of ADPCM each
+#define BSP_CLIP_RING (300 * 80)      // RAM ADPCM ring, 3 s of 10 ms blocks
+#define BSP_CLIP_MAX_PRE_MS 2000      // leaves 1 s of ring for flash write lag
+#define BSP_DEFAULT_CLIP_PRE_MS 2000
+#define BSP_DEFAULT_CLIP_POST_MS 3000
+#define BSP_CLIP_MAGIC 0x50494C43 // "CLIP"
+
+#define BSP_CLIP_TRIG_MANUAL 0
+#define BSP_CLIP_TRIG_BUTTON 1
+#define BSP_CLIP_TRIG_SHOCK 2 // motion tap / free fall
+#define BSP_CLIP_TRIG_SCHED 3 // RTC alarm / timer job
+
+// Acoustic event detector
+#define BSP_AED_TONES 4
+#define BSP_AED_SUB 32               // envelope sub-block, 2 ms
+#define BSP_AED_MIN_LEVEL 100        // sub-block mean abs, quieter impulses are ignored
+#define BSP_AED_REFRACT_MS 250       // one impulse event per knock/clap
+#define BSP_AED_CLAP_HF 30           // % HF energy (first difference) above which an impulse is a clap
+#define BSP_AED_TONE_MIN_MS 300      // tone present this long before it is reported
+#define BSP_DEFAULT_AED_IMPULSE_THR 8 // fast / background envelope, x8 = 18 dB
+#define BSP_DEFAULT_AED_TONE_PCT 50  // % of the block energy in the Goertzel bin
+
+#define BSP_AED_EVT_KNOCK 1
+#define BSP_AED_EVT_CLAP 2
+#define BSP_AED_EVT_TONE 3 // ARG : tone slot, LEVEL : % energy in the bin
+
+// Wall clock (PCF8563 disciplined)
+#define BSP_WALL_RESYNC_S 600     // RTC read period once synced, BSP_PRD_JOB_WALL default
+#define BSP_WALL_EDGE_POLL_MS 10  // seconds edge hunt, anchor error ~ half of it
+
+// RTC alarm / timer jobs (PCF8563 INT)
+#define BSP_RTC_TIMER_1HZ 2    // countdown source, PCF8563 TD
+#define BSP_RTC_TIMER_1_60HZ 3
+#define BSP_RTC_IRQ_ALARM (1 << 0)
+#define BSP_RTC_IRQ_TIMER (1 << 1)
+#define BSP_RSCHED_ACT_NOTIFY (1 << 0) // NUS_MSG_NOTIFY_RTC_SCHED with the latest IMU sample
+#define BSP_RSCHED_ACT_CLIP (1 << 1)   // audio clip, BSP_CLIP_TRIG_SCHED
+
+// I2C transaction manager (i2c1, expansion board bus)
+#define BSP_I2C_LANE_SENSOR 0 // highest
+#define BSP_I2C_LANE_RTC 1
+#define BSP_I2C_LANE_DISP 2
+#define BSP_I2C_LANES 3
+#define BSP_I2C_DEV_RTC 0
+#define BSP_I2C_DEV_OLED 1
+#define BSP_I2C_DEVS 2
+#define BSP_I2C_ADDR_OLED 0x3C       // SSD1306 on the expansion board
+#define BSP_I2C_BATCH_MSGS 8         // messages per i2c_transfer
+#define BSP_I2C_DISP_MAX_BYTES 129   // control byte + one 128 column page
+
+// Time-series log on the external QSPI flash, after the clips
+#define BSP_TSLOG_REGION_OFF 0x100000
+#define BSP_TSLOG_REGION_SIZE 0x100000 // second 1 MB, 256 sectors
+#define BSP_TSLOG_MAGIC 0x474F4C54     // "TLOG"
+#define BSP_TSLOG_MAX_PAYLOAD 32
+#define BSP_TSLOG_FLUSH_MS 10000 // a staged record reaches flash within this
+
+#define BSP_TSLOG_T_BOOT 1   // BOOT_COUNT(4)
+#define BSP_TSLOG_T_MOTION 2 // EVT(1) | ARG(2)
+#define BSP_TSLOG_T_AED 3    // EVT(1) | ARG(2) | LEVEL(2)
+#define BSP_TSLOG_T_SLM 4    // LAEQ(2) | LPEAK(2) | BAND(2) x 7
+#define BSP_TSLOG_T_SCHED 5  // SRC(1) | IMU_SAMPLE(18)
+#define BSP_TSLOG_T_CLIP 6   // CLIP_ID(4) | SRC(1)
+#define BSP_DEFAULT_TSLOG_MASK 0x006E // BOOT, MOTION, AED, SCHED, CLIP (SLM only when asked)
+
+// NVS wear / latency (internal flash storage_partition)
+#define BSP_NVS_HIST_BINS 12     // write / GC latency, bin n : < 125 us << n, last one open ended
+#define BSP_NVS_HIST_BASE_US 125
+#define BSP_NVS_ENDURANCE 10000  // nRF52840 flash erase cycles (datasheet minimum)
+#define BSP_NVS_GC_US 60000      // a write this long ran a GC (page erase ~85 ms)
+
+// Retained RAM (boot count, run stats, last fault)
+#define BSP_RET_MAGIC 0x4E544552     // "RETN"
+#define BSP_RET_SNAPSHOT_S 10        // run counters into retained RAM, BSP_PRD_JOB_STATS default
+#define BSP_RET_NVS_FLUSH_S 3600     // retained block to NVS, and at a clean shutdown
+
+// Settings (one NVS entry per key)
+#define BSP_SETTINGS_FLUSH_MS 2000      // coalescing window after the first change
+#define BSP_SETTINGS_DEFER_MAX_MS 60000 // longest wait for the radio to go quiet
+#define BSP_SET_MAX_LEN 120 // RETAINED_ST
+#define BSP_SET_TYPE_U8 0
+#define BSP_SET_TYPE_U16 1
+#define BSP_SET_TYPE_U32 2
+#define BSP_SET_TYPE_BLOB 3
+
 /*********************************************************/
 typedef struct PACKED LSM6DS3TR_S
 {
     struct sensor_value accel[3];
     struct sensor_value gyro[3];
 
+    // latest sample, BSP_IMU_ACC_SCALE/BSP_IMU_GYRO_SCALE, read via bsp_imu_get_latest()
     int16_t acc_x;
     int16_t acc_y;
     int16_t acc_z;
@@ -68,11 +294,198 @@ typedef struct PACKED LSM6DS3TR_S
     int16_t gyro_z;
 
     uint8_t isInit;
-    uint8_t reserved1;
-    uint8_t reserved2;
+    uint8_t outMask;      // BSP_IMU_OUT_xxx
+    uint8_t fusionRateHz; // quaternion/euler notify rate
     uint8_t reserved3;
 } LSM6DS3TR_ST;
 
+/* One acquisition record, fixed size, passed through the IMU ring */
+typedef struct PACKED IMU_SAMPLE_S
+{
+    int16_t acc[3];  // x/y/z, BSP_IMU_ACC_SCALE
+    int16_t gyro[3]; // x/y/z, BSP_IMU_GYRO_SCALE
+    uint32_t ts;     // bsp_time_us() at data-ready (low 32 bits, wraps ~71 min)
+    uint16_t seq;    // acquisition counter, gaps mean lost samples
+} IMU_SAMPLE_ST;
+
+typedef struct PACKED IMU_CAL_S
+{
+    uint8_t valid;
+    int16_t gyroBias[3];  // rad/s x1000
+    int16_t accOffset[3]; // m/s^2 x100
+    uint16_t accGain[3];  // Q14, 16384 = 1.0
+} IMU_CAL_ST;
+
+typedef struct PACKED VIB_FEAT_S
+{
+    uint16_t rms;   // m/s^2 x100, DC removed
+    uint16_t peak;  // m/s^2 x100, DC removed
+    uint16_t crest; // x100
+    uint16_t kurt;  // x100, 300 for gaussian
+    uint16_t band[BSP_VIB_BANDS]; // band RMS m/s^2 x100, equal width 0..ODR/2
+} VIB_FEAT_ST;
+
+typedef struct PACKED VIB_S
+{
+    uint16_t win;
+    uint32_t windows;
+    VIB_FEAT_ST feat[3]; // last window, x/y/z
+} VIB_ST;
+
+typedef struct PACKED ML_S
+{
+    uint8_t loaded;
+    uint8_t classes;
+    uint16_t winLen;
+    uint16_t hop;
+    uint16_t modelSize;
+    uint16_t arenaUsed;
+    uint16_t arenaSize;
+    uint32_t inferences;
+    uint32_t latUs; // last inference
+    uint32_t latMaxUs;
+    uint8_t lastClass;
+    uint8_t lastConf; // %
+} ML_ST;
+
+typedef struct PACKED IMU_POWER_S
+{
+    uint8_t mode;     // BSP_IMU_MODE_xxx
+    uint8_t state;    // BSP_IMU_STATE_xxx
+    uint16_t odrHz;   // streaming ODR
+    uint16_t idleMs;  // WOM only, idle time before going back to sleep
+    uint16_t wakeThr; // WOM only, slope threshold m/s^2 x100
+    uint32_t transitions;
+    uint32_t stateMs[2]; // total time spent per BSP_IMU_STATE_xxx
+    int64_t stateStartMs;
+} IMU_POWER_ST;
+
+typedef struct PACKED IMU_HIST_STAT_S
+{
+    uint32_t capacity; // samples
+    uint32_t count;
+    uint32_t spanMs; // oldest to newest
+} IMU_HIST_STAT_ST;
+
+typedef struct PACKED IMU_DECIM_STAT_S
+{
+    uint8_t used;
+    uint16_t reqHz;
+    uint16_t odrHz;
+    uint16_t factor; // cic x fir
+    uint16_t cic;
+    uint8_t fir;
+    uint8_t taps;
+    uint16_t outputs; // output sample counter (wraps)
+} IMU_DECIM_STAT_ST;
+
+typedef struct PACKED ADPCM_STATE_S
+{
+    int16_t predictor;
+    int8_t index; // step table index 0..88
+} ADPCM_STATE_ST;
+
+typedef struct PACKED AUDIO_BLK_S
+{
+    void *pcm;     // slab block, BSP_AUDIO_BLOCK_SAMPLES int16, bsp_audio_block_release() when done
+    uint32_t ts;   // bsp_time_us() low 32 bits at capture
+    uint8_t voice; // VAD decision, 1 when the VAD is off
+    uint8_t start; // first block a gated sink gets after silence
+} AUDIO_BLK_ST;
+
+typedef struct PACKED AUDIO_STAT_S
+{
+    uint8_t running;
+    uint8_t vad;
+    uint8_t voice;          // current VAD state
+    uint8_t blocksPerFrame; // from the MTU at stream start
+    uint32_t blocks;        // PCM blocks captured
+    uint32_t dropped;       // blocks lost, queue full or notification failed
+    uint32_t gated;         // silent blocks not sent
+    uint32_t voiceBlocks;
+    uint32_t vadFloor; // noise floor, mean square
+    uint32_t frames;
+    uint32_t bytes; // notified, headers included
+    uint32_t budgetBps;
+    uint32_t actualBps;
+    int64_t startMs;
+} AUDIO_STAT_ST;
+
+typedef struct PACKED SLM_S
+{
+    uint16_t intervalMs;         // 0 : off
+    int16_t laeq;                // A weighted Leq over the interval, 0.01 dB SPL
+    int16_t lpeak;               // A weighted peak, 0.01 dB SPL
+    int16_t band[BSP_SLM_BANDS]; // octave band Leq, 0.01 dB SPL
+    uint32_t ts;                 // device us at the end of the interval
+    uint32_t reports;
+} SLM_ST;
+
+typedef struct PACKED CLIP_HDR_S
+{
+    uint32_t magic; // BSP_CLIP_MAGIC, written last
+    uint32_t id;    // 1.., increasing
+    uint32_t len;   // ADPCM bytes after the header page
+    int64_t trigUs; // bsp_time_us() at the trigger
+    uint16_t rateHz;
+    uint16_t preMs;
+    uint8_t src;   // BSP_CLIP_TRIG_xxx
+    int16_t pred;  // encoder state at the first sample
+    uint8_t index;
+} CLIP_HDR_ST;
+
+typedef struct PACKED CLIP_STAT_S
+{
+    uint8_t armed;
+    uint8_t busy; // clip being written
+    uint16_t preMs;
+    uint16_t postMs;
+    uint8_t clips; // stored
+    uint32_t lastId;
+    uint32_t triggers;
+    uint32_t ignored;  // while busy or disarmed
+    uint32_t overruns; // flash fell behind the ring
+} CLIP_STAT_ST;
+
+typedef struct PACKED AED_S
+{
+    uint8_t on;
+    uint8_t impulseThr;
+    uint8_t tonePct;
+    uint16_t toneHz[BSP_AED_TONES]; // 0 : slot unused
+    uint32_t events;
+    uint8_t lastEvt; // BSP_AED_EVT_xxx
+    uint16_t cpuUs;  // mean processing time per 10 ms block
+} AED_ST;
+
+typedef struct PACKED IMU_RING_STAT_S
+{
+    uint32_t pushed;
+    uint32_t popped;
+    uint32_t overflow; // samples dropped because the consumer was behind
+    uint16_t highWater; // max fill level seen
+    uint16_t size;
+} IMU_RING_STAT_ST;
+
+typedef struct PACKED IMU_BENCH_S
+{
+    uint32_t samples;
+    uint32_t errors;
+    uint64_t cpuCycles;  // imu_task execution cycles over the window
+    uint32_t latSumUs;   // data-ready to ring push
+    uint32_t latMaxUs;
+    uint8_t rtio;        // 1 : async read-and-decode, 0 : blocking fetch
+    uint8_t threads;     // threads involved in acquisition
+    uint64_t busyCycles; // non-idle cycles of all threads over the window
+} IMU_BENCH_ST;
+
+typedef struct PACKED IMU_FUSION_S
+{
+    int16_t q[4];     // w, x, y, z in Q14 (16384 = 1.0)
+    int16_t euler[3]; // roll, pitch, yaw in 0.01 deg
+    uint32_t count;   // filter updates since init
+} IMU_FUSION_ST;
+
 typedef struct PACKED LED_S
 {
     uint8_t led_red;
@@ -85,9 +498,39 @@ typedef struct PACKED LED_S
 
 typedef struct PACKED BATT_ADC_S
 {
-    int value;
+    int value;        // raw ADC
+    uint16_t mv;      // VBAT
+    uint32_t samples;
 } BATT_ADC_ST;
 
+typedef struct PACKED PRD_JOB_STAT_S
+{
+    uint32_t runs;
+    uint32_t overruns; // deadlines skipped
+    uint32_t jitAvgUs; // start - deadline
+    uint32_t jitMaxUs;
+    uint32_t runAvgUs;
+    uint32_t runMaxUs;
+} PRD_JOB_STAT_ST;
+
+typedef struct PACKED EVQ_EVT_STAT_S
+{
+    uint32_t posted;   // posts while pending coalesce, posted - runs
+    uint32_t runs;
+    uint32_t latAvgUs; // post to handler start
+    uint32_t latMaxUs;
+    uint32_t runMaxUs;
+} EVQ_EVT_STAT_ST;
+
+typedef struct PACKED EVQ_S
+{
+    uint16_t stackSize;
+    uint16_t stackUsed; // high water, CONFIG_INIT_STACKS
+    EVQ_EVT_STAT_ST evt[BSP_EVTS];
+    uint16_t mainStackSize;
+    uint16_t mainStackUsed; // driver init + main(), final once main returned
+} EVQ_ST;
+
 typedef struct PACKED RTC_TIME_S
 {
     uint8_t year; // Years since 2000
@@ -99,6 +542,49 @@ typedef struct PACKED RTC_TIME_S
     uint8_t sec;
 } RTC_TIME_ST;
 
+typedef struct PACKED TIME_SYNC_S
+{
+    int64_t offset;   // central clock - device clock in us, at refTime
+    int64_t refTime;  // device time (bsp_time_us) of the offset estimate
+    int32_t driftPpb; // central clock rate vs device clock, parts per billion
+    uint32_t errUs;   // estimated sync error (half min round trip + residual)
+    uint8_t samples;  // exchanges in the estimate window
+    uint8_t isSync;
+} TIME_SYNC_ST;
+
+enum MOTION_EVT_EN
+{
+    MOTION_EVT_NONE = 0,
+    MOTION_EVT_TAP = 1,
+    MOTION_EVT_DOUBLE_TAP = 2,
+    MOTION_EVT_FREE_FALL = 3,
+    MOTION_EVT_STEP = 4,
+    MOTION_EVT_SHAKE = 5,
+};
+
+typedef struct PACKED MOTION_CFG_S
+{
+    uint16_t tapThr;
+    uint16_t tapQuietMs;
+    uint16_t doubleTapMs;
+    uint16_t ffThr;
+    uint16_t ffMinMs;
+    uint16_t stepThr;
+    uint16_t stepMinMs;
+    uint16_t shakeThr;
+    uint16_t shakeCount;
+    uint16_t shakeWinMs;
+} MOTION_CFG_ST;
+
+typedef struct PACKED MOTION_S
+{
+    MOTION_CFG_ST cfg;
+
+    uint32_t stepCount;
+    uint32_t evtCount;
+    uint8_t lastEvt; // MOTION_EVT_xxx
+} MOTION_ST;
+
 typedef struct PACKED NVS_INFO_S
 {
     uint16_t unique_id; // 0xa55a
@@ -108,6 +594,185 @@ typedef struct PACKED NVS_INFO_S
 
 } NVS_INFO_ST;
 
+typedef struct PACKED WALL_CLOCK_S
+{
+    int64_t epochMs;    // wall time (UTC ms) at refUs
+    int64_t refUs;      // device time (bsp_time_us) of the anchor
+    int64_t lastSyncUs; // device time of the last RTC seconds edge
+    int32_t driftPpb;   // RTC rate vs device clock, parts per billion
+    int32_t stepMs;     // correction applied at the last sync
+    uint32_t syncs;
+    uint16_t errors;
+    uint8_t valid;
+} WALL_CLOCK_ST;
+
+typedef struct PACKED RTC_SCHED_S
+{
+    int8_t alarmHour; // -1 : off
+    int8_t alarmMin;
+    uint8_t alarmAct; // BSP_RSCHED_ACT_xxx
+    uint16_t everySec; // 0 : off
+    uint8_t timerAct;
+    uint32_t alarms;
+    uint32_t timers;
+    int64_t lastMs;   // wall time of the last job
+    uint8_t lastSrc;  // BSP_RTC_IRQ_xxx
+    uint8_t hasInt;   // INT pin wired (rtc-int alias)
+} RTC_SCHED_ST;
+
+typedef struct PACKED I2C_STAT_S
+{
+    uint32_t xfers;
+    uint32_t batched; // went out together with the previous one
+    uint16_t errors;
+    uint16_t full;    // lane queue full on submit
+    uint32_t waitAvgUs; // queued -> on the bus
+    uint32_t waitMaxUs;
+    uint32_t busAvgUs;
+    uint32_t busMaxUs;
+} I2C_STAT_ST;
+
+enum BSP_SET_KEY_EN
+{
+    BSP_SET_BOOT_COUNT = 0,
+    BSP_SET_PRD_TICK,
+    BSP_SET_LED_PWM,
+    BSP_SET_IMU_OUT,
+    BSP_SET_IMU_FUSION_RATE,
+    BSP_SET_IMU_MODE,
+    BSP_SET_IMU_ODR,
+    BSP_SET_IMU_IDLE,
+    BSP_SET_IMU_CAL,
+    BSP_SET_CONN_PROFILE,
+    BSP_SET_NVS_ERASES,
+    BSP_SET_RETAINED,
+    BSP_SET_PRD_PERIODS,
+    BSP_SET_KEYS,
+};
+
+typedef struct PACKED CONN_PROFILE_S
+{
+    uint16_t intMin;  // 1.25 ms units, 0 : leave it to the central
+    uint16_t intMax;
+    uint16_t latency; // connection events
+    uint16_t timeout; // 10 ms units
+} CONN_PROFILE_ST;
+
+typedef struct PACKED NVS_STAT_S
+{
+    uint8_t sectors;
+    uint16_t sectorSize;
+    uint32_t freeBytes;    // nvs_calc_free_space
+    uint32_t writes;       // since boot, unchanged data not counted
+    uint32_t gcs;          // since boot, writes taking BSP_NVS_GC_US or more
+    uint32_t erases;       // lifetime, BSP_SET_NVS_ERASES
+    uint16_t lifePermille; // erase budget left
+    uint32_t lifeDays;     // at this boot's GC rate, UINT32_MAX : no GC yet
+    uint32_t wrMaxUs;
+    uint32_t gcMaxUs;
+    uint16_t wrHist[BSP_NVS_HIST_BINS];
+    uint16_t gcHist[BSP_NVS_HIST_BINS];
+} NVS_STAT_ST;
+
+typedef struct PACKED BLE_STAT_S
+{
+    uint32_t tx;      // notifications sent (messages and bulk frames)
+    uint32_t txErr;   // bt_nus_send failed, connected
+    uint32_t txBytes;
+} BLE_STAT_ST;
+
+typedef struct PACKED RET_RUN_S
+{
+    uint32_t uptimeS;
+    uint32_t bleTx;
+    uint32_t bleTxErr;
+    uint32_t bleTxBytes;
+    uint32_t audioDropped;
+    uint32_t imuOverflow;
+    uint32_t tslogDropped;
+    uint16_t i2cFull; // all devices
+    uint16_t nvsGcs;
+} RET_RUN_ST;
+
+typedef struct PACKED RET_FAULT_S
+{
+    uint32_t reason;    // K_ERR_xxx
+    uint32_t pc;
+    uint32_t lr;
+    uint32_t uptimeS;
+    uint32_t bootCount; // run that died
+    char thread[8];
+} RET_FAULT_ST;
+
+typedef struct PACKED RETAINED_S
+{
+    uint32_t magic;      // BSP_RET_MAGIC
+    uint32_t bootCount;
+    uint32_t resetCause; // hwinfo RESET_xxx of this boot
+    uint32_t totalUptimeS; // runs before this one
+    uint16_t faults;
+    RET_RUN_ST run;      // this run, as of the last snapshot
+    RET_RUN_ST prev;     // run before the last reset
+    RET_FAULT_ST fault;  // last fatal error
+    uint32_t crc;        // crc32 ieee of the above
+} RETAINED_ST;
+
+typedef struct PACKED SETTINGS_STAT_S
+{
+    uint8_t keys;
+    uint8_t stored;      // keys found in NVS at boot
+    uint32_t flushes;
+    uint32_t writes;     // NVS entries written
+    uint32_t deferredMs; // flush held back for the radio
+    uint16_t errors;
+} SETTINGS_STAT_ST;
+
+/* Time-series log, on flash as is (little endian) */
+typedef struct PACKED TSLOG_SECT_S
+{
+    uint32_t magic;  // BSP_TSLOG_MAGIC
+    uint32_t seq;    // +1 per sector opened
+    int64_t baseMs;  // epoch ms, record times are relative to it
+} TSLOG_SECT_ST;
+
+typedef struct PACKED TSLOG_REC_S
+{
+    uint8_t type;  // BSP_TSLOG_T_xxx, 0xFF : end of the sector
+    uint8_t len;   // payload, padded to 4 bytes on flash
+    uint8_t crc;   // crc8 ccitt of the record with crc 0, then the payload
+    uint8_t rsvd;
+    uint32_t dtMs; // from the sector baseMs
+} TSLOG_REC_ST;
+
+typedef struct PACKED TSLOG_S
+{
+    uint16_t mask;    // BIT(BSP_TSLOG_T_xxx), 0 : off
+    uint16_t sectors; // with data
+    uint32_t records; // appended since boot
+    uint32_t dropped; // not synced, queue full or flash error
+    uint32_t flushes; // page programs
+    uint32_t erases;
+    int64_t oldestMs;
+    int64_t newestMs;
+} TSLOG_ST;
+
+struct i2c_msg;
+typedef struct BSP_I2C_XFER_S BSP_I2C_XFER_ST;
+typedef void (*bsp_i2c_done_t)(BSP_I2C_XFER_ST *x);
+
+/* Not packed, owned by the I2C thread from submit to completion */
+struct BSP_I2C_XFER_S
+{
+    struct i2c_msg *msgs;
+    uint8_t num;
+    uint8_t dev;         // BSP_I2C_DEV_xxx, gives address and lane
+    int result;          // i2c_transfer result once done
+    int64_t queuedUs;
+    bsp_i2c_done_t done; // I2C thread context, NULL : sem is given instead
+    void *ctx;
+    struct k_sem sem;
+};
+
 /*********************************************************/
 typedef struct PACKED BSP_S
 {
@@ -115,14 +780,60 @@ typedef struct PACKED BSP_S
 
     uint16_t prdTick; // periodic task tick count in ms
 
+    uint32_t prdPeriodMs[BSP_PRD_JOBS];
+
+    PRD_JOB_STAT_ST prdStat[BSP_PRD_JOBS];
+
+    EVQ_ST evq;
+
     LED_ST led_status;
 
     BATT_ADC_ST batt_adc;
 
     LSM6DS3TR_ST imu;
 
+    IMU_POWER_ST imuPwr;
+
+    IMU_CAL_ST imuCal;
+
+    VIB_ST vib;
+
+    ML_ST ml;
+
+    AUDIO_STAT_ST audio;
+
+    SLM_ST slm;
+
+    CLIP_STAT_ST clip;
+
+    AED_ST aed;
+
+    IMU_FUSION_ST fusion;
+
+    MOTION_ST motion;
+
     RTC_TIME_ST rtc;
 
+    TIME_SYNC_ST tsync;
+
+    WALL_CLOCK_ST wall;
+
+    RTC_SCHED_ST rsched;
+
+    I2C_STAT_ST i2c[BSP_I2C_DEVS];
+
+    CONN_PROFILE_ST connProfile;
+
+    SETTINGS_STAT_ST settings;
+
+    NVS_STAT_ST nvsStat;
+
+    BLE_STAT_ST ble;
+
+    RETAINED_ST retNvs; // NVS copy of the retained block
+
+    TSLOG_ST tslog;
+
     NVS_INFO_ST nvs;
 } BSP_ST;
 
@@ -132,6 +843,7 @@ struct PACKED nus_msg_packet
     uint16_t id;
     uint16_t len; // total received length of message includes id + len
     char message[BSP_MAX_MSG_LEN];
+    int64_t rx_us; // bsp_time_us() when the packet arrived over BLE, not sent
 };
 /*********************************************************/
 
@@ -145,25 +857,63 @@ enum NUS_MSG_EN
     NUS_MSG_LED_CTRL = 1, // ID(2) | LEN(2) | LED_NUM(1) | LED_ONOFF(1)
     NUS_MSG_GET_BATT_ADC = 2,
     NUS_MSG_SET_PWM_LED_WIDTH = 3, // ID(2) | LEN(2) | PULSE_WIDTH(4)
-    NUS_MSG_SET_PRD_TICK = 4,      // ID(2) | LEN(2) | PRD_TICK(2)
+    NUS_MSG_SET_PRD_TICK = 4,      // ID(2) | LEN(2) | PRD_TICK(2) [| JOB(1) | PERIOD_MS(4)], LEN 6 or 11 only, PERIOD_MS over PRD_TICK, 0 : off
     NUS_MSG_GET_RTC = 5,
     NUS_MSG_SET_RTC = 6,
     NUS_MSG_SET_BUZZER = 7,         // ID(2) | LEN(2) | FREQ(2) | DURATION(2)
-    NUS_MSG_06 = 8,
-    NUS_MSG_07 = 9,
-    NUS_MSG_08 = 10,
-    NUS_MSG_09 = 11,
-    NUS_MSG_10 = 12,
-    NUS_MSG_11 = 13,
-    NUS_MSG_12 = 14,
-    NUS_MSG_13 = 15,
-    NUS_MSG_NOTIFY_IMU = 16, // ID(2) | LEN(2) | ACC_X(2) | ACC_Y(2) | ACC_Z(2) | GYRO_X(2) | GYRO_Y(2) | GYRO_Z(2)
+    NUS_MSG_SET_IMU_OUTPUT = 8,     // ID(2) | LEN(2) | OUT_MASK(1) | FUSION_RATE_HZ(1)
+    NUS_MSG_TIME_SYNC_REQ = 9,     // ID(2) | LEN(2) | T1(8), central us
+    NUS_MSG_TIME_SYNC_RESULT = 10, // ID(2) | LEN(2) | T1(8) | T4(8), central us
+    NUS_MSG_SET_MOTION_CFG = 11,   // ID(2) | LEN(2) | TAP_THR(2) | FF_THR(2) | STEP_THR(2) | SHAKE_THR(2), 0 keeps
+    NUS_MSG_SET_IMU_MODE = 12,     // ID(2) | LEN(2) | MODE(1) | ODR_HZ(2) | IDLE_MS(2), 0 keeps
+    NUS_MSG_IMU_CAL = 13,          // ID(2) | LEN(2) | CMD(1), BSP_IMU_CAL_xxx
+    NUS_MSG_SET_VIB_CFG = 14,      // ID(2) | LEN(2) | WIN(2)
+    NUS_MSG_ML_MODEL = 15,         // ID(2) | LEN(2) | OFFSET(4) | DATA(n), OFFSET 0xFFFFFFFF commits
+    NUS_MSG_NOTIFY_IMU = 16, // ID(2) | LEN(2) | ACC_X(2) | ACC_Y(2) | ACC_Z(2) | GYRO_X(2) | GYRO_Y(2) | GYRO_Z(2) | SEQ(2) | TS(4)
     NUS_MSG_NOTIFY_RTC = 17, // ID(2) | LEN(2) | YEAR(2) | MON(2) | DAY(2) | WEEKDAY(2) | HOUR(2) | MIN(2) | SEC(2)
-    NUS_MSG_16 = 18,
-    NUS_MSG_17 = 19,
-    NUS_MSG_18 = 20,
-    NUS_MSG_19 = 21,
-    NUS_MSG_20 = 22,
+    NUS_MSG_NOTIFY_QUAT = 18,  // ID(2) | LEN(2) | QW(2) | QX(2) | QY(2) | QZ(2), Q14
+    NUS_MSG_NOTIFY_EULER = 19, // ID(2) | LEN(2) | ROLL(2) | PITCH(2) | YAW(2), 0.01 deg
+    NUS_MSG_NOTIFY_TIME_SYNC = 20,      // ID(2) | LEN(2) | T1(8) | T2(8) | T3(8), T2/T3 device us
+    NUS_MSG_NOTIFY_TIME_SYNC_STAT = 21, // ID(2) | LEN(2) | OFFSET(8) | DRIFT_PPB(4) | ERR_US(4) | SAMPLES(1)
+    NUS_MSG_NOTIFY_MOTION_EVT = 22, // ID(2) | LEN(2) | EVT(1) | ARG(2) | TS(4)
+    NUS_MSG_NOTIFY_IMU_POWER = 23,  // ID(2) | LEN(2) | MODE(1) | STATE(1) | PREV_STATE_MS(4) | TRANSITIONS(4)
+    NUS_MSG_NOTIFY_IMU_CAL = 24,    // ID(2) | LEN(2) | CMD(1) | STATUS(1) | DONE_MASK(1)
+    NUS_MSG_NOTIFY_VIB = 25,        // ID(2) | LEN(2) | AXIS(1) | WIN(2) | ODR(2) | TS(4) | RMS(2) | PEAK(2) | CREST(2) | KURT(2) | BAND(2) x 8
+    NUS_MSG_NOTIFY_ML_CLASS = 26,   // ID(2) | LEN(2) | CLASS(1) | CONF(1) | LAT_US(2) | TS(4)
+    NUS_MSG_NOTIFY_ML_MODEL = 27,   // ID(2) | LEN(2) | OFFSET(4) | STATUS(1)
+    NUS_MSG_GET_IMU_HIST = 28,      // ID(2) | LEN(2) | FROM_MS(4) | TO_MS(4), ms before now, sent as bulk
+    NUS_MSG_NOTIFY_BULK = 29,       // ID(2) | LEN(2) | STREAM(1) | SEQ(2) | DATA(n)
+    NUS_MSG_NOTIFY_BULK_INFO = 30,  // ID(2) | LEN(2) | STREAM(1) | EVT(1) | TOTAL(4) | FRAMES(2)
+    NUS_MSG_SET_DECIM_RATE = 31,    // ID(2) | LEN(2) | SUB(1) | RATE_HZ(2), 0 : off, 0xFFFF : full ODR
+    NUS_MSG_SET_AUDIO_STREAM = 32,  // ID(2) | LEN(2) | ON(1) [| VAD(1)]
+    NUS_MSG_NOTIFY_AUDIO = 33,      // ID(2) | LEN(2) | SEQ(2) | PRED(2) | INDEX(1) | ADPCM(n), low nibble first
+    NUS_MSG_NOTIFY_AUDIO_STAT = 34, // ID(2) | LEN(2) | BLOCKS(4) | DROPPED(4) | GATED(4) | BUDGET_BPS(4) | ACTUAL_BPS(4)
+    NUS_MSG_SET_SLM_CFG = 35,       // ID(2) | LEN(2) | INTERVAL_MS(2), 0 : off
+    NUS_MSG_NOTIFY_SLM = 36,        // ID(2) | LEN(2) | LAEQ(2) | LPEAK(2) | BAND(2) x 7 | TS(4), 0.01 dB SPL
+    NUS_MSG_SET_CLIP_CFG = 37,      // ID(2) | LEN(2) | ARM(1) | PRE_MS(2) | POST_MS(2), 0 keeps
+    NUS_MSG_GET_CLIP = 38,          // ID(2) | LEN(2) | CLIP_ID(4), 0 : list as NOTIFY_CLIP, else sent as bulk
+    NUS_MSG_NOTIFY_CLIP = 39,       // ID(2) | LEN(2) | CLIP_ID(4) | LEN(4) | SRC(1) | PRE_MS(2) | TRIG_US(8)
+    NUS_MSG_CLIP_TRIGGER = 40,      // ID(2) | LEN(2)
+    NUS_MSG_SET_AED_CFG = 41,       // ID(2) | LEN(2) | ON(1) | IMPULSE_THR(1) | TONE_PCT(1) [| TONE_HZ(2) x 4], 0 keeps, TONE_HZ 0 : unused
+    NUS_MSG_NOTIFY_AED = 42,        // ID(2) | LEN(2) | EVT(1) | ARG(2) | LEVEL(2) | TS(4)
+    NUS_MSG_GET_WALL_CLOCK = 43,    // ID(2) | LEN(2), resyncs to the RTC then notifies
+    NUS_MSG_NOTIFY_WALL_CLOCK = 44, // ID(2) | LEN(2) | EPOCH_MS(8) | REF_US(8) | DRIFT_PPB(4) | STEP_MS(4) | SYNCS(4)
+    NUS_MSG_SET_RTC_ALARM = 45,     // ID(2) | LEN(2) | HOUR(1) | MIN(1) | ACT(1), HOUR 0xFF : off
+    NUS_MSG_SET_RTC_TIMER = 46,     // ID(2) | LEN(2) | SEC(2) | ACT(1), SEC 0 : off
+    NUS_MSG_NOTIFY_RTC_SCHED = 47,  // ID(2) | LEN(2) | SRC(1) | FIRES(4) | WALL_MS(8) | IMU_SAMPLE(18)
+    NUS_MSG_SET_CONN_PROFILE = 48,  // ID(2) | LEN(2) | INT_MIN(2) | INT_MAX(2) | LATENCY(2) | TIMEOUT(2), INT 0 : central decides
+    NUS_MSG_GET_LOG = 49,           // ID(2) | LEN(2) | FROM_MS(8) | TO_MS(8), epoch ms, 0 : open end, sectors sent as bulk
+    NUS_MSG_SET_LOG_CFG = 50,       // ID(2) | LEN(2) | MASK(2), BIT(BSP_TSLOG_T_xxx), 0 : off
+    NUS_MSG_NOTIFY_LOG_STAT = 51,   // ID(2) | LEN(2) | MASK(2) | SECTORS(2) | RECORDS(4) | DROPPED(4) | OLDEST_MS(8) | NEWEST_MS(8)
+    NUS_MSG_GET_NVS_STAT = 52,      // ID(2) | LEN(2) [| RESET(1)], RESET 1 : clear the latency histograms after
+    NUS_MSG_NOTIFY_NVS_STAT = 53,   // ID(2) | LEN(2) | SECTORS(1) | SECTOR_SIZE(2) | FREE(4) | WRITES(4) | GCS(4) | ERASES(4) | LIFE_PERMILLE(2) | LIFE_DAYS(4) | WR_MAX_US(4) | GC_MAX_US(4) | WR_HIST(2) x 12 | GC_HIST(2) x 12
+    NUS_MSG_GET_RETAINED = 54,      // ID(2) | LEN(2)
+    NUS_MSG_NOTIFY_RETAINED = 55,   // ID(2) | LEN(2) | RETAINED_ST, previous run counters and last fault included
+    NUS_MSG_GET_PRD_STAT = 56,      // ID(2) | LEN(2) [| JOB(1)], no JOB : all jobs
+    NUS_MSG_NOTIFY_PRD_STAT = 57,   // ID(2) | LEN(2) | JOB(1) | PERIOD_MS(4) | RUNS(4) | OVERRUNS(4) | JIT_AVG_US(4) | JIT_MAX_US(4) | RUN_AVG_US(4) | RUN_MAX_US(4)
+    NUS_MSG_NOTIFY_BATT = 58,       // ID(2) | LEN(2) | MV(2) | RAW(2) | SAMPLES(4)
+    NUS_MSG_GET_EVQ_STAT = 59,      // ID(2) | LEN(2) [| RESET(1)], RESET 1 : clear the stats after
+    NUS_MSG_NOTIFY_EVQ_STAT = 60,   // ID(2) | LEN(2) | STACK_SIZE(2) | STACK_USED(2) | [POSTED(4) | RUNS(4) | LAT_AVG_US(4) | LAT_MAX_US(4) | RUN_MAX_US(4)] x 3 | MAIN_STACK_SIZE(2) | MAIN_STACK_USED(2)
 };
 /*********************************************************/
 
@@ -175,26 +925,167 @@ int bsp_led_ctrl(int led, int val);
 int bsp_led_toggle(int led);
 int bsp_pwm_led_ctrl(uint32_t pulse_width);
 int bsp_key_init(void);
+void bsp_key_event(void);
 
 void cliTask(void *pvParameters);
 
 void bsp_sleep_sec(int sec);
 void bsp_sleep_ms(int ms);
 void bsp_sleep_us(int us);
+int64_t bsp_time_us(void);
 
 int bsp_nus_msg_send_to_rcv_task(struct nus_msg_packet *p, int len);
+void bsp_nus_msg_dispatch(void);
 void ble_nus_send_data(char *p, int len);
+int ble_nus_send_frame(const uint8_t *p, int len);
+int ble_nus_get_payload_len(void);
+int ble_conn_profile_apply(void);
+bool ble_conn_profile_valid(const CONN_PROFILE_ST *prof);
+void ble_adv_refresh(void);
+void ble_nus_alive(void);
+
+typedef int (*bsp_bulk_read_t)(uint32_t offset, uint8_t *buf, uint16_t len, void *ctx);
+int bsp_bulk_start(uint8_t stream, uint32_t total, bsp_bulk_read_t read, void *ctx);
+void bsp_bulk_abort(void);
+bool bsp_bulk_busy(void);
 
 int bsp_lsm6ds3tr_init(void *p);
 int bsp_lsm6ds3tr_read(void *p);
+int bsp_imu_set_output(uint8_t mask, uint8_t rate_hz);
+void bsp_imu_bench_get(IMU_BENCH_ST *b);
+void bsp_imu_bench_reset(void);
+int bsp_imu_set_mode(uint8_t mode, uint16_t odr_hz, uint16_t idle_ms);
+void bsp_imu_activity(const IMU_SAMPLE_ST *s);
+void bsp_imu_power_get(IMU_POWER_ST *pwr);
+
+int bsp_imu_ring_push(const IMU_SAMPLE_ST *s);
+IMU_SAMPLE_ST *bsp_imu_ring_peek(k_timeout_t timeout);
+void bsp_imu_ring_release(void);
+void bsp_imu_ring_get_stat(IMU_RING_STAT_ST *st);
+void bsp_imu_ring_reset_stat(void);
+void bsp_imu_set_latest(const IMU_SAMPLE_ST *s);
+void bsp_imu_get_latest(IMU_SAMPLE_ST *s);
+
+void bsp_imu_fusion_init(float beta);
+void bsp_imu_fusion_update(const float acc[3], const float gyro[3], float dt);
+int bsp_imu_fusion_notify(uint8_t mask);
+
+int bsp_imu_cal_cmd(uint8_t cmd);
+void bsp_imu_cal_process(const IMU_SAMPLE_ST *s);
+void bsp_imu_cal_apply(IMU_SAMPLE_ST *s);
+uint8_t bsp_imu_cal_done(void);
+
+typedef void (*bsp_decim_sink_t)(const IMU_SAMPLE_ST *s, void *ctx);
+void bsp_imu_decim_process(const IMU_SAMPLE_ST *s);
+int bsp_imu_decim_subscribe(uint8_t sub, uint16_t rate_hz, bsp_decim_sink_t sink, void *ctx);
+int bsp_imu_decim_set_rate(uint8_t sub, uint16_t rate_hz);
+int bsp_imu_decim_get(uint8_t sub, IMU_DECIM_STAT_ST *st);
+
+void bsp_imu_hist_put(const IMU_SAMPLE_ST *s);
+int bsp_imu_hist_query(uint32_t from_ms, uint32_t to_ms);
+void bsp_imu_hist_get_stat(IMU_HIST_STAT_ST *st);
+
+int bsp_imu_vib_set_win(uint16_t win);
+void bsp_imu_vib_process(const IMU_SAMPLE_ST *s);
+
+void bsp_imu_ml_process(const IMU_SAMPLE_ST *s);
+int bsp_imu_ml_upload(const struct nus_msg_packet *p);
+int bsp_imu_ml_load(void);
+
+void bsp_motion_detect_init(void);
+void bsp_motion_detect_set_thr(uint16_t tap, uint16_t ff, uint16_t step, uint16_t shake);
+void bsp_motion_detect_process(const IMU_SAMPLE_ST *s);
+
+void bsp_time_sync_request(const struct nus_msg_packet *p);
+void bsp_time_sync_result(const struct nus_msg_packet *p);
+void bsp_time_sync_reset(void);
 
 int bsp_rtc_set_time(RTC_TIME_ST *time);
 int bsp_rtc_get_time(RTC_TIME_ST *time);
 
+int bsp_wall_init(void);
+int64_t bsp_wall_now_ms(void);
+int64_t bsp_wall_ms_at(int64_t device_us);
+int bsp_wall_get_time(RTC_TIME_ST *time);
+int bsp_wall_set_time(RTC_TIME_ST *time);
+void bsp_wall_resync(void);
+
+int bsp_rtc_set_alarm(int8_t hour, int8_t min);
+int bsp_rtc_set_timer(uint8_t freq, uint8_t count);
+int bsp_rtc_get_irq(uint8_t *flags);
+int bsp_rtc_set_clkout(uint8_t on, uint8_t freq);
+int bsp_rtc_sched_init(void);
+int bsp_rtc_sched_alarm(int8_t hour, int8_t min, uint8_t act);
+int bsp_rtc_sched_every(uint16_t sec, uint8_t act);
+
+int bsp_i2c_submit(BSP_I2C_XFER_ST *x);
+int bsp_i2c_write(uint8_t dev, const uint8_t *buf, uint32_t len);
+int bsp_i2c_write_read(uint8_t dev, const uint8_t *wbuf, uint32_t wlen, uint8_t *rbuf, uint32_t rlen);
+void bsp_i2c_reset_stat(void);
+
+void bsp_adpcm_encode(ADPCM_STATE_ST *st, const int16_t *in, int n, uint8_t *out);
+int bsp_audio_stream(uint8_t on, uint8_t vad);
+void bsp_audio_get_stat(AUDIO_STAT_ST *st);
+int bsp_audio_sink_attach(uint8_t sink, struct k_msgq *q, uint8_t gated);
+void bsp_audio_sink_detach(uint8_t sink);
+void bsp_audio_block_release(void *pcm);
+void bsp_audio_vad_reset(void);
+uint8_t bsp_audio_vad_process(const int16_t *pcm, int n);
+int bsp_audio_slm_set_interval(uint16_t interval_ms);
+int bsp_audio_clip_arm(uint8_t on, uint16_t pre_ms, uint16_t post_ms);
+void bsp_audio_clip_trigger(uint8_t src);
+int bsp_audio_clip_get(uint32_t id);
+int bsp_audio_aed_set(uint8_t on, uint8_t impulse_thr, uint8_t tone_pct, const uint16_t *tone_hz);
+
 int bsp_nvs_init(void);
-int bsp_nvs_read(NVS_INFO_ST *p);
-int bsp_nvs_write(NVS_INFO_ST *p);
+int bsp_nvs_read_id(uint16_t id, void *p, size_t len);
+int bsp_nvs_write_id(uint16_t id, const void *p, size_t len);
+int bsp_nvs_delete_id(uint16_t id);
+int bsp_nvs_write_blob(uint16_t id, const void *p, size_t len);
+int bsp_nvs_read_blob(uint16_t id, void *p, size_t max);
 int bsp_nvs_reset(void);
+int bsp_nvs_update_stat(void);
+void bsp_nvs_reset_stat(void);
+void bsp_nvs_notify_stat(void);
+
+int bsp_settings_load(void);
+int bsp_settings_set(uint8_t key, const void *v, uint8_t len);
+int bsp_settings_get(uint8_t key, void *v, uint8_t len);
+void bsp_settings_touch(uint8_t key);
+int bsp_settings_flush(void);
+uint32_t bsp_settings_dirty(void);
+const char *bsp_settings_name(uint8_t key);
+
+int bsp_evq_init(void);
+int bsp_evq_post(uint8_t evt);
+int bsp_evq_submit(struct k_work *work);
+int bsp_evq_reschedule(struct k_work_delayable *dwork, k_timeout_t delay);
+const char *bsp_evq_name(uint8_t evt);
+void bsp_evq_update_stat(void);
+void bsp_evq_reset_stat(void);
+void bsp_evq_notify_stat(void);
+
+void bsp_prd_start(void);
+int bsp_prd_set_period(uint8_t job, uint32_t period_ms);
+const char *bsp_prd_name(uint8_t job);
+void bsp_prd_reset_stat(void);
+void bsp_prd_notify_stat(uint8_t job);
+
+int bsp_batt_init(void);
+int bsp_batt_sample(void);
+void bsp_batt_notify(void);
+
+int bsp_retained_init(void);
+void bsp_retained_snapshot(void);
+void bsp_retained_get(RETAINED_ST *ret);
+void bsp_retained_shutdown(void);
+void bsp_retained_notify(void);
+
+int bsp_tslog_append(uint8_t type, const void *data, uint8_t len);
+void bsp_tslog_set_mask(uint16_t mask);
+int bsp_tslog_flush(void);
+int bsp_tslog_query(int64_t from_ms, int64_t to_ms);
+void bsp_tslog_notify_stat(void);
 
 int bsp_pwm_buzzer(uint16_t frequency_hz, uint16_t duration_ms);
 /**************/
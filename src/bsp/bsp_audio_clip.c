@@ -0,0 +1,516 @@
+/*
+    Pre-trigger audio clips on the external QSPI flash (P25Q16H)
+
+    recorder (audio sink) : PCM block -> ADPCM -> RAM ring (BSP_CLIP_RING)
+    writer                : ring -> flash pages, header page last
+
+    While armed the encoder runs all the time, so on a trigger (button,
+    motion shock, NUS/cli) the clip starts pre_ms back in the ring, with the
+    encoder state saved for that block, and ends post_ms after it.
+    Only page programs happen while a clip is written: the next slot is
+    erased when a clip is closed (and at boot), and the writer has its own
+    lowest priority thread. A slow flash costs the clip (overrun), never
+    DMIC blocks.
+
+    Flash layout, BSP_CLIP_REGION_xxx : 64 KB slots used as a ring
+        page 0  : CLIP_HDR_ST, programmed once the data is complete
+        page 1- : ADPCM, same coding as NUS_MSG_NOTIFY_AUDIO
+    The index is rebuilt from the slot headers at boot, clips are read back
+    with NUS_MSG_GET_CLIP as a bulk transfer (header + ADPCM).
+*/
+#include <zephyr/drivers/flash.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(audio_clip, LOG_LEVEL_INF);
+
+#define CLIP_PAGE 256
+#define CLIP_SLOTS (BSP_CLIP_REGION_SIZE / BSP_CLIP_SLOT_SIZE)
+#define CLIP_DATA_MAX (BSP_CLIP_SLOT_SIZE - CLIP_PAGE)
+#define CLIP_BLOCK_BYTES (BSP_AUDIO_BLOCK_SAMPLES / 2)
+#define CLIP_RING_BLOCKS (BSP_CLIP_RING / CLIP_BLOCK_BYTES)
+#define CLIP_BYTES_PER_MS (BSP_AUDIO_RATE_HZ / 2 / 1000)
+#define CLIP_WAIT_MS 500 // no audio for this long aborts the clip
+
+#define CLIP_SLOT_OFF(s) (BSP_CLIP_REGION_OFF + (s) * BSP_CLIP_SLOT_SIZE)
+
+static void clip_rec_task(void);
+static void clip_wr_task(void);
+
+K_THREAD_DEFINE(thread_clip_rec, 1024, clip_rec_task, NULL, NULL, NULL, 10, 0, 0);
+K_THREAD_DEFINE(thread_clip_wr, 1024, clip_wr_task, NULL, NULL, NULL, 11, 0, 0);
+
+K_MSGQ_DEFINE(clip_mq, sizeof(AUDIO_BLK_ST), 4, 4);
+
+K_SEM_DEFINE(clip_wr_sem, 0, 1);
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint32_t clipId;
+    uint32_t clipLen;
+    uint8_t src;
+    uint16_t preMs;
+    int64_t trigUs;
+} clip_packet_t;
+
+static const struct device *m_flash = DEVICE_DT_GET(DT_NODELABEL(p25q16h));
+
+static uint8_t m_ring[BSP_CLIP_RING];
+static ADPCM_STATE_ST m_ring_st[CLIP_RING_BLOCKS]; // encoder state before each block
+static volatile uint32_t m_wr = 0;                 // ADPCM bytes since armed
+
+static atomic_t m_trig;             // pending BSP_CLIP_TRIG_xxx + 1, 0 : none
+static volatile bool m_ready;       // slot erased, writer idle
+static volatile uint16_t m_pre_ms = BSP_DEFAULT_CLIP_PRE_MS;
+static volatile uint16_t m_post_ms = BSP_DEFAULT_CLIP_POST_MS;
+
+/* Clip being written, set up by the recorder, owned by the writer while active */
+static struct
+{
+    volatile bool active;
+    uint32_t start; // ring bytes [start, end)
+    uint32_t end;
+    CLIP_HDR_ST hdr;
+} m_clip;
+
+static CLIP_HDR_ST m_idx[CLIP_SLOTS]; // magic != BSP_CLIP_MAGIC : empty
+static uint8_t m_slot;                // slot the next clip goes to
+static uint32_t m_next_id = 1;
+static uint32_t m_get_id;             // clip in the bulk transfer
+
+static void clip_notify(const CLIP_HDR_ST *h)
+{
+    clip_packet_t packet;
+
+    packet.id = NUS_MSG_NOTIFY_CLIP;
+    packet.len = sizeof(packet);
+    packet.clipId = h->id;
+    packet.clipLen = h->len;
+    packet.src = h->src;
+    packet.preMs = h->preMs;
+    packet.trigUs = h->trigUs;
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+static void clip_count(void)
+{
+    uint8_t n = 0;
+
+    for (int i = 0; i < CLIP_SLOTS; i++)
+    {
+        n += (m_idx[i].magic == BSP_CLIP_MAGIC);
+    }
+    g_Bsp.clip.clips = n;
+}
+
+/**
+ * @brief rebuild the index from the slot headers
+ *
+ */
+static void clip_scan(void)
+{
+    uint32_t newest = 0;
+
+    for (int i = 0; i < CLIP_SLOTS; i++)
+    {
+        CLIP_HDR_ST *h = &m_idx[i];
+
+        if (flash_read(m_flash, CLIP_SLOT_OFF(i), h, sizeof(*h)) < 0 ||
+            h->magic != BSP_CLIP_MAGIC || h->len > CLIP_DATA_MAX)
+        {
+            h->magic = 0;
+            continue;
+        }
+        if (h->id >= newest)
+        {
+            newest = h->id;
+            m_slot = (i + 1) % CLIP_SLOTS;
+        }
+    }
+
+    m_next_id = newest + 1;
+    g_Bsp.clip.lastId = newest;
+    clip_count();
+
+    LOG_INF("Clips %d stored, next slot %d", g_Bsp.clip.clips, m_slot);
+}
+
+/**
+ * @brief erase the slot the next clip goes to, drops the oldest clip
+ *
+ */
+static bool clip_blank(uint8_t s)
+{
+    uint32_t buf[CLIP_PAGE / 4];
+
+    for (uint32_t off = 0; off < BSP_CLIP_SLOT_SIZE; off += sizeof(buf))
+    {
+        if (flash_read(m_flash, CLIP_SLOT_OFF(s) + off, buf, sizeof(buf)) < 0)
+        {
+            return false;
+        }
+        for (int i = 0; i < ARRAY_SIZE(buf); i++)
+        {
+            if (buf[i] != 0xFFFFFFFF)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void clip_erase_slot(void)
+{
+    int64_t t0 = k_uptime_get();
+
+    m_idx[m_slot].magic = 0;
+    clip_count();
+
+    /* Blank already (fresh flash, or erased before the last reset) : no erase cycle, no busy flash */
+    if (clip_blank(m_slot))
+    {
+        m_ready = true;
+        return;
+    }
+    if (flash_erase(m_flash, CLIP_SLOT_OFF(m_slot), BSP_CLIP_SLOT_SIZE) < 0)
+    {
+        LOG_ERR("Clip slot %d erase failed", m_slot);
+        return;
+    }
+
+    LOG_INF("Clip slot %d erased in %d ms", m_slot, (int)(k_uptime_get() - t0));
+    m_ready = true;
+}
+
+/**
+ * @brief set up a clip around the current ring position, recorder side
+ *
+ * @param src BSP_CLIP_TRIG_xxx
+ */
+static void clip_start(uint8_t src)
+{
+    uint32_t pre, post;
+    uint32_t blk;
+
+    if (m_clip.active || !m_ready)
+    {
+        g_Bsp.clip.ignored++;
+        return;
+    }
+
+    pre = MIN((uint32_t)m_pre_ms * CLIP_BYTES_PER_MS, m_wr);
+    pre -= pre % CLIP_BLOCK_BYTES;
+    post = MIN((uint32_t)m_post_ms * CLIP_BYTES_PER_MS, CLIP_DATA_MAX - pre);
+    post -= post % CLIP_BLOCK_BYTES;
+
+    m_clip.start = m_wr - pre;
+    m_clip.end = m_wr + post;
+
+    blk = (m_clip.start / CLIP_BLOCK_BYTES) % CLIP_RING_BLOCKS;
+    m_clip.hdr.magic = BSP_CLIP_MAGIC;
+    m_clip.hdr.id = m_next_id;
+    m_clip.hdr.len = pre + post;
+    m_clip.hdr.trigUs = bsp_time_us();
+    m_clip.hdr.rateHz = BSP_AUDIO_RATE_HZ;
+    m_clip.hdr.preMs = pre / CLIP_BYTES_PER_MS;
+    m_clip.hdr.src = src;
+    m_clip.hdr.pred = m_ring_st[blk].predictor;
+    m_clip.hdr.index = m_ring_st[blk].index;
+
+    m_clip.active = true;
+    g_Bsp.clip.busy = 1;
+
+    LOG_INF("Clip %d triggered (src %d), %d ms before", m_clip.hdr.id, src, m_clip.hdr.preMs);
+}
+
+static void clip_rec_task(void)
+{
+    ADPCM_STATE_ST enc = {0};
+    AUDIO_BLK_ST blk;
+    atomic_val_t trig;
+
+    while (1)
+    {
+        uint32_t b;
+
+        k_msgq_get(&clip_mq, &blk, K_FOREVER);
+
+        /* First block after arming, the ring starts over */
+        if (blk.start)
+        {
+            m_wr = 0;
+            enc.predictor = 0;
+            enc.index = 0;
+        }
+
+        b = (m_wr / CLIP_BLOCK_BYTES) % CLIP_RING_BLOCKS;
+        m_ring_st[b] = enc;
+        bsp_adpcm_encode(&enc, (const int16_t *)blk.pcm, BSP_AUDIO_BLOCK_SAMPLES, &m_ring[b * CLIP_BLOCK_BYTES]);
+        bsp_audio_block_release(blk.pcm);
+        m_wr += CLIP_BLOCK_BYTES;
+
+        trig = atomic_set(&m_trig, 0);
+        if (trig)
+        {
+            clip_start((uint8_t)(trig - 1));
+        }
+        if (m_clip.active)
+        {
+            k_sem_give(&clip_wr_sem);
+        }
+    }
+}
+
+/**
+ * @brief copy ring data to flash until the clip end
+ *
+ * @return int  0 : OK, -1 : ERROR
+ */
+static int clip_write_data(void)
+{
+    static uint8_t page[CLIP_PAGE] __aligned(4);
+    uint32_t off = CLIP_SLOT_OFF(m_slot) + CLIP_PAGE;
+    uint32_t pos = m_clip.start;
+
+    while (pos < m_clip.end)
+    {
+        uint32_t avail = MIN(m_wr, m_clip.end);
+        uint32_t n;
+
+        /* Whole pages only, except for the tail */
+        if (avail - pos < CLIP_PAGE && avail < m_clip.end)
+        {
+            if (k_sem_take(&clip_wr_sem, K_MSEC(CLIP_WAIT_MS)) != 0)
+            {
+                LOG_ERR("Clip audio stopped");
+                return -1;
+            }
+            continue;
+        }
+
+        n = MIN(CLIP_PAGE, avail - pos);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            page[i] = m_ring[(pos + i) % BSP_CLIP_RING];
+        }
+
+        /* Recorder lapped us while copying, the page holds newer audio. The
+         * block being encoded at m_wr is already being overwritten too.
+         */
+        if (m_wr + CLIP_BLOCK_BYTES - pos > BSP_CLIP_RING)
+        {
+            LOG_ERR("Clip overrun");
+            g_Bsp.clip.overruns++;
+            return -1;
+        }
+
+        if (flash_write(m_flash, off, page, n) < 0)
+        {
+            LOG_ERR("Clip write failed at 0x%x", off);
+            return -1;
+        }
+        off += n;
+        pos += n;
+    }
+
+    return 0;
+}
+
+static void clip_wr_task(void)
+{
+    static uint8_t hdr_page[sizeof(CLIP_HDR_ST)] __aligned(4);
+    uint8_t tslog_rec[5];
+
+    g_Bsp.clip.preMs = m_pre_ms;
+    g_Bsp.clip.postMs = m_post_ms;
+
+    if (!device_is_ready(m_flash))
+    {
+        LOG_ERR("QSPI flash not ready");
+        return;
+    }
+
+    clip_scan();
+    clip_erase_slot();
+
+    while (1)
+    {
+        k_sem_take(&clip_wr_sem, K_FOREVER);
+        if (!m_clip.active)
+        {
+            continue;
+        }
+
+        if (clip_write_data() == 0)
+        {
+            /* Header last, a slot without one is never listed */
+            memcpy(hdr_page, &m_clip.hdr, sizeof(CLIP_HDR_ST));
+            if (flash_write(m_flash, CLIP_SLOT_OFF(m_slot), hdr_page, sizeof(hdr_page)) == 0)
+            {
+                m_idx[m_slot] = m_clip.hdr;
+                g_Bsp.clip.lastId = m_clip.hdr.id;
+                m_next_id++;
+                m_slot = (m_slot + 1) % CLIP_SLOTS;
+                clip_notify(&m_clip.hdr);
+                LOG_INF("Clip %d stored, %d bytes", m_clip.hdr.id, m_clip.hdr.len);
+
+                /* CLIP_ID(4) | SRC(1) */
+                memcpy(tslog_rec, &m_clip.hdr.id, 4);
+                tslog_rec[4] = m_clip.hdr.src;
+                bsp_tslog_append(BSP_TSLOG_T_CLIP, tslog_rec, sizeof(tslog_rec));
+            }
+        }
+
+        m_ready = false;
+        m_clip.active = false;
+        clip_erase_slot();
+        g_Bsp.clip.busy = 0;
+    }
+}
+
+/**
+ * @brief arm/disarm recording, the mic runs while armed
+ *
+ * @param on        1 : arm, 0 : disarm
+ * @param pre_ms    audio kept before a trigger, 0 keeps
+ * @param post_ms   audio recorded after a trigger, 0 keeps
+ * @return int      0 : OK, -1 : ERROR
+ */
+int bsp_audio_clip_arm(uint8_t on, uint16_t pre_ms, uint16_t post_ms)
+{
+    if (pre_ms)
+    {
+        m_pre_ms = MIN(pre_ms, BSP_CLIP_MAX_PRE_MS);
+    }
+    if (post_ms)
+    {
+        m_post_ms = post_ms;
+    }
+    g_Bsp.clip.preMs = m_pre_ms;
+    g_Bsp.clip.postMs = m_post_ms;
+
+    if (on == g_Bsp.clip.armed)
+    {
+        return 0;
+    }
+
+    if (on)
+    {
+        if (!device_is_ready(m_flash))
+        {
+            LOG_ERR("QSPI flash not ready");
+            return -1;
+        }
+        if (bsp_audio_sink_attach(BSP_AUDIO_SINK_FLASH, &clip_mq, 0) < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        if (m_clip.active)
+        {
+            LOG_ERR("Clip being written");
+            return -1;
+        }
+        bsp_audio_sink_detach(BSP_AUDIO_SINK_FLASH);
+    }
+    g_Bsp.clip.armed = on;
+
+    LOG_INF("Clip recorder %s, pre %d ms, post %d ms", on ? "armed" : "off", m_pre_ms, m_post_ms);
+
+    return 0;
+}
+
+/**
+ * @brief request a clip, ISR safe (button, motion events)
+ *
+ * @param src BSP_CLIP_TRIG_xxx
+ */
+void bsp_audio_clip_trigger(uint8_t src)
+{
+    g_Bsp.clip.triggers++;
+
+    if (!g_Bsp.clip.armed)
+    {
+        g_Bsp.clip.ignored++;
+        return;
+    }
+    atomic_set(&m_trig, src + 1);
+}
+
+static int clip_read(uint32_t offset, uint8_t *buf, uint16_t len, void *ctx)
+{
+    const CLIP_HDR_ST *h = &m_idx[(uintptr_t)ctx];
+    uint32_t n = 0;
+
+    /* Slot erased for a new clip while streaming */
+    if (h->magic != BSP_CLIP_MAGIC || h->id != m_get_id)
+    {
+        LOG_ERR("Clip %d gone", m_get_id);
+        return -1;
+    }
+
+    if (offset < sizeof(CLIP_HDR_ST))
+    {
+        n = MIN(len, sizeof(CLIP_HDR_ST) - offset);
+        memcpy(buf, (const uint8_t *)h + offset, n);
+    }
+    if (n < len &&
+        flash_read(m_flash, CLIP_SLOT_OFF((uintptr_t)ctx) + CLIP_PAGE + offset + n - sizeof(CLIP_HDR_ST),
+                   buf + n, len - n) < 0)
+    {
+        return -1;
+    }
+
+    return len;
+}
+
+/**
+ * @brief list clips or send one over the bulk path
+ *
+ * @param id    0 : NUS_MSG_NOTIFY_CLIP for every stored clip, else clip id
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_audio_clip_get(uint32_t id)
+{
+    for (int i = 0; i < CLIP_SLOTS; i++)
+    {
+        const CLIP_HDR_ST *h = &m_idx[i];
+
+        if (h->magic != BSP_CLIP_MAGIC)
+        {
+            continue;
+        }
+        if (id == 0)
+        {
+            clip_notify(h);
+            continue;
+        }
+        if (h->id == id)
+        {
+            if (bsp_bulk_busy())
+            {
+                LOG_ERR("Bulk busy");
+                return -1;
+            }
+            m_get_id = id;
+            return bsp_bulk_start(BSP_BULK_STREAM_AUDIO_CLIP, sizeof(CLIP_HDR_ST) + h->len, clip_read,
+                                  (void *)(uintptr_t)i);
+        }
+    }
+
+    if (id)
+    {
+        LOG_ERR("No clip %d", id);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,314 @@
+/*
+    Acoustic event detector on the DMIC block pipeline (knock, clap, alarm tone)
+
+    A sink of the audio pipeline, only NUS_MSG_NOTIFY_AED events go out.
+    Impulses : mean abs envelope per 2 ms sub-block against a slow background
+               envelope, fast > background x impulseThr opens an event, then
+               a refractory time. The share of energy in the first difference
+               (high frequencies) tells a clap (broadband) from a knock (thud).
+    Tones    : Goertzel power per 10 ms block (100 Hz bins) at up to
+               BSP_AED_TONES configurable frequencies, a tone holding more than
+               tonePct % of the block energy for BSP_AED_TONE_MIN_MS is reported
+               once per occurrence (alarm beeps, buzzers).
+    Cost is a few us per block, the mean is kept in g_Bsp.aed.cpuUs.
+    NUS_MSG_SET_AED_CFG or cli aed.
+*/
+#include <math.h>
+#include <stdlib.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(audio_aed, LOG_LEVEL_INF);
+
+#define AED_QUEUE_DEPTH 4
+#define AED_CPU_AVG 100 // blocks per cpuUs update
+#define AED_SUBS (BSP_AUDIO_BLOCK_SAMPLES / BSP_AED_SUB)
+#define AED_BLOCK_MS (BSP_AUDIO_BLOCK_SAMPLES * 1000 / BSP_AUDIO_RATE_HZ)
+#define AED_BG_SHIFT 10 // background accumulator fraction bits
+#define AED_SAMPLE_US(n) ((uint32_t)(n) * 1000000U / BSP_AUDIO_RATE_HZ)
+
+static void aed_task(void);
+
+K_THREAD_DEFINE(thread_aed, 1024, aed_task, NULL, NULL, NULL, 10, 0, 0);
+
+K_MSGQ_DEFINE(aed_mq, sizeof(AUDIO_BLK_ST), AED_QUEUE_DEPTH, 4);
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t evt;    // BSP_AED_EVT_xxx
+    uint16_t arg;   // tone slot
+    uint16_t level; // impulse : fast / background x10, tone : % energy in the bin
+    uint32_t ts;    // device us of the onset
+} aed_packet_t;
+
+typedef struct
+{
+    int32_t bg;          // background envelope, mean abs x16
+    int32_t bgAcc;       // bg << AED_BG_SHIFT, keeps the sub unit steps
+    uint32_t refractUs;  // no impulse before this ts
+    bool refract;
+    float coef[BSP_AED_TONES]; // 2 cos(w)
+    uint16_t toneMs[BSP_AED_TONES];
+    bool toneSent[BSP_AED_TONES];
+    uint32_t cycles; // over AED_CPU_AVG blocks
+    uint16_t blocks;
+} aed_state_t;
+
+static aed_state_t m_st;
+static volatile bool m_cfg_changed = true;
+
+static void aed_emit(uint8_t evt, uint16_t arg, uint16_t level, uint32_t ts)
+{
+    aed_packet_t packet;
+
+    packet.id = NUS_MSG_NOTIFY_AED;
+    packet.len = sizeof(packet);
+    packet.evt = evt;
+    packet.arg = arg;
+    packet.level = level;
+    packet.ts = ts;
+
+    g_Bsp.aed.lastEvt = evt;
+    g_Bsp.aed.events++;
+
+    LOG_INF("Acoustic event %d, arg %d, level %d", evt, arg, level);
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+    bsp_tslog_append(BSP_TSLOG_T_AED, &packet.evt, sizeof(packet.evt) + sizeof(packet.arg) + sizeof(packet.level));
+}
+
+/**
+ * @brief Goertzel coefficients for the configured tones, consumer side only
+ *
+ */
+static void aed_setup(void)
+{
+    for (int i = 0; i < BSP_AED_TONES; i++)
+    {
+        float w = 2.0f * PI * g_Bsp.aed.toneHz[i] / BSP_AUDIO_RATE_HZ;
+
+        m_st.coef[i] = 2.0f * cosf(w);
+        m_st.toneMs[i] = 0;
+        m_st.toneSent[i] = false;
+    }
+    m_st.bg = 0;
+    m_st.bgAcc = 0;
+    m_st.refract = false;
+}
+
+/**
+ * @brief envelope transient detection over the 2 ms sub-blocks
+ *
+ * @param x     block samples
+ * @param ts    device us at the end of the block
+ */
+static void aed_impulse(const int16_t *x, uint32_t ts)
+{
+    for (int s = 0; s < AED_SUBS; s++)
+    {
+        const int16_t *p = &x[s * BSP_AED_SUB];
+        uint32_t sub_ts = ts - AED_SAMPLE_US(BSP_AUDIO_BLOCK_SAMPLES - s * BSP_AED_SUB);
+        int32_t sum = 0, mean;
+        int32_t fast;
+        uint64_t e = 0, d = 0;
+
+        for (int i = 0; i < BSP_AED_SUB; i++)
+        {
+            sum += p[i];
+        }
+        mean = sum / BSP_AED_SUB;
+
+        /* Mean abs (DC removed) x16, fixed point for the slow average */
+        sum = 0;
+        for (int i = 0; i < BSP_AED_SUB; i++)
+        {
+            sum += abs(p[i] - mean);
+        }
+        fast = sum * 16 / BSP_AED_SUB;
+
+        if (m_st.bg == 0)
+        {
+            m_st.bg = MAX(fast, 16);
+            m_st.bgAcc = m_st.bg << AED_BG_SHIFT;
+        }
+        if (m_st.refract && (int32_t)(sub_ts - m_st.refractUs) >= 0)
+        {
+            m_st.refract = false;
+        }
+
+        if (!m_st.refract && fast > m_st.bg * g_Bsp.aed.impulseThr && fast > BSP_AED_MIN_LEVEL * 16)
+        {
+            /* HF share : E[diff^2] / 2 E[x^2] is ~100 % for white noise, a few % for a thud */
+            for (int i = 1; i < BSP_AED_SUB; i++)
+            {
+                int32_t v = p[i] - mean;
+                int32_t dv = p[i] - p[i - 1];
+
+                e += (uint32_t)v * (uint32_t)v;
+                d += (uint32_t)dv * (uint32_t)dv;
+            }
+            aed_emit((d * 100 > e * 2 * BSP_AED_CLAP_HF) ? BSP_AED_EVT_CLAP : BSP_AED_EVT_KNOCK, 0,
+                     (uint16_t)MIN(fast * 10 / m_st.bg, UINT16_MAX), sub_ts);
+
+            m_st.refract = true;
+            m_st.refractUs = sub_ts + BSP_AED_REFRACT_MS * 1000U;
+        }
+
+        /* Background follows quiet parts, impulses barely move it. Fixed point,
+           a rise under 1024 would add nothing in whole units */
+        m_st.bgAcc += ((fast << AED_BG_SHIFT) - m_st.bgAcc) / ((fast > m_st.bg) ? 1024 : 64);
+        m_st.bgAcc = MAX(m_st.bgAcc, 16 << AED_BG_SHIFT);
+        m_st.bg = m_st.bgAcc >> AED_BG_SHIFT;
+    }
+}
+
+/**
+ * @brief Goertzel tone detection over the whole block
+ *
+ * @param x     block samples
+ * @param ts    device us at the end of the block
+ */
+static void aed_tone(const int16_t *x, uint32_t ts)
+{
+    float energy = 0.0f;
+    float mean = 0.0f;
+
+    for (int i = 0; i < BSP_AUDIO_BLOCK_SAMPLES; i++)
+    {
+        mean += x[i];
+    }
+    mean /= BSP_AUDIO_BLOCK_SAMPLES;
+
+    /* PDM DC offset removed, it would leak into the low bins */
+    for (int i = 0; i < BSP_AUDIO_BLOCK_SAMPLES; i++)
+    {
+        energy += (x[i] - mean) * (x[i] - mean);
+    }
+    if (energy <= 0.0f)
+    {
+        return;
+    }
+
+    for (int t = 0; t < BSP_AED_TONES; t++)
+    {
+        float s1 = 0.0f, s2 = 0.0f, power;
+        uint16_t pct;
+
+        if (g_Bsp.aed.toneHz[t] == 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < BSP_AUDIO_BLOCK_SAMPLES; i++)
+        {
+            float s0 = (x[i] - mean) + m_st.coef[t] * s1 - s2;
+
+            s2 = s1;
+            s1 = s0;
+        }
+        power = s1 * s1 + s2 * s2 - m_st.coef[t] * s1 * s2;
+
+        /* Pure tone on the bin : power = (A N / 2)^2, energy = A^2 N / 2 */
+        pct = (uint16_t)MIN(power * 2.0f * 100.0f / (BSP_AUDIO_BLOCK_SAMPLES * energy), 100.0f);
+
+        if (pct < g_Bsp.aed.tonePct)
+        {
+            m_st.toneMs[t] = 0;
+            m_st.toneSent[t] = false;
+            continue;
+        }
+
+        m_st.toneMs[t] += AED_BLOCK_MS;
+        if (!m_st.toneSent[t] && m_st.toneMs[t] >= BSP_AED_TONE_MIN_MS)
+        {
+            aed_emit(BSP_AED_EVT_TONE, t, pct, ts - m_st.toneMs[t] * 1000U);
+            m_st.toneSent[t] = true;
+        }
+    }
+}
+
+static void aed_task(void)
+{
+    AUDIO_BLK_ST blk;
+
+    g_Bsp.aed.impulseThr = BSP_DEFAULT_AED_IMPULSE_THR;
+    g_Bsp.aed.tonePct = BSP_DEFAULT_AED_TONE_PCT;
+
+    while (1)
+    {
+        uint32_t c0;
+
+        k_msgq_get(&aed_mq, &blk, K_FOREVER);
+
+        if (m_cfg_changed || blk.start)
+        {
+            m_cfg_changed = false;
+            aed_setup();
+        }
+
+        c0 = k_cycle_get_32();
+        aed_impulse((const int16_t *)blk.pcm, blk.ts);
+        aed_tone((const int16_t *)blk.pcm, blk.ts);
+        m_st.cycles += k_cycle_get_32() - c0;
+
+        bsp_audio_block_release(blk.pcm);
+
+        if (++m_st.blocks == AED_CPU_AVG)
+        {
+            g_Bsp.aed.cpuUs = k_cyc_to_us_floor32(m_st.cycles / m_st.blocks);
+            m_st.cycles = 0;
+            m_st.blocks = 0;
+        }
+    }
+}
+
+/**
+ * @brief configure the detector, attaches it to the audio pipeline while on
+ *
+ * @param on            1 : run, 0 : off
+ * @param impulse_thr   fast / background envelope ratio, 0 keeps
+ * @param tone_pct      % of block energy in a tone bin, 0 keeps
+ * @param tone_hz       BSP_AED_TONES frequencies (0 : unused), NULL keeps
+ * @return int          0 : OK, -1 : ERROR
+ */
+int bsp_audio_aed_set(uint8_t on, uint8_t impulse_thr, uint8_t tone_pct, const uint16_t *tone_hz)
+{
+    if (impulse_thr)
+    {
+        g_Bsp.aed.impulseThr = impulse_thr;
+    }
+    if (tone_pct)
+    {
+        g_Bsp.aed.tonePct = MIN(tone_pct, 100);
+    }
+    if (tone_hz)
+    {
+        for (int i = 0; i < BSP_AED_TONES; i++)
+        {
+            g_Bsp.aed.toneHz[i] = MIN(tone_hz[i], BSP_AUDIO_RATE_HZ / 2);
+        }
+    }
+    m_cfg_changed = true;
+
+    if (on != g_Bsp.aed.on)
+    {
+        if (on && bsp_audio_sink_attach(BSP_AUDIO_SINK_AED, &aed_mq, 0) < 0)
+        {
+            return -1;
+        }
+        if (!on)
+        {
+            bsp_audio_sink_detach(BSP_AUDIO_SINK_AED);
+        }
+        g_Bsp.aed.on = on;
+    }
+
+    LOG_INF("AED %s, impulse x%d, tone %d %%, %d/%d/%d/%d Hz", on ? "on" : "off", g_Bsp.aed.impulseThr,
+            g_Bsp.aed.tonePct, g_Bsp.aed.toneHz[0], g_Bsp.aed.toneHz[1], g_Bsp.aed.toneHz[2], g_Bsp.aed.toneHz[3]);
+
+    return 0;
+}
@@ -0,0 +1,283 @@
+/*
+    Sound level meter on the DMIC block pipeline (noise monitoring)
+
+    A sink of the audio pipeline, no audio leaves the device. Per interval:
+        LAeq  : A weighted energy average, 3 biquads (bilinear transform of
+                the IEC 61672 poles, 0 dB at 1 kHz; at 16 kHz the 12.2 kHz
+                pole is warped so the top octave reads a few dB low)
+        Lpeak : A weighted absolute peak (no DC from the PDM offset)
+        bands : BSP_SLM_BANDS octave Leq, one constant 0 dB peak band pass
+                biquad per band, 63 Hz .. 4 kHz
+    Levels are dB SPL from the nominal mic sensitivity (BSP_SLM_SPL_AT_0DBFS,
+    0 dBFS = full scale sine RMS), 0.01 dB units, CMSIS-DSP float filters.
+    NUS_MSG_SET_SLM_CFG or cli slm sets the interval, NUS_MSG_NOTIFY_SLM out.
+*/
+#include <math.h>
+#include <arm_math.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(audio_slm, LOG_LEVEL_INF);
+
+#define SLM_QUEUE_DEPTH 4
+#define SLM_A_STAGES 3
+#define SLM_BAND_Q 1.414f  // one octave bandwidth
+#define SLM_SINE_DBFS 3.01f // full scale sine RMS is 0 dBFS
+
+static void slm_task(void);
+
+K_THREAD_DEFINE(thread_slm, 1536, slm_task, NULL, NULL, NULL, 9, 0, 0);
+
+K_MSGQ_DEFINE(slm_mq, sizeof(AUDIO_BLK_ST), SLM_QUEUE_DEPTH, 4);
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    int16_t laeq;
+    int16_t lpeak;
+    int16_t band[BSP_SLM_BANDS];
+    uint32_t ts;
+} slm_packet_t;
+
+static const float m_band_hz[BSP_SLM_BANDS] = {63.0f, 125.0f, 250.0f, 500.0f, 1000.0f, 2000.0f, 4000.0f};
+
+static float32_t m_a_coef[SLM_A_STAGES * 5];
+static float32_t m_a_state[SLM_A_STAGES * 2];
+static arm_biquad_cascade_df2T_instance_f32 m_a;
+
+static float32_t m_band_coef[BSP_SLM_BANDS][5];
+static float32_t m_band_state[BSP_SLM_BANDS][2];
+static arm_biquad_cascade_df2T_instance_f32 m_band[BSP_SLM_BANDS];
+
+static float32_t m_x[BSP_AUDIO_BLOCK_SAMPLES];
+static float32_t m_y[BSP_AUDIO_BLOCK_SAMPLES];
+
+/* Interval accumulators */
+static float m_acc_a;
+static float m_acc_band[BSP_SLM_BANDS];
+static float m_peak;
+static uint32_t m_samples;
+static uint16_t m_interval = 0; // interval the accumulators run for
+
+/**
+ * @brief analog 2nd order section -> CMSIS biquad, bilinear transform
+ *
+ *  H(s) = (n2 s^2 + n1 s + n0) / (d2 s^2 + d1 s + d0)
+ *
+ * @param c out : b0, b1, b2, -a1, -a2
+ */
+static void slm_bilinear(float n2, float n1, float n0, float d2, float d1, float d0, float32_t *c)
+{
+    float k = 2.0f * BSP_AUDIO_RATE_HZ;
+    float kk = k * k;
+    float a0 = d2 * kk + d1 * k + d0;
+
+    c[0] = (n2 * kk + n1 * k + n0) / a0;
+    c[1] = 2.0f * (n0 - n2 * kk) / a0;
+    c[2] = (n2 * kk - n1 * k + n0) / a0;
+    c[3] = -2.0f * (d0 - d2 * kk) / a0;
+    c[4] = -(d2 * kk - d1 * k + d0) / a0;
+}
+
+/**
+ * @brief magnitude of one biquad at f
+ *
+ * @param c     b0, b1, b2, -a1, -a2
+ * @param f     Hz
+ * @return float gain
+ */
+static float slm_gain(const float32_t *c, float f)
+{
+    float w = 2.0f * PI * f / BSP_AUDIO_RATE_HZ;
+    float c1 = cosf(w), s1 = sinf(w);
+    float c2 = cosf(2.0f * w), s2 = sinf(2.0f * w);
+    float nr = c[0] + c[1] * c1 + c[2] * c2;
+    float ni = -(c[1] * s1 + c[2] * s2);
+    float dr = 1.0f - c[3] * c1 - c[4] * c2;
+    float di = c[3] * s1 + c[4] * s2;
+
+    return sqrtf((nr * nr + ni * ni) / (dr * dr + di * di));
+}
+
+/**
+ * @brief build the A weighting cascade and the octave band filters
+ *
+ */
+static void slm_design(void)
+{
+    const float w1 = 2.0f * PI * 20.598997f;
+    const float w2 = 2.0f * PI * 107.65265f;
+    const float w3 = 2.0f * PI * 737.86223f;
+    const float w4 = 2.0f * PI * 12194.217f;
+
+    /* A(s) ~ s^4 / ((s + w1)^2 (s + w2)(s + w3)(s + w4)^2), one section per pole pair */
+    slm_bilinear(1.0f, 0.0f, 0.0f, 1.0f, 2.0f * w1, w1 * w1, &m_a_coef[0]);
+    slm_bilinear(1.0f, 0.0f, 0.0f, 1.0f, w2 + w3, w2 * w3, &m_a_coef[5]);
+    slm_bilinear(0.0f, 0.0f, 1.0f, 1.0f, 2.0f * w4, w4 * w4, &m_a_coef[10]);
+
+    /* 0 dB at 1 kHz per section, keeps every stage well scaled in float */
+    for (int i = 0; i < SLM_A_STAGES; i++)
+    {
+        float g = slm_gain(&m_a_coef[i * 5], 1000.0f);
+
+        m_a_coef[i * 5 + 0] /= g;
+        m_a_coef[i * 5 + 1] /= g;
+        m_a_coef[i * 5 + 2] /= g;
+    }
+    arm_biquad_cascade_df2T_init_f32(&m_a, SLM_A_STAGES, m_a_coef, m_a_state);
+
+    for (int b = 0; b < BSP_SLM_BANDS; b++)
+    {
+        float w0 = 2.0f * PI * m_band_hz[b] / BSP_AUDIO_RATE_HZ;
+        float alpha = sinf(w0) / (2.0f * SLM_BAND_Q);
+        float a0 = 1.0f + alpha;
+
+        m_band_coef[b][0] = alpha / a0;
+        m_band_coef[b][1] = 0.0f;
+        m_band_coef[b][2] = -alpha / a0;
+        m_band_coef[b][3] = 2.0f * cosf(w0) / a0;
+        m_band_coef[b][4] = -(1.0f - alpha) / a0;
+        arm_biquad_cascade_df2T_init_f32(&m_band[b], 1, m_band_coef[b], m_band_state[b]);
+    }
+}
+
+static void slm_reset(bool filters)
+{
+    if (filters)
+    {
+        memset(m_a_state, 0, sizeof(m_a_state));
+        memset(m_band_state, 0, sizeof(m_band_state));
+    }
+    m_acc_a = 0.0f;
+    memset(m_acc_band, 0, sizeof(m_acc_band));
+    m_peak = 0.0f;
+    m_samples = 0;
+}
+
+/**
+ * @brief full scale mean square -> 0.01 dB SPL
+ *
+ */
+static int16_t slm_db(float ms)
+{
+    float db = 10.0f * log10f(ms + 1e-12f) + SLM_SINE_DBFS + BSP_SLM_SPL_AT_0DBFS;
+
+    return (int16_t)lroundf(CLAMP(db, -300.0f, 300.0f) * 100.0f);
+}
+
+static void slm_report(uint32_t ts)
+{
+    slm_packet_t packet;
+
+    g_Bsp.slm.laeq = slm_db(m_acc_a / m_samples);
+    g_Bsp.slm.lpeak = slm_db(m_peak * m_peak);
+    for (int b = 0; b < BSP_SLM_BANDS; b++)
+    {
+        g_Bsp.slm.band[b] = slm_db(m_acc_band[b] / m_samples);
+    }
+    g_Bsp.slm.ts = ts;
+    g_Bsp.slm.reports++;
+
+    packet.id = NUS_MSG_NOTIFY_SLM;
+    packet.len = sizeof(packet);
+    packet.laeq = g_Bsp.slm.laeq;
+    packet.lpeak = g_Bsp.slm.lpeak;
+    memcpy(packet.band, g_Bsp.slm.band, sizeof(packet.band));
+    packet.ts = ts;
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+    bsp_tslog_append(BSP_TSLOG_T_SLM, &packet.laeq, offsetof(slm_packet_t, ts) - offsetof(slm_packet_t, laeq));
+}
+
+/**
+ * @brief one 10 ms block through the weighting and band filters
+ *
+ * @param pcm   BSP_AUDIO_BLOCK_SAMPLES samples
+ */
+static void slm_block(const int16_t *pcm)
+{
+    float32_t p, pk;
+    uint32_t idx;
+
+    arm_q15_to_float((const q15_t *)pcm, m_x, BSP_AUDIO_BLOCK_SAMPLES);
+
+    arm_biquad_cascade_df2T_f32(&m_a, m_x, m_y, BSP_AUDIO_BLOCK_SAMPLES);
+    arm_power_f32(m_y, BSP_AUDIO_BLOCK_SAMPLES, &p);
+    arm_absmax_f32(m_y, BSP_AUDIO_BLOCK_SAMPLES, &pk, &idx);
+    m_acc_a += p;
+    m_peak = MAX(m_peak, pk);
+
+    for (int b = 0; b < BSP_SLM_BANDS; b++)
+    {
+        arm_biquad_cascade_df2T_f32(&m_band[b], m_x, m_y, BSP_AUDIO_BLOCK_SAMPLES);
+        arm_power_f32(m_y, BSP_AUDIO_BLOCK_SAMPLES, &p);
+        m_acc_band[b] += p;
+    }
+
+    m_samples += BSP_AUDIO_BLOCK_SAMPLES;
+}
+
+static void slm_task(void)
+{
+    AUDIO_BLK_ST blk;
+
+    slm_design();
+    g_Bsp.slm.intervalMs = BSP_DEFAULT_SLM_INTERVAL_MS;
+
+    while (1)
+    {
+        k_msgq_get(&slm_mq, &blk, K_FOREVER);
+
+        /* First block after attach or a new interval, start clean */
+        if (blk.start || m_interval != g_Bsp.slm.intervalMs)
+        {
+            m_interval = g_Bsp.slm.intervalMs;
+            slm_reset(blk.start);
+        }
+
+        slm_block((const int16_t *)blk.pcm);
+        bsp_audio_block_release(blk.pcm);
+
+        if (m_interval && m_samples >= (uint32_t)m_interval * (BSP_AUDIO_RATE_HZ / 1000))
+        {
+            slm_report(blk.ts);
+            slm_reset(false);
+        }
+    }
+}
+
+/**
+ * @brief set the reporting interval, attaches the meter to the audio pipeline
+ *
+ * @param interval_ms   0 : off, else >= BSP_SLM_MIN_INTERVAL_MS
+ * @return int          0 : OK, -1 : ERROR
+ */
+int bsp_audio_slm_set_interval(uint16_t interval_ms)
+{
+    if (interval_ms == 0)
+    {
+        bsp_audio_sink_detach(BSP_AUDIO_SINK_SLM);
+        g_Bsp.slm.intervalMs = 0;
+        LOG_INF("SLM off");
+        return 0;
+    }
+    if (interval_ms < BSP_SLM_MIN_INTERVAL_MS)
+    {
+        LOG_ERR("SLM interval %d < %d ms", interval_ms, BSP_SLM_MIN_INTERVAL_MS);
+        return -1;
+    }
+
+    if (g_Bsp.slm.intervalMs == 0 && bsp_audio_sink_attach(BSP_AUDIO_SINK_SLM, &slm_mq, 0) < 0)
+    {
+        return -1;
+    }
+    g_Bsp.slm.intervalMs = interval_ms;
+
+    LOG_INF("SLM every %d ms", interval_ms);
+
+    return 0;
+}
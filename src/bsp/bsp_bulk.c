@@ -0,0 +1,207 @@
+/*
+    Bulk transfer over NUS
+
+    For data bigger than one notification (IMU history, later clips/logs).
+    The owner registers a read callback, bulk_task pulls MTU sized pieces
+    from it and sends them as NUS_MSG_NOTIFY_BULK frames:
+
+        NUS_MSG_NOTIFY_BULK_INFO  START, total bytes
+        NUS_MSG_NOTIFY_BULK       SEQ 0..n, payload up to MTU - header
+        NUS_MSG_NOTIFY_BULK_INFO  END (or ABORT), frames sent
+
+    Runs at low priority and backs off when the BLE buffers are full, so
+    streaming never holds up the realtime tasks. One transfer at a time.
+*/
+#include <errno.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(bulk, LOG_LEVEL_INF);
+
+#define BULK_HDR_LEN 7 // id + len + stream + seq
+#define BULK_RETRY_MS 5
+#define BULK_RETRY_MAX 200
+
+static void bulk_task(void);
+
+K_THREAD_DEFINE(thread_bulk, 1024, bulk_task, NULL, NULL, NULL, 10, 0, 0);
+
+K_SEM_DEFINE(bulk_sem, 0, 1);
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t stream; // BSP_BULK_STREAM_xxx
+    uint16_t seq;
+    uint8_t data[BSP_BULK_FRAME_MAX - BULK_HDR_LEN];
+} bulk_packet_t;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t stream;
+    uint8_t evt;    // BSP_BULK_EVT_xxx
+    uint32_t total; // bytes
+    uint16_t frames;
+} bulk_info_packet_t;
+
+static struct
+{
+    uint8_t stream;
+    uint32_t total;
+    bsp_bulk_read_t read;
+    void *ctx;
+} m_req;
+
+static atomic_t m_busy;
+static volatile bool m_abort;
+
+static void bulk_info(uint8_t evt, uint32_t total, uint16_t frames)
+{
+    bulk_info_packet_t packet;
+
+    packet.id = NUS_MSG_NOTIFY_BULK_INFO;
+    packet.len = sizeof(packet);
+    packet.stream = m_req.stream;
+    packet.evt = evt;
+    packet.total = total;
+    packet.frames = frames;
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+/**
+ * @brief send one frame, wait while the stack is out of buffers
+ *
+ * @return int  0 : OK, -1 : ERROR
+ */
+static int bulk_send(const bulk_packet_t *p, int len)
+{
+    for (int retry = 0; retry < BULK_RETRY_MAX; retry++)
+    {
+        int err = ble_nus_send_frame((const uint8_t *)p, len);
+
+        if (err == 0)
+        {
+            return 0;
+        }
+        if (err != -ENOMEM && err != -EAGAIN)
+        {
+            LOG_ERR("Bulk send failed (%d)", err);
+            return -1;
+        }
+        k_msleep(BULK_RETRY_MS);
+    }
+
+    LOG_ERR("Bulk send timeout");
+    return -1;
+}
+
+static void bulk_task(void)
+{
+    static bulk_packet_t packet;
+
+    while (1)
+    {
+        uint32_t offset = 0;
+        uint16_t seq = 0;
+        int chunk, n;
+        uint8_t evt = BSP_BULK_EVT_END;
+
+        k_sem_take(&bulk_sem, K_FOREVER);
+
+        bulk_info(BSP_BULK_EVT_START, m_req.total, 0);
+
+        while (offset < m_req.total)
+        {
+            chunk = MIN(ble_nus_get_payload_len(), BSP_BULK_FRAME_MAX) - BULK_HDR_LEN;
+            if (m_abort || chunk <= 0)
+            {
+                evt = BSP_BULK_EVT_ABORT;
+                break;
+            }
+            chunk = MIN((uint32_t)chunk, m_req.total - offset);
+
+            n = m_req.read(offset, packet.data, chunk, m_req.ctx);
+            if (n <= 0)
+            {
+                evt = (n == 0) ? BSP_BULK_EVT_END : BSP_BULK_EVT_ABORT;
+                break;
+            }
+
+            packet.id = NUS_MSG_NOTIFY_BULK;
+            packet.len = BULK_HDR_LEN + n;
+            packet.stream = m_req.stream;
+            packet.seq = seq;
+            if (bulk_send(&packet, packet.len) < 0)
+            {
+                evt = BSP_BULK_EVT_ABORT;
+                break;
+            }
+
+            offset += n;
+            seq++;
+        }
+
+        bulk_info(evt, offset, seq);
+        LOG_INF("Bulk stream %d %s, %d bytes, %d frames", m_req.stream,
+                (evt == BSP_BULK_EVT_END) ? "done" : "aborted", offset, seq);
+
+        atomic_set(&m_busy, 0);
+    }
+}
+
+/**
+ * @brief queue a bulk transfer
+ *
+ * @param stream    BSP_BULK_STREAM_xxx, echoed in every frame
+ * @param total     bytes to send
+ * @param read      fills the next piece, returns bytes, 0 : end, < 0 : ERROR
+ * @param ctx       passed to read
+ * @return int      0 : OK, -1 : busy or nothing to send
+ */
+int bsp_bulk_start(uint8_t stream, uint32_t total, bsp_bulk_read_t read, void *ctx)
+{
+    if (total == 0 || read == NULL)
+    {
+        return -1;
+    }
+    if (!atomic_cas(&m_busy, 0, 1))
+    {
+        LOG_ERR("Bulk busy");
+        return -1;
+    }
+
+    m_req.stream = stream;
+    m_req.total = total;
+    m_req.read = read;
+    m_req.ctx = ctx;
+    m_abort = false;
+
+    k_sem_give(&bulk_sem);
+
+    return 0;
+}
+
+/**
+ * @brief stop the running transfer after the current frame
+ *
+ */
+void bsp_bulk_abort(void)
+{
+    m_abort = true;
+}
+
+/**
+ * @brief transfer in progress
+ *
+ * @return true : busy
+ */
+bool bsp_bulk_busy(void)
+{
+    return atomic_get(&m_busy) != 0;
+}
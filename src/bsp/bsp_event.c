@@ -0,0 +1,198 @@
+/*
+    Application event queue
+
+    One work queue thread (BSP_EVQ_PRIO) for the non-realtime work that
+    used to own a thread or sit on the system work queue :
+      - NUS message handling (was the msg_rcv thread, 2 KB stack)
+      - periodic jobs and the alive message (were prd_task and the main
+        loop, 2 KB stack)
+      - button press (was done in the GPIO ISR)
+      - wall clock sync, RTC schedule and IMU power mode works (were on the
+        system work queue, which the BT host wants responsive)
+    Events are k_work items, a post while the event is pending coalesces.
+    Handlers may block on I2C / flash but delay every other event while
+    they do, long transfers keep their own threads (bulk, tslog, settings,
+    clip writer, i2c). Realtime paths (IMU acquisition / processing, audio)
+    and the cli (blocking console read) keep theirs too.
+    The BT / board init runs as its first work, main() only starts the
+    queue and returns, so the main stack is cut down to what the driver
+    init needs (CONFIG_MAIN_STACK_SIZE).
+    Stats : post to start latency mean / max, run time max, stack high
+    water of the queue and of main. cli evq, NUS_MSG_GET_EVQ_STAT.
+*/
+#include "bsp.h"
+
+#define EVQ_AVG_SHIFT 4 // latency mean, 1/16 per run
+
+LOG_MODULE_REGISTER(bsp_evq, LOG_LEVEL_INF);
+
+extern BSP_ST g_Bsp;
+
+static K_THREAD_STACK_DEFINE(m_evq_stack, BSP_EVQ_STACK_SIZE);
+static struct k_work_q m_evq;
+static k_tid_t m_main; // exited after init, its stack stays for the high water
+
+typedef struct
+{
+    const char *name;
+    void (*fn)(void);
+} evq_evt_t;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    EVQ_ST evq;
+} evq_packet_t;
+
+static void evq_ping(void);
+
+static const evq_evt_t m_evt[BSP_EVTS] = {
+    [BSP_EVT_NUS_RX] = {"nus_rx", bsp_nus_msg_dispatch},
+    [BSP_EVT_BUTTON] = {"button", bsp_key_event},
+    [BSP_EVT_PING] = {"ping", evq_ping},
+};
+
+static struct k_work m_work[BSP_EVTS];
+static uint32_t m_post_cyc[BSP_EVTS];
+
+static void evq_ping(void)
+{
+}
+
+static void evq_handler(struct k_work *work)
+{
+    int e = work - m_work;
+    EVQ_EVT_STAT_ST *st = &g_Bsp.evq.evt[e];
+    uint32_t start = k_cycle_get_32();
+    uint32_t lat_us = k_cyc_to_us_floor32(start - m_post_cyc[e]);
+    uint32_t run_us;
+
+    m_evt[e].fn();
+
+    run_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+    st->runs++;
+    st->latMaxUs = MAX(st->latMaxUs, lat_us);
+    st->runMaxUs = MAX(st->runMaxUs, run_us);
+    st->latAvgUs += ((int32_t)lat_us - (int32_t)st->latAvgUs) >> EVQ_AVG_SHIFT;
+}
+
+/**
+ * @brief start the event queue thread, call from main() before anything posts
+ *
+ * @return int 0 : OK
+ */
+int bsp_evq_init(void)
+{
+    const struct k_work_queue_config cfg = {
+        .name = "bsp_evq",
+    };
+
+    for (int e = 0; e < BSP_EVTS; e++)
+    {
+        k_work_init(&m_work[e], evq_handler);
+    }
+
+    k_work_queue_start(&m_evq, m_evq_stack, K_THREAD_STACK_SIZEOF(m_evq_stack), BSP_EVQ_PRIO, &cfg);
+    g_Bsp.evq.stackSize = K_THREAD_STACK_SIZEOF(m_evq_stack);
+    g_Bsp.evq.mainStackSize = CONFIG_MAIN_STACK_SIZE;
+    m_main = k_current_get();
+
+    return 0;
+}
+
+/**
+ * @brief post an event, ISR safe
+ *
+ * @param evt   BSP_EVT_xxx
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_evq_post(uint8_t evt)
+{
+    if (evt >= BSP_EVTS)
+    {
+        return -1;
+    }
+
+    /* Pending : coalesces, the latency counts from the first post */
+    if (!k_work_is_pending(&m_work[evt]))
+    {
+        m_post_cyc[evt] = k_cycle_get_32();
+    }
+    g_Bsp.evq.evt[evt].posted++;
+
+    return (k_work_submit_to_queue(&m_evq, &m_work[evt]) < 0) ? -1 : 0;
+}
+
+/**
+ * @brief k_work_submit() on the event queue
+ *
+ */
+int bsp_evq_submit(struct k_work *work)
+{
+    return k_work_submit_to_queue(&m_evq, work);
+}
+
+/**
+ * @brief k_work_reschedule() on the event queue, absolute timeouts work too
+ *
+ */
+int bsp_evq_reschedule(struct k_work_delayable *dwork, k_timeout_t delay)
+{
+    return k_work_reschedule_for_queue(&m_evq, dwork, delay);
+}
+
+/**
+ * @brief event name for the cli
+ *
+ */
+const char *bsp_evq_name(uint8_t evt)
+{
+    return (evt < BSP_EVTS) ? m_evt[evt].name : "?";
+}
+
+/**
+ * @brief stack high water (queue and main) into g_Bsp.evq
+ *
+ */
+void bsp_evq_update_stat(void)
+{
+    size_t unused = 0;
+
+    if (k_thread_stack_space_get(&m_evq.thread, &unused) == 0)
+    {
+        g_Bsp.evq.stackUsed = g_Bsp.evq.stackSize - unused;
+    }
+    if (m_main != NULL && k_thread_stack_space_get(m_main, &unused) == 0)
+    {
+        g_Bsp.evq.mainStackUsed = g_Bsp.evq.mainStackSize - unused;
+    }
+}
+
+/**
+ * @brief clear the latency / run time stats
+ *
+ */
+void bsp_evq_reset_stat(void)
+{
+    memset(g_Bsp.evq.evt, 0, sizeof(g_Bsp.evq.evt));
+}
+
+/**
+ * @brief NUS_MSG_NOTIFY_EVQ_STAT
+ *
+ */
+void bsp_evq_notify_stat(void)
+{
+    evq_packet_t packet;
+
+    bsp_evq_update_stat();
+
+    packet.id = NUS_MSG_NOTIFY_EVQ_STAT;
+    packet.len = sizeof(packet);
+    packet.evq = g_Bsp.evq;
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
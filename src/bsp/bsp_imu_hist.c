@@ -0,0 +1,190 @@
+/*
+    IMU history in RAM, the last BSP_IMU_HIST_RAM bytes worth of samples
+
+    Structure of arrays (one int16 array per axis + ts array), written once by
+    imu_proc_task straight from the ring slot. A query maps "from/to ms ago"
+    to a sample range and streams it through the bulk path as records:
+        TS(4) | ACC_X(2) | ACC_Y(2) | ACC_Z(2) | GYRO_X(2) | GYRO_Y(2) | GYRO_Z(2)
+    Samples overwritten while the transfer runs abort it instead of sending
+    newer data under old indexes. A record is written and copied under
+    m_lock, so the reader never sees one half updated.
+*/
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(imu_hist, LOG_LEVEL_INF);
+
+#define HIST_REC_LEN sizeof(hist_rec_t)
+#define HIST_LEN (BSP_IMU_HIST_RAM / (6 * sizeof(int16_t) + sizeof(uint32_t)))
+
+typedef struct PACKED
+{
+    uint32_t ts;
+    int16_t acc[3];
+    int16_t gyro[3];
+} hist_rec_t;
+
+static int16_t m_axis[6][HIST_LEN]; // acc x/y/z, gyro x/y/z
+static uint32_t m_ts[HIST_LEN];
+static volatile uint32_t m_wr = 0; // samples written since boot
+static struct k_spinlock m_lock;   // one record + m_wr
+
+/* Range of the running query, absolute sample numbers [start, end) */
+static uint32_t m_q_start, m_q_end;
+
+/**
+ * @brief store one sample, consumer side only
+ *
+ * @param s sample from the IMU ring
+ */
+void bsp_imu_hist_put(const IMU_SAMPLE_ST *s)
+{
+    k_spinlock_key_t key = k_spin_lock(&m_lock);
+    uint32_t idx = m_wr % HIST_LEN;
+
+    m_axis[0][idx] = s->acc[0];
+    m_axis[1][idx] = s->acc[1];
+    m_axis[2][idx] = s->acc[2];
+    m_axis[3][idx] = s->gyro[0];
+    m_axis[4][idx] = s->gyro[1];
+    m_axis[5][idx] = s->gyro[2];
+    m_ts[idx] = s->ts;
+    m_wr++;
+
+    k_spin_unlock(&m_lock, key);
+}
+
+/**
+ * @brief first sample (absolute number) not older than age_us
+ *
+ * @param oldest    first sample still in RAM
+ * @param newest    one past the last sample
+ * @param now       bsp_time_us() low 32 bits
+ * @param age_us    age limit
+ * @return uint32_t sample number, newest if none
+ */
+static uint32_t hist_find(uint32_t oldest, uint32_t newest, uint32_t now, uint32_t age_us)
+{
+    /* Age only goes down with the sample number, binary search */
+    while (oldest < newest)
+    {
+        uint32_t mid = oldest + (newest - oldest) / 2;
+
+        if (now - m_ts[mid % HIST_LEN] > age_us)
+        {
+            oldest = mid + 1;
+        }
+        else
+        {
+            newest = mid;
+        }
+    }
+    return oldest;
+}
+
+static int hist_read(uint32_t offset, uint8_t *buf, uint16_t len, void *ctx)
+{
+    uint32_t rec = m_q_start + offset / HIST_REC_LEN;
+    uint32_t skip = offset % HIST_REC_LEN;
+    int n = 0;
+
+    while (n < len && rec < m_q_end)
+    {
+        hist_rec_t r;
+        uint32_t idx = rec % HIST_LEN;
+        uint32_t cp;
+        bool lost;
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+        /* Writer already reached the slot, the record is not the one asked for */
+        lost = (m_wr - rec >= HIST_LEN);
+        if (!lost)
+        {
+            r.ts = m_ts[idx];
+            for (int i = 0; i < 3; i++)
+            {
+                r.acc[i] = m_axis[i][idx];
+                r.gyro[i] = m_axis[3 + i][idx];
+            }
+        }
+        k_spin_unlock(&m_lock, key);
+
+        if (lost)
+        {
+            LOG_ERR("History overwritten during transfer");
+            return -1;
+        }
+
+        cp = MIN(HIST_REC_LEN - skip, (uint32_t)(len - n));
+        memcpy(buf + n, (uint8_t *)&r + skip, cp);
+        n += cp;
+        skip = 0;
+        rec++;
+    }
+
+    return n;
+}
+
+/**
+ * @brief stream samples between from_ms and to_ms ago over the bulk path
+ *
+ * @param from_ms   oldest end of the range, ms before now
+ * @param to_ms     newest end of the range, ms before now (0 : up to now)
+ * @return int      samples queued, -1 : ERROR
+ */
+int bsp_imu_hist_query(uint32_t from_ms, uint32_t to_ms)
+{
+    uint32_t wr = m_wr;
+    uint32_t oldest = (wr > HIST_LEN) ? wr - HIST_LEN : 0;
+    uint32_t now = (uint32_t)bsp_time_us();
+    uint32_t start, end;
+
+    if (from_ms <= to_ms)
+    {
+        LOG_ERR("Bad range %d..%d ms", from_ms, to_ms);
+        return -1;
+    }
+    if (bsp_bulk_busy())
+    {
+        LOG_ERR("Bulk busy");
+        return -1;
+    }
+
+    /* Ages in [to_ms, from_ms] */
+    start = hist_find(oldest, wr, now, from_ms * 1000U);
+    end = (to_ms == 0) ? wr : hist_find(start, wr, now, to_ms * 1000U - 1);
+    if (end <= start)
+    {
+        LOG_INF("No history in range");
+        return 0;
+    }
+
+    m_q_start = start;
+    m_q_end = end;
+
+    if (bsp_bulk_start(BSP_BULK_STREAM_IMU_HIST, (end - start) * HIST_REC_LEN, hist_read, NULL) < 0)
+    {
+        return -1;
+    }
+
+    LOG_INF("History %d samples (%d..%d ms ago)", end - start, from_ms, to_ms);
+
+    return end - start;
+}
+
+/**
+ * @brief history capacity and fill
+ *
+ * @param st copy destination
+ */
+void bsp_imu_hist_get_stat(IMU_HIST_STAT_ST *st)
+{
+    uint32_t wr = m_wr;
+
+    st->capacity = HIST_LEN;
+    st->count = MIN(wr, HIST_LEN);
+    st->spanMs = 0;
+    if (st->count > 1)
+    {
+        st->spanMs = (m_ts[(wr - 1) % HIST_LEN] - m_ts[(wr - st->count) % HIST_LEN]) / 1000;
+    }
+}
@@ -0,0 +1,152 @@
+/*
+    IMU consumer stage
+
+    Takes samples out of the IMU ring and runs everything that may block or
+    take time (fusion, BLE notify), so imu_task only does acquisition.
+*/
+#include "bsp.h"
+
+extern BSP_ST g_Bsp;
+
+static void imu_proc_task(void);
+
+LOG_MODULE_REGISTER(imu_proc, LOG_LEVEL_INF);
+
+K_THREAD_DEFINE(thread_imu_proc, 3072, imu_proc_task, NULL, NULL, NULL, 8, 0, 0);
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    int16_t acc_x;
+    int16_t acc_y;
+    int16_t acc_z;
+    int16_t gyro_x;
+    int16_t gyro_y;
+    int16_t gyro_z;
+    uint16_t seq;
+    uint32_t ts; // device us, see NUS_MSG_NOTIFY_TIME_SYNC_STAT to map to central time
+} sensor_packet_t;
+
+/**
+ * @brief feed the fusion filter with one sample and notify at fusionRateHz
+ *
+ * @param s sample from the ring
+ */
+static void imu_fusion_step(const IMU_SAMPLE_ST *s)
+{
+    static uint32_t last_ts = 0;
+    static int64_t last_notify_ms = 0;
+    float acc_f[3], gyro_f[3];
+    float dt = 1.0f / g_Bsp.imuPwr.odrHz;
+    uint8_t mask = g_Bsp.imu.outMask & BSP_IMU_OUT_FUSION;
+
+    if (last_ts != 0)
+    {
+        /* Sample to sample time from data-ready timestamps, not from when we got here */
+        dt = (float)(s->ts - last_ts) / 1000000.0f;
+        if (dt > 0.5f)
+        {
+            /* Long gap (mode change or stall), do not integrate a huge step */
+            dt = 1.0f / g_Bsp.imuPwr.odrHz;
+        }
+    }
+    last_ts = s->ts;
+
+    for (int i = 0; i < 3; i++)
+    {
+        acc_f[i] = (float)s->acc[i] / BSP_IMU_ACC_SCALE;
+        gyro_f[i] = (float)s->gyro[i] / BSP_IMU_GYRO_SCALE;
+    }
+
+    bsp_imu_fusion_update(acc_f, gyro_f, dt);
+
+    if (g_Bsp.imu.fusionRateHz != 0 && (k_uptime_get() - last_notify_ms) >= (1000 / g_Bsp.imu.fusionRateHz))
+    {
+        last_notify_ms = k_uptime_get();
+        bsp_imu_fusion_notify(mask);
+    }
+}
+
+/**
+ * @brief send one sample as NUS_MSG_NOTIFY_IMU, decimation bank sink
+ *
+ * @param s     sample at the BSP_DECIM_SUB_RAW rate
+ * @param ctx   not used
+ */
+static void imu_raw_notify(const IMU_SAMPLE_ST *s, void *ctx)
+{
+    sensor_packet_t packet;
+
+    if (!(g_Bsp.imu.outMask & BSP_IMU_OUT_RAW))
+    {
+        return;
+    }
+
+    packet.id = NUS_MSG_NOTIFY_IMU;
+    packet.len = sizeof(packet);
+    packet.acc_x = s->acc[0];
+    packet.acc_y = s->acc[1];
+    packet.acc_z = s->acc[2];
+
+    // Protocol keeps gyro in rad/s x100
+    packet.gyro_x = s->gyro[0] / (BSP_IMU_GYRO_SCALE / 100);
+    packet.gyro_y = s->gyro[1] / (BSP_IMU_GYRO_SCALE / 100);
+    packet.gyro_z = s->gyro[2] / (BSP_IMU_GYRO_SCALE / 100);
+    packet.seq = s->seq;
+    packet.ts = s->ts;
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+static void imu_hist_sink(const IMU_SAMPLE_ST *s, void *ctx)
+{
+    bsp_imu_hist_put(s);
+}
+
+static void imu_proc_task(void)
+{
+    IMU_SAMPLE_ST *s;
+
+    /* Rate reduced outputs come from the decimation bank */
+    bsp_imu_decim_subscribe(BSP_DECIM_SUB_RAW, BSP_DEFAULT_DECIM_RAW_HZ, imu_raw_notify, NULL);
+    bsp_imu_decim_subscribe(BSP_DECIM_SUB_HIST, BSP_DEFAULT_DECIM_HIST_HZ, imu_hist_sink, NULL);
+
+    while (1)
+    {
+        s = bsp_imu_ring_peek(K_FOREVER);
+        if (s == NULL)
+        {
+            continue;
+        }
+
+        bsp_imu_set_latest(s);
+        bsp_imu_activity(s);
+        bsp_imu_cal_process(s);
+
+        if (g_Bsp.imu.outMask & BSP_IMU_OUT_FUSION)
+        {
+            imu_fusion_step(s);
+        }
+
+        if (g_Bsp.imu.outMask & BSP_IMU_OUT_MOTION)
+        {
+            bsp_motion_detect_process(s);
+        }
+
+        if (g_Bsp.imu.outMask & BSP_IMU_OUT_VIB)
+        {
+            bsp_imu_vib_process(s);
+        }
+
+        if (g_Bsp.imu.outMask & BSP_IMU_OUT_CLASS)
+        {
+            bsp_imu_ml_process(s);
+        }
+
+        bsp_imu_decim_process(s);
+
+        bsp_imu_ring_release();
+    }
+}
@@ -0,0 +1,172 @@
+/*
+    IMU sample ring, single producer (imu_task) / single consumer (imu_proc_task)
+
+    Lock-free: the producer only writes m_head, the consumer only writes m_tail.
+    The consumer reads records in place (peek/release), no copy out of the ring.
+    When the ring is full the newest sample is dropped and counted, the
+    acquisition side never waits for the consumer.
+*/
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+
+#include "bsp.h"
+
+BUILD_ASSERT(IS_POWER_OF_TWO(BSP_IMU_RING_SIZE), "BSP_IMU_RING_SIZE must be power of 2");
+
+#define RING_MASK (BSP_IMU_RING_SIZE - 1)
+
+LOG_MODULE_REGISTER(imu_ring, LOG_LEVEL_INF);
+
+extern BSP_ST g_Bsp;
+
+static IMU_SAMPLE_ST m_ring[BSP_IMU_RING_SIZE];
+static atomic_t m_head; // next slot to write, producer owned
+static atomic_t m_tail; // next slot to read, consumer owned
+
+static IMU_RING_STAT_ST m_stat = {.size = BSP_IMU_RING_SIZE};
+
+/* Wakes the consumer, producer gives one count per pushed sample */
+K_SEM_DEFINE(imu_ring_sem, 0, BSP_IMU_RING_SIZE);
+
+/* Protects the latest sample copy in g_Bsp.imu (12 bytes, a few cycles) */
+static struct k_spinlock m_latest_lock;
+
+/**
+ * @brief push one sample, producer side only
+ *
+ * @param s     sample to copy into the ring
+ * @return int  0 : OK, -1 : ring full, sample dropped
+ */
+int bsp_imu_ring_push(const IMU_SAMPLE_ST *s)
+{
+    atomic_val_t head = atomic_get(&m_head);
+    atomic_val_t tail = atomic_get(&m_tail);
+    uint32_t used = (uint32_t)(head - tail);
+
+    if (used >= BSP_IMU_RING_SIZE)
+    {
+        m_stat.overflow++;
+        return -1;
+    }
+
+    m_ring[head & RING_MASK] = *s;
+
+    /* Record must be visible before the consumer sees the new head */
+    barrier_dmem_fence_full();
+    atomic_set(&m_head, head + 1);
+
+    used++;
+    if (used > m_stat.highWater)
+    {
+        m_stat.highWater = used;
+    }
+    m_stat.pushed++;
+
+    k_sem_give(&imu_ring_sem);
+
+    return 0;
+}
+
+/**
+ * @brief get the oldest sample in place, consumer side only
+ *        call bsp_imu_ring_release() when done with it
+ *
+ * @param timeout   how long to wait for a sample
+ * @return IMU_SAMPLE_ST* slot pointer, NULL on timeout
+ */
+IMU_SAMPLE_ST *bsp_imu_ring_peek(k_timeout_t timeout)
+{
+    atomic_val_t tail = atomic_get(&m_tail);
+
+    if (atomic_get(&m_head) == tail)
+    {
+        if (k_sem_take(&imu_ring_sem, timeout) != 0)
+        {
+            return NULL;
+        }
+        if (atomic_get(&m_head) == tail)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        /* Keep the semaphore count in step with the fill level */
+        k_sem_take(&imu_ring_sem, K_NO_WAIT);
+    }
+
+    barrier_dmem_fence_full();
+
+    return &m_ring[tail & RING_MASK];
+}
+
+/**
+ * @brief hand the slot from bsp_imu_ring_peek() back to the producer
+ *
+ */
+void bsp_imu_ring_release(void)
+{
+    barrier_dmem_fence_full();
+    atomic_inc(&m_tail);
+    m_stat.popped++;
+}
+
+/**
+ * @brief ring counters
+ *
+ * @param st copy destination
+ */
+void bsp_imu_ring_get_stat(IMU_RING_STAT_ST *st)
+{
+    *st = m_stat;
+}
+
+/**
+ * @brief clear overflow counter and high-water mark
+ *
+ */
+void bsp_imu_ring_reset_stat(void)
+{
+    m_stat.overflow = 0;
+    m_stat.highWater = 0;
+}
+
+/**
+ * @brief publish latest sample to g_Bsp.imu for other threads
+ *
+ * @param s latest sample
+ */
+void bsp_imu_set_latest(const IMU_SAMPLE_ST *s)
+{
+    k_spinlock_key_t key = k_spin_lock(&m_latest_lock);
+
+    g_Bsp.imu.acc_x = s->acc[0];
+    g_Bsp.imu.acc_y = s->acc[1];
+    g_Bsp.imu.acc_z = s->acc[2];
+    g_Bsp.imu.gyro_x = s->gyro[0];
+    g_Bsp.imu.gyro_y = s->gyro[1];
+    g_Bsp.imu.gyro_z = s->gyro[2];
+
+    k_spin_unlock(&m_latest_lock, key);
+}
+
+/**
+ * @brief read a consistent copy of the latest sample in g_Bsp.imu
+ *
+ * @param s copy destination (ts/seq are not kept, set to 0)
+ */
+void bsp_imu_get_latest(IMU_SAMPLE_ST *s)
+{
+    k_spinlock_key_t key = k_spin_lock(&m_latest_lock);
+
+    s->acc[0] = g_Bsp.imu.acc_x;
+    s->acc[1] = g_Bsp.imu.acc_y;
+    s->acc[2] = g_Bsp.imu.acc_z;
+    s->gyro[0] = g_Bsp.imu.gyro_x;
+    s->gyro[1] = g_Bsp.imu.gyro_y;
+    s->gyro[2] = g_Bsp.imu.gyro_z;
+    s->ts = 0;
+    s->seq = 0;
+
+    k_spin_unlock(&m_latest_lock, key);
+}
@@ -9,25 +9,41 @@
 
 extern BSP_ST g_Bsp;
 
-static void msg_rcv_task(void);
-
 LOG_MODULE_REGISTER(msg_rcv, LOG_LEVEL_INF);
 
 /* Define the queue: (name, message_size, max_messages, alignment) */
 K_MSGQ_DEFINE(nus_msgq, sizeof(struct nus_msg_packet), 10, 4);
 
-K_THREAD_DEFINE(msg_rcv_id, 2048, msg_rcv_task, NULL, NULL, NULL, 7, 0, 0);
-
 static struct nus_msg_packet nus_data;
 
-static void msg_rcv_task(void)
+/**
+ * @brief payload length check, LEN counts id + len
+ *
+ * @param p     received packet
+ * @param need  payload bytes the handler reads
+ * @return true enough bytes
+ */
+static bool msg_len_ok(const struct nus_msg_packet *p, int need)
+{
+    if (p->len < 4 + need)
+    {
+        ERR("Message 0x%x too short : %d, payload needs %d", p->id, p->len, need);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief handle the queued messages, BSP_EVT_NUS_RX (event queue, was msg_rcv thread)
+ * 
+ */
+void bsp_nus_msg_dispatch(void)
 {
     struct nus_msg_packet received_data;
 
-    while (true)
+    /* Posts coalesce, one run drains everything queued so far */
+    while (k_msgq_get(&nus_msgq, &received_data, K_NO_WAIT) == 0)
     {
-        /* Wait forever (K_FOREVER) until a message arrives */
-        k_msgq_get(&nus_msgq, &received_data, K_FOREVER);
         LOG_HEXDUMP_WRN(&received_data, received_data.len, "nus_msg_rcv:");
 
         INF("Receiver: Got ID 0x%x with len: %d\n",
@@ -41,6 +57,10 @@ static void msg_rcv_task(void)
             switch (received_data.id)
             {
             case NUS_MSG_LED_CTRL:
+                if (!msg_len_ok(&received_data, 2))
+                {
+                    break;
+                }
                 uint8_t num = received_data.message[0]; // 0 : RED, 1 : GREEN, 2 : BLUE
                 uint8_t onoff = received_data.message[1];
 
@@ -64,23 +84,47 @@ static void msg_rcv_task(void)
                 break;
 
             case NUS_MSG_GET_BATT_ADC:
-
+                bsp_batt_sample();
+                bsp_batt_notify();
                 break;
 
             case NUS_MSG_SET_PWM_LED_WIDTH:
+                if (!msg_len_ok(&received_data, 4))
+                {
+                    break;
+                }
                 uint32_t pulse_width = received_data.message[0] << 24 | received_data.message[1] << 16 | received_data.message[2] << 8 | received_data.message[3];
                 bsp_pwm_led_ctrl(pulse_width);
                 g_Bsp.led_status.pwm_led_width = pulse_width;
+                bsp_settings_touch(BSP_SET_LED_PWM);
                 INF("LED pulse_width : %d nsec", g_Bsp.led_status.pwm_led_width);
                 break;
 
             case NUS_MSG_SET_PRD_TICK:
-                uint16_t tick = received_data.message[0] << 8 | received_data.message[1];
-                g_Bsp.prdTick = tick;
-                INF("PRD tick : %d ms", g_Bsp.prdTick);
+                /* PRD_TICK(2) alone : heartbeat, the old format. Or PRD_TICK(2) | JOB(1) | PERIOD_MS(4), nothing between */
+                uint32_t tick = (uint8_t)received_data.message[0] << 8 | (uint8_t)received_data.message[1];
+                uint8_t job = BSP_PRD_JOB_HEARTBEAT;
+                if (received_data.len == 4 + 7)
+                {
+                    job = (uint8_t)received_data.message[2];
+                    tick = (uint32_t)(uint8_t)received_data.message[3] << 24 |
+                           (uint32_t)(uint8_t)received_data.message[4] << 16 |
+                           (uint32_t)(uint8_t)received_data.message[5] << 8 | (uint8_t)received_data.message[6];
+                }
+                else if (received_data.len != 4 + 2)
+                {
+                    ERR("PRD tick length %d, expected 6 or 11", received_data.len);
+                    break;
+                }
+                bsp_prd_set_period(job, tick);
+                INF("PRD job %d : %d ms", job, tick);
                 break;
 
             case NUS_MSG_SET_RTC:
+                if (!msg_len_ok(&received_data, 7))
+                {
+                    break;
+                }
                 RTC_TIME_ST date = {0};
                 date.year = received_data.message[0];
                 date.mon = received_data.message[1];
@@ -89,13 +133,16 @@ static void msg_rcv_task(void)
                 date.hour = received_data.message[4];
                 date.min = received_data.message[5];
                 date.sec = received_data.message[6];
-                bsp_rtc_set_time(&date);
+                bsp_wall_set_time(&date);
                 INF("RTC set 20%02d-%02d-%02d, %02d:%02d:%02d", date.year, date.mon, date.day, date.hour, date.min, date.sec);
                 break;
 
             case NUS_MSG_GET_RTC:
                 RTC_TIME_ST gdate = {0};
-                bsp_rtc_get_time(&gdate);
+                if (bsp_wall_get_time(&gdate) != 0)
+                {
+                    bsp_rtc_get_time(&gdate); // not synced yet
+                }
 
                 nus_data.id = NUS_MSG_NOTIFY_RTC;
                 nus_data.len = sizeof(RTC_TIME_ST);
@@ -106,12 +153,276 @@ static void msg_rcv_task(void)
                 break;
 
             case NUS_MSG_SET_BUZZER:
+                if (!msg_len_ok(&received_data, 4))
+                {
+                    break;
+                }
                 uint16_t freq = received_data.message[0] << 8 | received_data.message[1];
                 uint16_t duration = received_data.message[2] << 8 | received_data.message[3];
                 bsp_pwm_buzzer(freq, duration);
                 INF("Buzzer freq : %d hz, duration : %d ms", freq, duration);
                 break;
 
+            case NUS_MSG_SET_IMU_OUTPUT:
+                if (!msg_len_ok(&received_data, 2))
+                {
+                    break;
+                }
+                uint8_t out_mask = received_data.message[0];
+                uint8_t fusion_rate = received_data.message[1];
+                bsp_imu_set_output(out_mask, fusion_rate);
+                INF("IMU output mask : 0x%02x, fusion rate : %d hz", out_mask, fusion_rate);
+                break;
+
+            case NUS_MSG_TIME_SYNC_REQ:
+                if (received_data.len < 4 + 8)
+                {
+                    break;
+                }
+                bsp_time_sync_request(&received_data);
+                break;
+
+            case NUS_MSG_TIME_SYNC_RESULT:
+                if (received_data.len < 4 + 16)
+                {
+                    break;
+                }
+                bsp_time_sync_result(&received_data);
+                break;
+
+            case NUS_MSG_SET_MOTION_CFG:
+                if (!msg_len_ok(&received_data, 8))
+                {
+                    break;
+                }
+                uint16_t tap_thr = received_data.message[0] << 8 | received_data.message[1];
+                uint16_t ff_thr = received_data.message[2] << 8 | received_data.message[3];
+                uint16_t step_thr = received_data.message[4] << 8 | received_data.message[5];
+                uint16_t shake_thr = received_data.message[6] << 8 | received_data.message[7];
+                bsp_motion_detect_set_thr(tap_thr, ff_thr, step_thr, shake_thr);
+                break;
+
+            case NUS_MSG_SET_IMU_MODE:
+                if (!msg_len_ok(&received_data, 5))
+                {
+                    break;
+                }
+                uint8_t imu_mode = received_data.message[0];
+                uint16_t imu_odr = received_data.message[1] << 8 | received_data.message[2];
+                uint16_t imu_idle = received_data.message[3] << 8 | received_data.message[4];
+                bsp_imu_set_mode(imu_mode, imu_odr, imu_idle);
+                INF("IMU mode : %d, odr : %d hz, idle : %d ms", imu_mode, imu_odr, imu_idle);
+                break;
+
+            case NUS_MSG_IMU_CAL:
+                if (!msg_len_ok(&received_data, 1))
+                {
+                    break;
+                }
+                bsp_imu_cal_cmd(received_data.message[0]);
+                break;
+
+            case NUS_MSG_SET_VIB_CFG:
+                if (!msg_len_ok(&received_data, 2))
+                {
+                    break;
+                }
+                uint16_t vib_win = received_data.message[0] << 8 | received_data.message[1];
+                bsp_imu_vib_set_win(vib_win);
+                INF("Vibration window : %d", vib_win);
+                break;
+
+            case NUS_MSG_ML_MODEL:
+                if (!msg_len_ok(&received_data, 4))
+                {
+                    break;
+                }
+                bsp_imu_ml_upload(&received_data);
+                break;
+
+            case NUS_MSG_GET_IMU_HIST:
+                if (!msg_len_ok(&received_data, 8))
+                {
+                    break;
+                }
+                const uint8_t *hist = (const uint8_t *)received_data.message;
+                uint32_t hist_from = (uint32_t)hist[0] << 24 | (uint32_t)hist[1] << 16 | (uint32_t)hist[2] << 8 | hist[3];
+                uint32_t hist_to = (uint32_t)hist[4] << 24 | (uint32_t)hist[5] << 16 | (uint32_t)hist[6] << 8 | hist[7];
+                bsp_imu_hist_query(hist_from, hist_to);
+                break;
+
+            case NUS_MSG_SET_DECIM_RATE:
+                if (!msg_len_ok(&received_data, 3))
+                {
+                    break;
+                }
+                uint8_t decim_sub = received_data.message[0];
+                uint16_t decim_rate = (uint8_t)received_data.message[1] << 8 | (uint8_t)received_data.message[2];
+                bsp_imu_decim_set_rate(decim_sub, decim_rate);
+                INF("Decim sub %d rate : %d hz", decim_sub, decim_rate);
+                break;
+
+            case NUS_MSG_SET_AUDIO_STREAM:
+                if (!msg_len_ok(&received_data, 1))
+                {
+                    break;
+                }
+                uint8_t audio_on = received_data.message[0];
+                uint8_t audio_vad = (received_data.len > 5) ? received_data.message[1] : 0;
+                bsp_audio_stream(audio_on, audio_vad);
+                INF("Audio stream : %d, vad : %d", audio_on, audio_vad);
+                break;
+
+            case NUS_MSG_SET_SLM_CFG:
+                if (!msg_len_ok(&received_data, 2))
+                {
+                    break;
+                }
+                uint16_t slm_interval = (uint8_t)received_data.message[0] << 8 | (uint8_t)received_data.message[1];
+                bsp_audio_slm_set_interval(slm_interval);
+                INF("SLM interval : %d ms", slm_interval);
+                break;
+
+            case NUS_MSG_SET_CLIP_CFG:
+                if (!msg_len_ok(&received_data, 5))
+                {
+                    break;
+                }
+                uint8_t clip_arm = received_data.message[0];
+                uint16_t clip_pre = (uint8_t)received_data.message[1] << 8 | (uint8_t)received_data.message[2];
+                uint16_t clip_post = (uint8_t)received_data.message[3] << 8 | (uint8_t)received_data.message[4];
+                bsp_audio_clip_arm(clip_arm, clip_pre, clip_post);
+                INF("Clip arm : %d, pre %d ms, post %d ms", clip_arm, clip_pre, clip_post);
+                break;
+
+            case NUS_MSG_GET_CLIP:
+                if (!msg_len_ok(&received_data, 4))
+                {
+                    break;
+                }
+                uint32_t clip_id = (uint32_t)(uint8_t)received_data.message[0] << 24 |
+                                   (uint32_t)(uint8_t)received_data.message[1] << 16 |
+                                   (uint32_t)(uint8_t)received_data.message[2] << 8 |
+                                   (uint8_t)received_data.message[3];
+                bsp_audio_clip_get(clip_id);
+                INF("Get clip : %d", clip_id);
+                break;
+
+            case NUS_MSG_CLIP_TRIGGER:
+                bsp_audio_clip_trigger(BSP_CLIP_TRIG_MANUAL);
+                break;
+
+            case NUS_MSG_SET_AED_CFG:
+                if (!msg_len_ok(&received_data, 3))
+                {
+                    break;
+                }
+                uint16_t aed_tone[BSP_AED_TONES];
+                bool aed_has_tone = (received_data.len >= 4 + 3 + 2 * BSP_AED_TONES);
+                for (int i = 0; i < BSP_AED_TONES; i++)
+                {
+                    aed_tone[i] = (uint8_t)received_data.message[3 + 2 * i] << 8 | (uint8_t)received_data.message[4 + 2 * i];
+                }
+                bsp_audio_aed_set(received_data.message[0], received_data.message[1], received_data.message[2],
+                                  aed_has_tone ? aed_tone : NULL);
+                INF("AED : %d", received_data.message[0]);
+                break;
+
+            case NUS_MSG_GET_WALL_CLOCK:
+                bsp_wall_resync();
+                INF("Wall clock resync");
+                break;
+
+            case NUS_MSG_SET_RTC_ALARM:
+                if (!msg_len_ok(&received_data, 3))
+                {
+                    break;
+                }
+                int8_t alarm_hour = ((uint8_t)received_data.message[0] == 0xFF) ? -1 : received_data.message[0];
+                bsp_rtc_sched_alarm(alarm_hour, received_data.message[1], received_data.message[2]);
+                INF("RTC alarm : %d:%d", alarm_hour, received_data.message[1]);
+                break;
+
+            case NUS_MSG_SET_RTC_TIMER:
+                if (!msg_len_ok(&received_data, 3))
+                {
+                    break;
+                }
+                uint16_t every_sec = (uint8_t)received_data.message[0] << 8 | (uint8_t)received_data.message[1];
+                bsp_rtc_sched_every(every_sec, received_data.message[2]);
+                INF("RTC timer : %d s", every_sec);
+                break;
+
+            case NUS_MSG_SET_CONN_PROFILE:
+                if (!msg_len_ok(&received_data, 8))
+                {
+                    break;
+                }
+                CONN_PROFILE_ST prof;
+                prof.intMin = (uint8_t)received_data.message[0] << 8 | (uint8_t)received_data.message[1];
+                prof.intMax = (uint8_t)received_data.message[2] << 8 | (uint8_t)received_data.message[3];
+                prof.latency = (uint8_t)received_data.message[4] << 8 | (uint8_t)received_data.message[5];
+                prof.timeout = (uint8_t)received_data.message[6] << 8 | (uint8_t)received_data.message[7];
+                if (!ble_conn_profile_valid(&prof))
+                {
+                    ERR("Conn profile %d..%d, latency %d, timeout %d out of range", prof.intMin, prof.intMax,
+                        prof.latency, prof.timeout);
+                    break;
+                }
+                bsp_settings_set(BSP_SET_CONN_PROFILE, &prof, sizeof(prof));
+                ble_conn_profile_apply();
+                INF("Conn profile : %d..%d, latency %d, timeout %d", prof.intMin, prof.intMax, prof.latency, prof.timeout);
+                break;
+
+            case NUS_MSG_GET_LOG:
+                if (!msg_len_ok(&received_data, 16))
+                {
+                    break;
+                }
+                int64_t log_from = 0;
+                int64_t log_to = 0;
+                for (int i = 0; i < 8; i++)
+                {
+                    log_from = log_from << 8 | (uint8_t)received_data.message[i];
+                    log_to = log_to << 8 | (uint8_t)received_data.message[8 + i];
+                }
+                bsp_tslog_query(log_from, log_to);
+                break;
+
+            case NUS_MSG_SET_LOG_CFG:
+                if (!msg_len_ok(&received_data, 2))
+                {
+                    break;
+                }
+                uint16_t log_mask = (uint8_t)received_data.message[0] << 8 | (uint8_t)received_data.message[1];
+                bsp_tslog_set_mask(log_mask);
+                bsp_tslog_notify_stat();
+                break;
+
+            case NUS_MSG_GET_EVQ_STAT:
+                bsp_evq_notify_stat();
+                if (received_data.len > 4 && received_data.message[0])
+                {
+                    bsp_evq_reset_stat();
+                }
+                break;
+
+            case NUS_MSG_GET_PRD_STAT:
+                bsp_prd_notify_stat((received_data.len > 4) ? (uint8_t)received_data.message[0] : BSP_PRD_JOBS);
+                break;
+
+            case NUS_MSG_GET_RETAINED:
+                bsp_retained_notify();
+                break;
+
+            case NUS_MSG_GET_NVS_STAT:
+                bsp_nvs_notify_stat();
+                if (received_data.len > 4 && received_data.message[0] == 1)
+                {
+                    bsp_nvs_reset_stat();
+                }
+                break;
+
             default:
                 INF("0x%04x, %d", received_data.id, received_data.len);
                 break;
@@ -138,6 +449,7 @@ int bsp_nus_msg_send_to_rcv_task(struct nus_msg_packet *p, int len)
     if (err == 0)
     {
         INF("Sender: Message 0x%x put in queue\n", p->id);
+        bsp_evq_post(BSP_EVT_NUS_RX);
     }
     else
     {
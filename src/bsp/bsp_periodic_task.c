@@ -1,34 +1,265 @@
 /*
+    Periodic job scheduler
 
+    A fixed registry of jobs, each with its period (settings, 0 : off), a
+    phase from the scheduler start and a priority (0 first). Deadlines are
+    absolute ticks and move by exactly one period per run, so the run time
+    of a job never shifts the next one. One delayable work on the event
+    queue (bsp_event.c) is armed with an absolute timeout at the earliest
+    deadline; of the jobs due, the highest priority runs first, one per
+    pass so queued events get their turn in between.
+    Stats per job : jitter (start - deadline, event queue latency included)
+    and run time, mean and max, overruns (deadlines skipped because the job
+    or the ones before it were late). cli prd_get, NUS_MSG_GET_PRD_STAT.
+    Jobs must not block for long, they share the event queue.
 */
 #include "bsp.h"
 
-#ifdef BSP_PRD_TASK_ENABLED
+#define PRD_AVG_SHIFT 4 // stat means, 1/16 per run
 
 extern BSP_ST g_Bsp;
 
-static void prd_task(void);
+static void prd_work(struct k_work *work);
 
 LOG_MODULE_REGISTER(bsp_prd, LOG_LEVEL_INF);
 
-K_THREAD_DEFINE(thread_prd, 2048, prd_task, NULL, NULL, NULL, 7, 0, 0);
+static K_WORK_DELAYABLE_DEFINE(m_work, prd_work);
+
+typedef struct
+{
+    const char *name;
+    uint16_t phaseMs; // first deadline after the scheduler start
+    uint8_t prio;     // 0 : first when several are due
+    void (*fn)(void);
+} prd_job_t;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t job;
+    uint32_t periodMs;
+    PRD_JOB_STAT_ST stat;
+} prd_packet_t;
+
+static void prd_heartbeat(void);
+static void prd_batt(void);
+
+static const prd_job_t m_job[BSP_PRD_JOBS] = {
+    [BSP_PRD_JOB_HEARTBEAT] = {"heartbeat", 0, 3, prd_heartbeat},
+    [BSP_PRD_JOB_BATT] = {"batt", 250, 1, prd_batt},
+    [BSP_PRD_JOB_WALL] = {"wall", 500, 0, bsp_wall_resync},
+    [BSP_PRD_JOB_STATS] = {"stats", 750, 2, bsp_retained_snapshot},
+    [BSP_PRD_JOB_ADV] = {"adv", 100, 4, ble_adv_refresh},
+    [BSP_PRD_JOB_ALIVE] = {"alive", 5000, 5, ble_nus_alive},
+};
+
+static int64_t m_base;                // scheduler start, ticks
+static int64_t m_next[BSP_PRD_JOBS]; // absolute deadline, ticks
+static atomic_t m_rearm = ATOMIC_INIT(0);
+static bool m_started = false;
 static uint16_t prd_count = 0;
 
-static void prd_task(void)
+static void prd_heartbeat(void)
+{
+    INF("prd_task %d", prd_count++);
+}
+
+static void prd_batt(void)
+{
+    bsp_batt_sample();
+}
+
+/**
+ * @brief first deadline after now on the job's grid (start + phase + n x period)
+ *
+ */
+static void prd_arm(int j, int64_t now)
+{
+    int64_t period = (int64_t)k_ms_to_ticks_ceil64(g_Bsp.prdPeriodMs[j]);
+    int64_t first = m_base + (int64_t)k_ms_to_ticks_ceil64(m_job[j].phaseMs);
+
+    if (now < first || period == 0)
+    {
+        m_next[j] = first;
+        return;
+    }
+    m_next[j] = first + ((now - first) / period + 1) * period;
+}
+
+/**
+ * @brief run one due job, advance its deadline
+ *
+ * @param period    job period in ticks, non zero, read once by the caller
+ *                  (cli prd_set may clear the period meanwhile)
+ */
+static void prd_run(int j, int64_t now, int64_t period)
 {
-    static int led_offset = 0;
-    while (1)
+    PRD_JOB_STAT_ST *st = &g_Bsp.prdStat[j];
+    uint32_t jit_us = (uint32_t)k_ticks_to_us_floor64(now - m_next[j]);
+    uint32_t run_us;
+    int64_t end;
+
+    m_job[j].fn();
+
+    end = k_uptime_ticks();
+    run_us = (uint32_t)k_ticks_to_us_floor64(end - now);
+
+    st->runs++;
+    st->jitMaxUs = MAX(st->jitMaxUs, jit_us);
+    st->runMaxUs = MAX(st->runMaxUs, run_us);
+    st->jitAvgUs += ((int32_t)jit_us - (int32_t)st->jitAvgUs) >> PRD_AVG_SHIFT;
+    st->runAvgUs += ((int32_t)run_us - (int32_t)st->runAvgUs) >> PRD_AVG_SHIFT;
+
+    /* Next slot on the grid, the ones already gone are overruns */
+    m_next[j] += period;
+    if (m_next[j] <= end)
     {
-        INF("prd_task %d", prd_count++);
+        int64_t missed = (end - m_next[j]) / period + 1;
 
-        // bsp_led_toggle(led_offset++);
-        // bsp_sleep_ms(g_Bsp.prdTick);
-        k_sleep(K_MSEC(g_Bsp.prdTick));
+        st->overruns += (uint32_t)missed;
+        m_next[j] += missed * period;
+    }
+}
 
-        if (led_offset > 2)
+static void prd_work(struct k_work *work)
+{
+    uint32_t rearm = (uint32_t)atomic_clear(&m_rearm);
+    int64_t now = k_uptime_ticks();
+    int64_t wake = INT64_MAX;
+    int64_t period[BSP_PRD_JOBS];
+    int due = -1;
+
+    for (int j = 0; j < BSP_PRD_JOBS; j++)
+    {
+        if (rearm & BIT(j))
         {
-            led_offset = 0;
+            prd_arm(j, now);
+        }
+        period[j] = (int64_t)k_ms_to_ticks_ceil64(g_Bsp.prdPeriodMs[j]);
+        if (period[j] == 0)
+        {
+            continue;
+        }
+        if (m_next[j] > now)
+        {
+            wake = MIN(wake, m_next[j]);
+        }
+        else if (due < 0 || m_job[j].prio < m_job[due].prio)
+        {
+            due = j;
         }
     }
+
+    if (due >= 0)
+    {
+        prd_run(due, now, period[due]);
+        /* Back of the queue, the next due job runs after what is pending */
+        bsp_evq_reschedule(&m_work, K_NO_WAIT);
+    }
+    else if (wake != INT64_MAX)
+    {
+        bsp_evq_reschedule(&m_work, K_TIMEOUT_ABS_TICKS(wake));
+    }
 }
+
+/**
+ * @brief start the jobs, call once the settings are loaded
+ *
+ */
+void bsp_prd_start(void)
+{
+    g_Bsp.prdPeriodMs[BSP_PRD_JOB_HEARTBEAT] = g_Bsp.prdTick;
+
+    m_base = k_uptime_ticks();
+    for (int j = 0; j < BSP_PRD_JOBS; j++)
+    {
+        prd_arm(j, m_base);
+    }
+    m_started = true;
+
+#ifdef BSP_PRD_TASK_ENABLED
+    bsp_evq_reschedule(&m_work, K_NO_WAIT);
 #endif
+}
+
+/**
+ * @brief job period, persisted
+ *
+ * @param job       BSP_PRD_JOB_xxx
+ * @param period_ms 0 : off
+ * @return int      0 : OK, -1 : ERROR
+ */
+int bsp_prd_set_period(uint8_t job, uint32_t period_ms)
+{
+    if (job >= BSP_PRD_JOBS || (job == BSP_PRD_JOB_HEARTBEAT && period_ms > UINT16_MAX))
+    {
+        LOG_ERR("Job %d period %d ms rejected", job, period_ms);
+        return -1;
+    }
+
+    g_Bsp.prdPeriodMs[job] = period_ms;
+    if (job == BSP_PRD_JOB_HEARTBEAT)
+    {
+        /* prd_tick stays the heartbeat period for older centrals */
+        g_Bsp.prdTick = (uint16_t)period_ms;
+        bsp_settings_touch(BSP_SET_PRD_TICK);
+    }
+    bsp_settings_touch(BSP_SET_PRD_PERIODS);
+
+    atomic_or(&m_rearm, BIT(job));
+#ifdef BSP_PRD_TASK_ENABLED
+    if (m_started)
+    {
+        bsp_evq_reschedule(&m_work, K_NO_WAIT);
+    }
+#endif
+
+    LOG_INF("Job %s every %d ms", m_job[job].name, period_ms);
+
+    return 0;
+}
+
+/**
+ * @brief job name for the cli
+ *
+ */
+const char *bsp_prd_name(uint8_t job)
+{
+    return (job < BSP_PRD_JOBS) ? m_job[job].name : "?";
+}
+
+/**
+ * @brief clear the jitter / run time stats
+ *
+ */
+void bsp_prd_reset_stat(void)
+{
+    memset(g_Bsp.prdStat, 0, sizeof(g_Bsp.prdStat));
+}
+
+/**
+ * @brief NUS_MSG_NOTIFY_PRD_STAT, one message per job
+ *
+ * @param job   BSP_PRD_JOB_xxx, >= BSP_PRD_JOBS : all
+ */
+void bsp_prd_notify_stat(uint8_t job)
+{
+    prd_packet_t packet;
+
+    for (int j = 0; j < BSP_PRD_JOBS; j++)
+    {
+        if (job < BSP_PRD_JOBS && j != job)
+        {
+            continue;
+        }
+        packet.id = NUS_MSG_NOTIFY_PRD_STAT;
+        packet.len = sizeof(packet);
+        packet.job = j;
+        packet.periodMs = g_Bsp.prdPeriodMs[j];
+        packet.stat = g_Bsp.prdStat[j];
+
+        ble_nus_send_data((char *)&packet, sizeof(packet));
+    }
+}
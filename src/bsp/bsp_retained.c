@@ -0,0 +1,242 @@
+/*
+    Retained RAM, boot count and run statistics that survive a warm reset
+
+    m_ret is in .noinit, startup code leaves it alone, so after a fatal
+    error, watchdog, pin or soft reset it still holds what the previous run
+    left. Magic + crc32 tell it from power up garbage (or a bootloader that
+    used the RAM).
+    Boot     : valid RAM is used as is, else the NVS copy (BSP_SET_RETAINED),
+               else a fresh block from the stored boot count. The counters
+               of the run that just ended move to prev. A warm reset counts
+               in RAM only, no flash write. A cold boot (RAM lost, count
+               taken from NVS) writes the boot_count key once, so power
+               cycles never hand out the same boot number twice.
+    Snapshot : BSP_PRD_JOB_STATS (BSP_RET_SNAPSHOT_S) copies the run counters (uptime, queue
+               drops, BLE TX) in and redoes the crc. The fatal
+               handler adds the fault and resets, RAM is kept.
+    NVS      : the whole block goes to NVS through the settings thread
+               every BSP_RET_NVS_FLUSH_S and at a clean shutdown (cli reboot).
+    cli ret, NUS_MSG_GET_RETAINED.
+*/
+#include <zephyr/drivers/hwinfo.h>
+#include <zephyr/fatal.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/reboot.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(retained, LOG_LEVEL_INF);
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    RETAINED_ST ret;
+} retained_packet_t;
+
+static __noinit RETAINED_ST m_ret;
+
+static uint32_t m_nvs_due_s;
+
+static uint32_t ret_crc(const RETAINED_ST *r)
+{
+    return crc32_ieee((const uint8_t *)r, offsetof(RETAINED_ST, crc));
+}
+
+static bool ret_valid(const RETAINED_ST *r)
+{
+    return r->magic == BSP_RET_MAGIC && r->crc == ret_crc(r);
+}
+
+static void ret_seal(void)
+{
+    m_ret.crc = ret_crc(&m_ret);
+}
+
+/**
+ * @brief current run counters into m_ret, thread context (reads other modules' stats)
+ *
+ */
+static void ret_snapshot(void)
+{
+    RET_RUN_ST *run = &m_ret.run;
+    IMU_RING_STAT_ST ring;
+    AUDIO_STAT_ST audio;
+    uint32_t full = 0;
+
+    bsp_imu_ring_get_stat(&ring);
+    bsp_audio_get_stat(&audio);
+    for (int i = 0; i < BSP_I2C_DEVS; i++)
+    {
+        full += g_Bsp.i2c[i].full;
+    }
+
+    run->uptimeS = (uint32_t)(k_uptime_get() / 1000);
+    run->bleTx = g_Bsp.ble.tx;
+    run->bleTxErr = g_Bsp.ble.txErr;
+    run->bleTxBytes = g_Bsp.ble.txBytes;
+    run->audioDropped = audio.dropped;
+    run->imuOverflow = ring.overflow;
+    run->tslogDropped = g_Bsp.tslog.dropped;
+    run->i2cFull = (uint16_t)MIN(full, UINT16_MAX);
+    run->nvsGcs = (uint16_t)MIN(g_Bsp.nvsStat.gcs, UINT16_MAX);
+
+    ret_seal();
+}
+
+/**
+ * @brief hand the block to the settings thread, written on its next flush
+ *
+ */
+static void ret_to_nvs(void)
+{
+    g_Bsp.retNvs = m_ret;
+    g_Bsp.nvs.boot_count = m_ret.bootCount;
+    bsp_settings_touch(BSP_SET_RETAINED);
+    bsp_settings_touch(BSP_SET_BOOT_COUNT);
+}
+
+/**
+ * @brief periodic snapshot, BSP_PRD_JOB_STATS
+ *
+ */
+void bsp_retained_snapshot(void)
+{
+    ret_snapshot();
+
+    if (m_ret.run.uptimeS >= m_nvs_due_s)
+    {
+        m_nvs_due_s = m_ret.run.uptimeS + BSP_RET_NVS_FLUSH_S;
+        ret_to_nvs();
+    }
+}
+
+/**
+ * @brief pick up the retained block, count the boot, call after bsp_settings_load()
+ *
+ * @return int 0 : OK
+ */
+int bsp_retained_init(void)
+{
+    uint32_t cause = 0;
+    const char *src = "RAM";
+    bool cold = false;
+
+    if (hwinfo_get_reset_cause(&cause) == 0)
+    {
+        hwinfo_clear_reset_cause();
+    }
+
+    if (!ret_valid(&m_ret))
+    {
+        cold = true;
+        if (ret_valid(&g_Bsp.retNvs))
+        {
+            m_ret = g_Bsp.retNvs;
+            src = "NVS";
+        }
+        else
+        {
+            memset(&m_ret, 0, sizeof(m_ret));
+            m_ret.magic = BSP_RET_MAGIC;
+            m_ret.bootCount = g_Bsp.nvs.boot_count;
+            src = "new";
+        }
+    }
+
+    /* The NVS block may be an hour older than the boot_count key */
+    m_ret.bootCount = MAX(m_ret.bootCount, g_Bsp.nvs.boot_count) + 1;
+    m_ret.resetCause = cause;
+    m_ret.prev = m_ret.run;
+    m_ret.totalUptimeS += m_ret.prev.uptimeS;
+    memset(&m_ret.run, 0, sizeof(m_ret.run));
+    ret_seal();
+
+    g_Bsp.nvs.boot_count = m_ret.bootCount;
+    if (cold)
+    {
+        bsp_settings_touch(BSP_SET_BOOT_COUNT);
+    }
+    m_nvs_due_s = BSP_RET_NVS_FLUSH_S;
+
+    LOG_INF("Boot %d (%s), reset cause 0x%x, last run %d s, faults %d", m_ret.bootCount, src, cause,
+            m_ret.prev.uptimeS, m_ret.faults);
+    if (m_ret.faults && m_ret.fault.bootCount == m_ret.bootCount - 1)
+    {
+        LOG_WRN("Previous run died : reason %d, pc 0x%08x, lr 0x%08x, thread %s", m_ret.fault.reason,
+                m_ret.fault.pc, m_ret.fault.lr, m_ret.fault.thread);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief latest snapshot
+ *
+ */
+void bsp_retained_get(RETAINED_ST *ret)
+{
+    ret_snapshot();
+    *ret = m_ret;
+}
+
+/**
+ * @brief clean shutdown, the block and the settings reach flash before the reset
+ *
+ */
+void bsp_retained_shutdown(void)
+{
+    ret_snapshot();
+    ret_to_nvs();
+    bsp_settings_flush();
+
+    LOG_INF("Clean shutdown, boot %d, up %d s", m_ret.bootCount, m_ret.run.uptimeS);
+    LOG_PANIC();
+    sys_reboot(SYS_REBOOT_WARM);
+}
+
+/**
+ * @brief NUS_MSG_NOTIFY_RETAINED
+ *
+ */
+void bsp_retained_notify(void)
+{
+    retained_packet_t packet;
+
+    packet.id = NUS_MSG_NOTIFY_RETAINED;
+    packet.len = sizeof(packet);
+    bsp_retained_get(&packet.ret);
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+/**
+ * @brief fatal error, keep the evidence in RAM and reset
+ *
+ *  Any context, possibly with a lock held, so no other module is touched :
+ *  the run counters stay as of the last snapshot.
+ */
+void k_sys_fatal_error_handler(unsigned int reason, const struct arch_esf *esf)
+{
+    const char *name = k_thread_name_get(k_current_get());
+
+    if (ret_valid(&m_ret))
+    {
+        m_ret.faults++;
+        m_ret.fault.reason = reason;
+        m_ret.fault.pc = esf ? esf->basic.pc : 0;
+        m_ret.fault.lr = esf ? esf->basic.lr : 0;
+        m_ret.fault.uptimeS = (uint32_t)(k_uptime_get() / 1000);
+        m_ret.fault.bootCount = m_ret.bootCount;
+        strncpy(m_ret.fault.thread, name ? name : "?", sizeof(m_ret.fault.thread) - 1);
+        m_ret.fault.thread[sizeof(m_ret.fault.thread) - 1] = 0;
+        m_ret.run.uptimeS = m_ret.fault.uptimeS;
+        ret_seal();
+    }
+
+    LOG_PANIC();
+    sys_reboot(SYS_REBOOT_WARM);
+}
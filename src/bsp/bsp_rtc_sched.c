@@ -0,0 +1,218 @@
+/*
+    RTC scheduled jobs, PCF8563 alarm / countdown timer on the INT pin
+
+    alarm : daily at HH:MM (RTC time, UTC as set by the wall clock)
+    every : N s (1 Hz source, up to 255 s) or N min (1/60 Hz source, up to
+            255 min), the PCF8563 reloads the count by itself
+    Both count on the RTC, the MCU has no kernel timeout pending for them
+    and stays in idle until INT (open drain, active low) fires. INT is a
+    level interrupt : the GPIO callback masks it and submits a work item,
+    the flags are read and cleared over I2C there, then the job actions run
+    (BSP_RSCHED_ACT_xxx) and INT is unmasked. A failed I2C access retries
+    later instead of waiting for an edge that a still low INT never gives.
+    INT is not routed on the expansion board, wire it to the rtc-int pin.
+    NUS_MSG_SET_RTC_ALARM / NUS_MSG_SET_RTC_TIMER or cli rsched.
+*/
+#include <zephyr/drivers/gpio.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(rtc_sched, LOG_LEVEL_INF);
+
+#define RTC_INT_NODE DT_ALIAS(rtc_int)
+#define RSCHED_RETRY_MS 1000 // flags read / clear failed
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t src;     // BSP_RTC_IRQ_xxx
+    uint32_t fires;  // alarms + timers
+    int64_t wallMs;  // 0 : wall clock not synced
+    IMU_SAMPLE_ST imu; // latest sample at the job
+} rsched_packet_t;
+
+#if DT_NODE_EXISTS(RTC_INT_NODE)
+static const struct gpio_dt_spec rtc_int = GPIO_DT_SPEC_GET(RTC_INT_NODE, gpios);
+static struct gpio_callback rtc_int_cb;
+#endif
+
+static void rsched_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(m_work, rsched_work_handler);
+
+static void rsched_run(uint8_t src, uint8_t act)
+{
+    rsched_packet_t packet;
+    uint8_t rec[1 + sizeof(IMU_SAMPLE_ST)];
+
+    g_Bsp.rsched.lastSrc = src;
+    g_Bsp.rsched.lastMs = bsp_wall_now_ms();
+
+    /* SRC(1) | IMU_SAMPLE */
+    rec[0] = src;
+    bsp_imu_get_latest((IMU_SAMPLE_ST *)&rec[1]);
+    bsp_tslog_append(BSP_TSLOG_T_SCHED, rec, sizeof(rec));
+
+    if (act & BSP_RSCHED_ACT_NOTIFY)
+    {
+        packet.id = NUS_MSG_NOTIFY_RTC_SCHED;
+        packet.len = sizeof(packet);
+        packet.src = src;
+        packet.fires = g_Bsp.rsched.alarms + g_Bsp.rsched.timers;
+        packet.wallMs = g_Bsp.rsched.lastMs;
+        bsp_imu_get_latest(&packet.imu);
+
+        ble_nus_send_data((char *)&packet, sizeof(packet));
+    }
+    if (act & BSP_RSCHED_ACT_CLIP)
+    {
+        bsp_audio_clip_trigger(BSP_CLIP_TRIG_SCHED);
+    }
+}
+
+static void rsched_work_handler(struct k_work *work)
+{
+    uint8_t flags = 0;
+
+    if (bsp_rtc_get_irq(&flags) != 0)
+    {
+        /* INT stays masked and low, try again */
+        LOG_ERR("RTC flags read failed");
+        bsp_evq_reschedule(&m_work, K_MSEC(RSCHED_RETRY_MS));
+        return;
+    }
+
+    if (flags & BSP_RTC_IRQ_ALARM)
+    {
+        g_Bsp.rsched.alarms++;
+        LOG_INF("RTC alarm %02d:%02d", g_Bsp.rsched.alarmHour, g_Bsp.rsched.alarmMin);
+        rsched_run(BSP_RTC_IRQ_ALARM, g_Bsp.rsched.alarmAct);
+    }
+    if (flags & BSP_RTC_IRQ_TIMER)
+    {
+        g_Bsp.rsched.timers++;
+        rsched_run(BSP_RTC_IRQ_TIMER, g_Bsp.rsched.timerAct);
+    }
+
+#if DT_NODE_EXISTS(RTC_INT_NODE)
+    /* Still low (a flag set since the read) fires again right away */
+    gpio_pin_interrupt_configure_dt(&rtc_int, GPIO_INT_LEVEL_ACTIVE);
+#endif
+}
+
+#if DT_NODE_EXISTS(RTC_INT_NODE)
+static void rtc_int_isr(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+    gpio_pin_interrupt_configure_dt(&rtc_int, GPIO_INT_DISABLE);
+    bsp_evq_reschedule(&m_work, K_NO_WAIT);
+}
+#endif
+
+/**
+ * @brief INT pin, CLKOUT off, no schedule left over from before a reset
+ *
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_rtc_sched_init(void)
+{
+    uint8_t flags;
+
+    g_Bsp.rsched.alarmHour = -1;
+
+    /* 32 kHz on CLKOUT is the power up default and nobody listens */
+    if (bsp_rtc_set_clkout(0, 0) != 0 || bsp_rtc_set_alarm(-1, 0) != 0 || bsp_rtc_set_timer(0, 0) != 0)
+    {
+        LOG_ERR("PCF8563 not responding");
+        return -1;
+    }
+    bsp_rtc_get_irq(&flags);
+
+#if DT_NODE_EXISTS(RTC_INT_NODE)
+    if (!gpio_is_ready_dt(&rtc_int) || gpio_pin_configure_dt(&rtc_int, GPIO_INPUT) != 0 ||
+        gpio_pin_interrupt_configure_dt(&rtc_int, GPIO_INT_LEVEL_ACTIVE) != 0)
+    {
+        LOG_ERR("RTC INT pin setup failed");
+        return -1;
+    }
+    gpio_init_callback(&rtc_int_cb, rtc_int_isr, BIT(rtc_int.pin));
+    gpio_add_callback(rtc_int.port, &rtc_int_cb);
+    g_Bsp.rsched.hasInt = 1;
+#else
+    LOG_WRN("No rtc-int alias, RTC schedule disabled");
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief daily alarm job
+ *
+ * @param hour      0..23, < 0 : off
+ * @param min       0..59
+ * @param act       BSP_RSCHED_ACT_xxx
+ * @return int      0 : OK, -1 : ERROR
+ */
+int bsp_rtc_sched_alarm(int8_t hour, int8_t min, uint8_t act)
+{
+    if (hour >= 0 && (!g_Bsp.rsched.hasInt || hour > 23 || min < 0 || min > 59))
+    {
+        LOG_ERR("RTC alarm %d:%d rejected", hour, min);
+        return -1;
+    }
+    if (bsp_rtc_set_alarm(hour, min) != 0)
+    {
+        return -1;
+    }
+
+    g_Bsp.rsched.alarmHour = (hour < 0) ? -1 : hour;
+    g_Bsp.rsched.alarmMin = min;
+    g_Bsp.rsched.alarmAct = act;
+
+    LOG_INF("RTC alarm %s %02d:%02d, act 0x%02x", (hour < 0) ? "off" : "at", hour, min, act);
+
+    return 0;
+}
+
+/**
+ * @brief repeating job on the RTC countdown timer
+ *
+ * @param sec       period, 1..255 s or a multiple of 60 up to 255 min, 0 : off
+ * @param act       BSP_RSCHED_ACT_xxx
+ * @return int      0 : OK, -1 : ERROR
+ */
+int bsp_rtc_sched_every(uint16_t sec, uint8_t act)
+{
+    uint8_t freq = BSP_RTC_TIMER_1HZ;
+    uint8_t count = (uint8_t)sec;
+
+    if (sec > 255)
+    {
+        if (sec % 60 || sec / 60 > 255)
+        {
+            LOG_ERR("RTC timer %d s, not n x 60 s <= 255 min", sec);
+            return -1;
+        }
+        freq = BSP_RTC_TIMER_1_60HZ;
+        count = (uint8_t)(sec / 60);
+    }
+    if (sec && !g_Bsp.rsched.hasInt)
+    {
+        LOG_ERR("RTC timer without INT pin");
+        return -1;
+    }
+    if (bsp_rtc_set_timer(freq, count) != 0)
+    {
+        return -1;
+    }
+
+    g_Bsp.rsched.everySec = sec;
+    g_Bsp.rsched.timerAct = act;
+
+    LOG_INF("RTC timer every %d s, act 0x%02x", sec, act);
+
+    return 0;
+}
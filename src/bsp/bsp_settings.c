@@ -0,0 +1,295 @@
+/*
+    Typed key-value settings over NVS, one NVS entry per parameter
+
+    The live values stay where the code uses them (g_Bsp fields), the table
+    below only points at them. m_stored holds what flash has, a key is dirty
+    when its live value differs from it.
+    set / touch : RAM only, marks the key dirty and kicks the flush thread,
+                  the caller never waits for flash.
+    flush       : BSP_SETTINGS_FLUSH_MS after the first change (later changes
+                  in that window coalesce), only the dirty keys are written.
+                  Held back while the radio is busy with bulk or audio
+                  streaming, at most BSP_SETTINGS_DEFER_MAX_MS.
+    The old single CONFIG_ID record (NVS_INFO_ST) is imported once and
+    deleted. IMU calibration keeps its NVS id, existing calibrations load.
+*/
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(settings, LOG_LEVEL_INF);
+
+#define SETTINGS_NVS_BASE 0x10
+#define SETTINGS_LEGACY_ID 1  // NVS_INFO_ST record before per key settings
+#define SETTINGS_IMU_CAL_ID 2 // kept from bsp_nvs_write_imu_cal
+#define SETTINGS_DEFER_POLL_MS 500
+
+/* Blob keys are copied into m_stored / val[BSP_SET_MAX_LEN] as they are */
+BUILD_ASSERT(sizeof(IMU_CAL_ST) <= BSP_SET_MAX_LEN, "imu_cal must fit one settings key");
+BUILD_ASSERT(sizeof(CONN_PROFILE_ST) <= BSP_SET_MAX_LEN, "conn_profile must fit one settings key");
+BUILD_ASSERT(sizeof(RETAINED_ST) <= BSP_SET_MAX_LEN, "retained must fit one settings key");
+BUILD_ASSERT(sizeof(((BSP_ST *)0)->prdPeriodMs) <= BSP_SET_MAX_LEN, "prd_periods must fit one settings key");
+
+static void settings_task(void);
+
+K_THREAD_DEFINE(thread_settings, 1024, settings_task, NULL, NULL, NULL, 12, 0, 0);
+
+static K_SEM_DEFINE(m_kick, 0, 1);
+static K_MUTEX_DEFINE(m_flush_mutex);
+
+extern BSP_ST g_Bsp;
+
+typedef struct
+{
+    uint16_t id;
+    uint8_t type; // BSP_SET_TYPE_xxx
+    uint8_t len;
+    void *live;
+    const char *name;
+} settings_key_t;
+
+static const settings_key_t m_key[BSP_SET_KEYS] = {
+    [BSP_SET_BOOT_COUNT] = {SETTINGS_NVS_BASE + 0, BSP_SET_TYPE_U32, 4, &g_Bsp.nvs.boot_count, "boot_count"},
+    [BSP_SET_PRD_TICK] = {SETTINGS_NVS_BASE + 1, BSP_SET_TYPE_U16, 2, &g_Bsp.prdTick, "prd_tick"},
+    [BSP_SET_LED_PWM] = {SETTINGS_NVS_BASE + 2, BSP_SET_TYPE_U32, 4, &g_Bsp.led_status.pwm_led_width, "led_pwm"},
+    [BSP_SET_IMU_OUT] = {SETTINGS_NVS_BASE + 3, BSP_SET_TYPE_U8, 1, &g_Bsp.imu.outMask, "imu_out"},
+    [BSP_SET_IMU_FUSION_RATE] = {SETTINGS_NVS_BASE + 4, BSP_SET_TYPE_U8, 1, &g_Bsp.imu.fusionRateHz, "fusion_rate"},
+    [BSP_SET_IMU_MODE] = {SETTINGS_NVS_BASE + 5, BSP_SET_TYPE_U8, 1, &g_Bsp.imuPwr.mode, "imu_mode"},
+    [BSP_SET_IMU_ODR] = {SETTINGS_NVS_BASE + 6, BSP_SET_TYPE_U16, 2, &g_Bsp.imuPwr.odrHz, "imu_odr"},
+    [BSP_SET_IMU_IDLE] = {SETTINGS_NVS_BASE + 7, BSP_SET_TYPE_U16, 2, &g_Bsp.imuPwr.idleMs, "imu_idle"},
+    [BSP_SET_IMU_CAL] = {SETTINGS_IMU_CAL_ID, BSP_SET_TYPE_BLOB, sizeof(IMU_CAL_ST), &g_Bsp.imuCal, "imu_cal"},
+    [BSP_SET_CONN_PROFILE] = {SETTINGS_NVS_BASE + 8, BSP_SET_TYPE_BLOB, sizeof(CONN_PROFILE_ST), &g_Bsp.connProfile,
+                              "conn_profile"},
+    [BSP_SET_NVS_ERASES] = {SETTINGS_NVS_BASE + 9, BSP_SET_TYPE_U32, 4, &g_Bsp.nvsStat.erases, "nvs_erases"},
+    [BSP_SET_RETAINED] = {SETTINGS_NVS_BASE + 10, BSP_SET_TYPE_BLOB, sizeof(RETAINED_ST), &g_Bsp.retNvs, "retained"},
+    [BSP_SET_PRD_PERIODS] = {SETTINGS_NVS_BASE + 11, BSP_SET_TYPE_BLOB, sizeof(g_Bsp.prdPeriodMs), &g_Bsp.prdPeriodMs,
+                             "prd_periods"},
+};
+
+static uint8_t m_stored[BSP_SET_KEYS][BSP_SET_MAX_LEN];
+static atomic_t m_dirty = ATOMIC_INIT(0);
+static bool m_legacy = false;
+
+static bool settings_radio_busy(void)
+{
+    return bsp_bulk_busy() || g_Bsp.audio.running;
+}
+
+/**
+ * @brief write the dirty keys, caller holds m_flush_mutex
+ *
+ * @return int  keys written, -1 : ERROR
+ */
+static int settings_write_dirty(void)
+{
+    uint32_t dirty = (uint32_t)atomic_clear(&m_dirty);
+    uint8_t val[BSP_SET_MAX_LEN];
+    int n = 0;
+
+    for (int k = 0; k < BSP_SET_KEYS && dirty; k++)
+    {
+        if (!(dirty & BIT(k)))
+        {
+            continue;
+        }
+        dirty &= ~BIT(k);
+
+        /* Snapshot first, the live value may change again while flash is busy */
+        memcpy(val, m_key[k].live, m_key[k].len);
+        if (bsp_nvs_write_id(m_key[k].id, val, m_key[k].len) != 0)
+        {
+            atomic_or(&m_dirty, BIT(k) | dirty);
+            g_Bsp.settings.errors++;
+            return -1;
+        }
+        memcpy(m_stored[k], val, m_key[k].len);
+        n++;
+    }
+
+    if (m_legacy && atomic_get(&m_dirty) == 0)
+    {
+        bsp_nvs_delete_id(SETTINGS_LEGACY_ID);
+        m_legacy = false;
+    }
+
+    if (n)
+    {
+        g_Bsp.settings.flushes++;
+        g_Bsp.settings.writes += n;
+    }
+
+    return n;
+}
+
+static void settings_task(void)
+{
+    while (1)
+    {
+        uint32_t waited = 0;
+
+        k_sem_take(&m_kick, K_FOREVER);
+
+        /* Coalesce the changes of the next moment into one flush */
+        k_sleep(K_MSEC(BSP_SETTINGS_FLUSH_MS));
+
+        while (settings_radio_busy() && waited < BSP_SETTINGS_DEFER_MAX_MS)
+        {
+            k_sleep(K_MSEC(SETTINGS_DEFER_POLL_MS));
+            waited += SETTINGS_DEFER_POLL_MS;
+        }
+        g_Bsp.settings.deferredMs += waited;
+
+        k_mutex_lock(&m_flush_mutex, K_FOREVER);
+        settings_write_dirty();
+        k_mutex_unlock(&m_flush_mutex);
+    }
+}
+
+/**
+ * @brief the live value of key changed, persist it later if it differs
+ *
+ * @param key   BSP_SET_xxx
+ */
+void bsp_settings_touch(uint8_t key)
+{
+    if (key >= BSP_SET_KEYS)
+    {
+        return;
+    }
+    if (memcmp(m_key[key].live, m_stored[key], m_key[key].len) == 0)
+    {
+        return;
+    }
+
+    atomic_or(&m_dirty, BIT(key));
+    k_sem_give(&m_kick);
+}
+
+/**
+ * @brief typed set, the length must match the key type
+ *
+ * @param key   BSP_SET_xxx
+ * @param v     new value
+ * @param len   value length
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_settings_set(uint8_t key, const void *v, uint8_t len)
+{
+    if (key >= BSP_SET_KEYS || len != m_key[key].len)
+    {
+        LOG_ERR("Setting %d, bad length %d", key, len);
+        return -1;
+    }
+
+    memcpy(m_key[key].live, v, len);
+    bsp_settings_touch(key);
+
+    return 0;
+}
+
+/**
+ * @brief typed get from the RAM cache
+ *
+ * @param key   BSP_SET_xxx
+ * @param v     out
+ * @param len   size of v, must match the key type
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_settings_get(uint8_t key, void *v, uint8_t len)
+{
+    if (key >= BSP_SET_KEYS || len != m_key[key].len)
+    {
+        return -1;
+    }
+    memcpy(v, m_key[key].live, len);
+
+    return 0;
+}
+
+/**
+ * @brief load every stored key over the driver defaults and apply them,
+ *        call after bsp_nvs_init() and the drivers init
+ *
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_settings_load(void)
+{
+    NVS_INFO_ST legacy;
+    int found = 0;
+
+    for (int k = 0; k < BSP_SET_KEYS; k++)
+    {
+        /* Not stored : the driver default is what flash "has" */
+        if (bsp_nvs_read_id(m_key[k].id, m_stored[k], m_key[k].len) == m_key[k].len)
+        {
+            memcpy(m_key[k].live, m_stored[k], m_key[k].len);
+            found++;
+        }
+        else
+        {
+            memcpy(m_stored[k], m_key[k].live, m_key[k].len);
+        }
+    }
+
+    /* One time import of the whole-struct record */
+    if (bsp_nvs_read_id(SETTINGS_LEGACY_ID, &legacy, sizeof(legacy)) == sizeof(legacy))
+    {
+        LOG_INF("Importing legacy NVS record");
+        g_Bsp.prdTick = legacy.prdTick;
+        g_Bsp.nvs.boot_count = legacy.boot_count;
+        bsp_settings_touch(BSP_SET_PRD_TICK);
+        bsp_settings_touch(BSP_SET_BOOT_COUNT);
+        m_legacy = true;
+    }
+
+    /* The boot count moves on in retained RAM (bsp_retained_init), no flash write per boot */
+    g_Bsp.nvs.unique_id = BSP_DEFAULT_UNIQUE_ID;
+    g_Bsp.nvs.prdTick = g_Bsp.prdTick;
+
+    /* Values with side effects go through their setters */
+    bsp_imu_set_mode(g_Bsp.imuPwr.mode, g_Bsp.imuPwr.odrHz, g_Bsp.imuPwr.idleMs);
+    bsp_imu_set_output(g_Bsp.imu.outMask, g_Bsp.imu.fusionRateHz);
+    if (g_Bsp.led_status.pwm_led_width)
+    {
+        bsp_pwm_led_ctrl(g_Bsp.led_status.pwm_led_width);
+    }
+
+    g_Bsp.settings.keys = BSP_SET_KEYS;
+    g_Bsp.settings.stored = found;
+
+    LOG_INF("Settings : %d/%d keys stored", found, BSP_SET_KEYS);
+
+    return 0;
+}
+
+/**
+ * @brief write the dirty keys now, cli nvs_set
+ *
+ * @return int  keys written, -1 : ERROR
+ */
+int bsp_settings_flush(void)
+{
+    int n;
+
+    k_mutex_lock(&m_flush_mutex, K_FOREVER);
+    n = settings_write_dirty();
+    k_mutex_unlock(&m_flush_mutex);
+
+    return n;
+}
+
+/**
+ * @brief dirty key mask, bit per BSP_SET_xxx
+ *
+ */
+uint32_t bsp_settings_dirty(void)
+{
+    return (uint32_t)atomic_get(&m_dirty);
+}
+
+/**
+ * @brief key name for the cli
+ *
+ */
+const char *bsp_settings_name(uint8_t key)
+{
+    return (key < BSP_SET_KEYS) ? m_key[key].name : "?";
+}
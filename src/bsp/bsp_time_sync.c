@@ -0,0 +1,220 @@
+/*
+    NTP style time sync against the central clock over NUS
+
+    central                       device
+    T1 --- NUS_MSG_TIME_SYNC_REQ ---> T2 (rx_us in bt_receive_cb)
+    T4 <-- NUS_MSG_NOTIFY_TIME_SYNC - T3
+    T1,T4 NUS_MSG_TIME_SYNC_RESULT -> offset/delay computed here
+
+    offset = ((T1 - T2) + (T4 - T3)) / 2   (central - device)
+    delay  = (T4 - T1) - (T3 - T2)
+
+    The last BSP_TSYNC_WINDOW exchanges are kept. The min-delay one gives
+    the offset (least queuing), a least squares fit over the window gives
+    the drift. Result goes out as NUS_MSG_NOTIFY_TIME_SYNC_STAT.
+    The window belongs to one central, it is dropped at disconnect.
+*/
+#include <math.h>
+
+#include "bsp.h"
+
+#define BSP_TSYNC_WINDOW 8
+
+LOG_MODULE_REGISTER(time_sync, LOG_LEVEL_INF);
+
+extern BSP_ST g_Bsp;
+
+typedef struct
+{
+    int64_t devTime; // device time of the exchange (T2)
+    int64_t offset;  // central - device
+    int64_t delay;   // round trip without device processing
+} tsync_sample_t;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    int64_t t1;
+    int64_t t2;
+    int64_t t3;
+} tsync_packet_t;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    int64_t offset;
+    int32_t driftPpb;
+    uint32_t errUs;
+    uint8_t samples;
+} tsync_stat_packet_t;
+
+static tsync_sample_t m_win[BSP_TSYNC_WINDOW];
+static uint8_t m_win_cnt = 0;
+static uint8_t m_win_idx = 0;
+static struct k_spinlock m_lock;
+
+/* Last request, matched by T1 when the result comes back */
+static int64_t m_t1 = 0, m_t2 = 0, m_t3 = 0;
+
+static int64_t get_be64(const char *p)
+{
+    int64_t v = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        v = (v << 8) | (uint8_t)p[i];
+    }
+    return v;
+}
+
+/**
+ * @brief recompute offset/drift/error from the sample window
+ *
+ */
+static void tsync_estimate(void)
+{
+    const tsync_sample_t *best = &m_win[0];
+    double mx = 0, my = 0, sxx = 0, sxy = 0, res = 0;
+    double slope = 0;
+    int n = m_win_cnt;
+
+    for (int i = 1; i < n; i++)
+    {
+        if (m_win[i].delay < best->delay)
+        {
+            best = &m_win[i];
+        }
+    }
+
+    /* Drift: least squares of offset vs device time, relative to best sample */
+    if (n >= 3)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            mx += (double)(m_win[i].devTime - best->devTime);
+            my += (double)(m_win[i].offset - best->offset);
+        }
+        mx /= n;
+        my /= n;
+
+        for (int i = 0; i < n; i++)
+        {
+            double dx = (double)(m_win[i].devTime - best->devTime) - mx;
+            double dy = (double)(m_win[i].offset - best->offset) - my;
+            sxx += dx * dx;
+            sxy += dx * dy;
+        }
+        if (sxx > 0)
+        {
+            slope = sxy / sxx; // us per us
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            double dx = (double)(m_win[i].devTime - best->devTime);
+            double e = (double)(m_win[i].offset - best->offset) - slope * dx;
+            res += e * e;
+        }
+        res = (res > 0) ? sqrt(res / n) : 0;
+    }
+
+    g_Bsp.tsync.offset = best->offset;
+    g_Bsp.tsync.refTime = best->devTime;
+    g_Bsp.tsync.driftPpb = (int32_t)(slope * 1e9);
+    /* A negative delay means the timestamps are off, not a better sample */
+    g_Bsp.tsync.errUs = (uint32_t)CLAMP(MAX(best->delay, 0) / 2 + (int64_t)res, 0, UINT32_MAX);
+    g_Bsp.tsync.samples = n;
+    g_Bsp.tsync.isSync = 1;
+}
+
+/**
+ * @brief NUS_MSG_TIME_SYNC_REQ, reply with T1/T2/T3
+ *
+ * @param p received packet, rx_us is T2
+ */
+void bsp_time_sync_request(const struct nus_msg_packet *p)
+{
+    tsync_packet_t packet;
+
+    m_t1 = get_be64(&p->message[0]);
+    m_t2 = p->rx_us;
+
+    packet.id = NUS_MSG_NOTIFY_TIME_SYNC;
+    packet.len = sizeof(packet);
+    packet.t1 = m_t1;
+    packet.t2 = m_t2;
+
+    /* T3 as late as possible */
+    m_t3 = bsp_time_us();
+    packet.t3 = m_t3;
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+/**
+ * @brief NUS_MSG_TIME_SYNC_RESULT, central sends back T1/T4 of our reply
+ *
+ * @param p received packet
+ */
+void bsp_time_sync_result(const struct nus_msg_packet *p)
+{
+    tsync_stat_packet_t packet;
+    int64_t t1 = get_be64(&p->message[0]);
+    int64_t t4 = get_be64(&p->message[8]);
+    tsync_sample_t *s;
+    k_spinlock_key_t key;
+
+    if (t1 != m_t1 || m_t2 == 0)
+    {
+        LOG_WRN("Time sync result does not match request");
+        return;
+    }
+
+    key = k_spin_lock(&m_lock);
+
+    s = &m_win[m_win_idx];
+    s->devTime = m_t2;
+    s->delay = (t4 - t1) - (m_t3 - m_t2);
+    s->offset = ((t1 - m_t2) + (t4 - m_t3)) / 2;
+
+    m_win_idx = (m_win_idx + 1) % BSP_TSYNC_WINDOW;
+    if (m_win_cnt < BSP_TSYNC_WINDOW)
+    {
+        m_win_cnt++;
+    }
+    m_t2 = 0;
+
+    tsync_estimate();
+    k_spin_unlock(&m_lock, key);
+
+    LOG_INF("Time sync offset %lld us, drift %d ppb, err %u us (%d)",
+            g_Bsp.tsync.offset, g_Bsp.tsync.driftPpb, g_Bsp.tsync.errUs, g_Bsp.tsync.samples);
+
+    packet.id = NUS_MSG_NOTIFY_TIME_SYNC_STAT;
+    packet.len = sizeof(packet);
+    packet.offset = g_Bsp.tsync.offset;
+    packet.driftPpb = g_Bsp.tsync.driftPpb;
+    packet.errUs = g_Bsp.tsync.errUs;
+    packet.samples = g_Bsp.tsync.samples;
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+/**
+ * @brief forget the samples of the central that went away (disconnect)
+ *
+ */
+void bsp_time_sync_reset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+    m_win_cnt = 0;
+    m_win_idx = 0;
+    m_t1 = m_t2 = m_t3 = 0;
+    memset(&g_Bsp.tsync, 0, sizeof(g_Bsp.tsync));
+
+    k_spin_unlock(&m_lock, key);
+}
@@ -0,0 +1,693 @@
+/*
+    Time-series log on the external QSPI flash (P25Q16H), second 1 MB
+
+    Producers (motion / acoustic events, SLM reports, RTC jobs, clips) call
+    bsp_tslog_append(), which only queues the record. The writer thread packs
+    records into a page sized RAM staging buffer and programs it when it is
+    full, or BSP_TSLOG_FLUSH_MS after the first record staged in it.
+
+    Flash layout, BSP_TSLOG_REGION_xxx : 4 KB sectors used as a ring
+        TSLOG_SECT_ST   : magic, seq (+1 per sector, never reused), base ms
+        TSLOG_REC_ST    : type, len, crc8, dt ms from the base, payload
+                          padded to 4 bytes, 0xFF type : end of the sector
+    Power fail : a sector header is programmed before any record in it and
+    every record has its crc. At boot the newest sector is walked, a torn
+    record closes it and the log goes on in a fresh sector. The sector after
+    the open one is kept erased, so opening a sector is one page program.
+    Index : seq + base ms per sector in RAM (rebuilt from the headers at
+    boot), a range query is a binary search over it (a linear pass once a
+    wall clock step back left the bases out of order). Sectors are streamed
+    as they are on flash over the bulk path (NUS_MSG_GET_LOG), the central
+    filters the records by time. The query is queued to the writer thread,
+    which programs what is staged and starts the transfer, so the caller
+    (event queue) never waits on flash.
+    Timestamps are wall clock ms (bsp_wall_now_ms), records before the
+    first RTC sync are dropped and counted.
+*/
+#include <zephyr/drivers/flash.h>
+#include <zephyr/sys/crc.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(tslog, LOG_LEVEL_INF);
+
+#define TSLOG_SECTORS (BSP_TSLOG_REGION_SIZE / BSP_QSPI_SECTOR)
+#define TSLOG_STAGE 256 // one flash page
+#define TSLOG_QUEUE_DEPTH 16
+#define TSLOG_TYPE_FLUSH 0    // queue marker, program what is staged now
+#define TSLOG_TYPE_QUERY 0xFE // queue marker, flush then stream ts .. data(8) ms
+#define TSLOG_ERASED 0xFF
+#define TSLOG_AT(first, i) m_idx[((first) + (i)) % TSLOG_SECTORS] // i-th sector in seq order
+#define TSLOG_BOOT_WAIT_MS 5000
+
+#define TSLOG_SECT_OFF(s) (BSP_TSLOG_REGION_OFF + (s) * BSP_QSPI_SECTOR)
+#define TSLOG_REC_SIZE(len) (sizeof(TSLOG_REC_ST) + ROUND_UP(len, 4))
+
+static void tslog_task(void);
+
+K_THREAD_DEFINE(thread_tslog, 1024, tslog_task, NULL, NULL, NULL, 11, 0, 0);
+
+typedef struct
+{
+    int64_t ts;
+    uint8_t type;
+    uint8_t len;
+    uint8_t data[BSP_TSLOG_MAX_PAYLOAD];
+} tslog_entry_t;
+
+K_MSGQ_DEFINE(tslog_mq, sizeof(tslog_entry_t), TSLOG_QUEUE_DEPTH, 4);
+
+static K_SEM_DEFINE(m_flushed, 0, 1);
+
+extern BSP_ST g_Bsp;
+
+typedef struct
+{
+    uint32_t seq; // 0 : erased / not a log sector
+    int64_t baseMs;
+} tslog_idx_t;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint16_t mask;
+    uint16_t sectors; // with data
+    uint32_t records; // appended since boot
+    uint32_t dropped;
+    int64_t oldestMs;
+    int64_t newestMs;
+} tslog_stat_packet_t;
+
+static const struct device *m_flash = DEVICE_DT_GET(DT_NODELABEL(p25q16h));
+
+static tslog_idx_t m_idx[TSLOG_SECTORS];
+static uint16_t m_cur;     // open sector
+static uint32_t m_off;     // next record offset in it
+static uint32_t m_prog;    // programmed up to here, m_stage starts at it
+static uint32_t m_seq = 0; // seq of the open sector
+static bool m_ready = false;
+
+static uint8_t m_stage[TSLOG_STAGE] __aligned(4);
+
+/* Range being streamed, checked against the index while reading */
+static struct
+{
+    uint16_t first; // sector ring position
+    uint32_t seq;   // seq of first
+} m_q;
+
+static void tslog_update_stat(void);
+static int tslog_query_start(int64_t from_ms, int64_t to_ms);
+
+static bool tslog_blank(uint16_t s)
+{
+    uint32_t buf[TSLOG_STAGE / 4];
+
+    for (uint32_t off = 0; off < BSP_QSPI_SECTOR; off += sizeof(buf))
+    {
+        if (flash_read(m_flash, TSLOG_SECT_OFF(s) + off, buf, sizeof(buf)) < 0)
+        {
+            return false;
+        }
+        for (int i = 0; i < ARRAY_SIZE(buf); i++)
+        {
+            if (buf[i] != 0xFFFFFFFF)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int tslog_erase(uint16_t s)
+{
+    m_idx[s].seq = 0;
+
+    /* Blank already (first pass over the ring), spare the erase cycle */
+    if (tslog_blank(s))
+    {
+        return 0;
+    }
+    if (flash_erase(m_flash, TSLOG_SECT_OFF(s), BSP_QSPI_SECTOR) < 0)
+    {
+        LOG_ERR("Log sector %d erase failed", s);
+        return -1;
+    }
+    g_Bsp.tslog.erases++;
+
+    return 0;
+}
+
+static uint8_t tslog_crc(const TSLOG_REC_ST *r, const uint8_t *payload)
+{
+    TSLOG_REC_ST h = *r;
+
+    h.crc = 0;
+    return crc8_ccitt(crc8_ccitt(0xFF, &h, sizeof(h)), payload, r->len);
+}
+
+/**
+ * @brief program the staged bytes
+ *
+ */
+static int tslog_program(void)
+{
+    uint32_t n = m_off - m_prog;
+
+    if (n == 0)
+    {
+        return 0;
+    }
+    if (flash_write(m_flash, TSLOG_SECT_OFF(m_cur) + m_prog, m_stage, n) < 0)
+    {
+        LOG_ERR("Log write failed at sector %d + 0x%x", m_cur, m_prog);
+        /* Skip the area, the crc tells the reader */
+        m_prog = m_off;
+        return -1;
+    }
+    m_prog = m_off;
+    memset(m_stage, TSLOG_ERASED, sizeof(m_stage));
+    g_Bsp.tslog.flushes++;
+
+    return 0;
+}
+
+/**
+ * @brief open the (erased) sector after the current one, erase the one after
+ *
+ * @param base_ms   time of the first record in it
+ */
+static int tslog_open(int64_t base_ms)
+{
+    static TSLOG_SECT_ST hdr __aligned(4);
+    uint16_t s = (m_cur + 1) % TSLOG_SECTORS;
+
+    tslog_program();
+
+    tslog_erase(s);
+
+    hdr.magic = BSP_TSLOG_MAGIC;
+    hdr.seq = m_seq + 1;
+    hdr.baseMs = base_ms;
+    if (flash_write(m_flash, TSLOG_SECT_OFF(s), &hdr, sizeof(hdr)) < 0)
+    {
+        LOG_ERR("Log sector %d open failed", s);
+        return -1;
+    }
+
+    m_cur = s;
+    m_seq = hdr.seq;
+    m_idx[s].seq = hdr.seq;
+    m_idx[s].baseMs = base_ms;
+    m_off = sizeof(TSLOG_SECT_ST);
+    m_prog = m_off;
+
+    /* Keep the next one ready, this is where the oldest data goes */
+    tslog_erase((s + 1) % TSLOG_SECTORS);
+    tslog_update_stat();
+
+    return 0;
+}
+
+/**
+ * @brief one record into the staging buffer, programs / opens as needed
+ *
+ */
+static void tslog_stage(const tslog_entry_t *e)
+{
+    uint32_t size = TSLOG_REC_SIZE(e->len);
+    TSLOG_REC_ST *r;
+
+    /* New sector when full, or when dt does not fit / time went back */
+    if (m_seq == 0 || m_off + size > BSP_QSPI_SECTOR || e->ts < m_idx[m_cur].baseMs ||
+        e->ts - m_idx[m_cur].baseMs > UINT32_MAX)
+    {
+        if (tslog_open(e->ts) != 0)
+        {
+            g_Bsp.tslog.dropped++;
+            return;
+        }
+    }
+    if (m_off - m_prog + size > TSLOG_STAGE)
+    {
+        tslog_program();
+    }
+
+    r = (TSLOG_REC_ST *)&m_stage[m_off - m_prog];
+    r->type = e->type;
+    r->len = e->len;
+    r->rsvd = 0;
+    r->dtMs = (uint32_t)(e->ts - m_idx[m_cur].baseMs);
+    memcpy(r + 1, e->data, e->len);
+    r->crc = tslog_crc(r, e->data);
+
+    m_off += size;
+    g_Bsp.tslog.newestMs = e->ts;
+}
+
+/**
+ * @brief rebuild the index, find the open sector and its end
+ *
+ */
+static void tslog_scan(void)
+{
+    TSLOG_SECT_ST hdr;
+    uint32_t off;
+    bool torn = false;
+
+    m_seq = 0;
+    for (int s = 0; s < TSLOG_SECTORS; s++)
+    {
+        m_idx[s].seq = 0;
+        if (flash_read(m_flash, TSLOG_SECT_OFF(s), &hdr, sizeof(hdr)) < 0 || hdr.magic != BSP_TSLOG_MAGIC)
+        {
+            continue;
+        }
+        m_idx[s].seq = hdr.seq;
+        m_idx[s].baseMs = hdr.baseMs;
+        if (hdr.seq > m_seq)
+        {
+            m_seq = hdr.seq;
+            m_cur = s;
+        }
+    }
+
+    if (m_seq == 0)
+    {
+        m_cur = TSLOG_SECTORS - 1; // first record opens sector 0
+        LOG_INF("Log empty");
+        return;
+    }
+
+    /* Walk the open sector up to the first erased or broken record */
+    off = sizeof(TSLOG_SECT_ST);
+    while (off + sizeof(TSLOG_REC_ST) <= BSP_QSPI_SECTOR)
+    {
+        uint8_t buf[sizeof(TSLOG_REC_ST) + BSP_TSLOG_MAX_PAYLOAD];
+        TSLOG_REC_ST *r = (TSLOG_REC_ST *)buf;
+
+        if (flash_read(m_flash, TSLOG_SECT_OFF(m_cur) + off, buf, sizeof(TSLOG_REC_ST)) < 0)
+        {
+            torn = true;
+            break;
+        }
+        if (r->type == TSLOG_ERASED)
+        {
+            break;
+        }
+        if (r->len > BSP_TSLOG_MAX_PAYLOAD || off + TSLOG_REC_SIZE(r->len) > BSP_QSPI_SECTOR ||
+            flash_read(m_flash, TSLOG_SECT_OFF(m_cur) + off + sizeof(TSLOG_REC_ST), r + 1, r->len) < 0 ||
+            tslog_crc(r, (const uint8_t *)(r + 1)) != r->crc)
+        {
+            torn = true;
+            break;
+        }
+        g_Bsp.tslog.newestMs = m_idx[m_cur].baseMs + r->dtMs;
+        off += TSLOG_REC_SIZE(r->len);
+    }
+
+    m_off = off;
+    m_prog = off;
+
+    /* The rest of a torn sector is not clean, start the next one on the first record */
+    if (torn)
+    {
+        LOG_WRN("Log sector %d torn at 0x%x, closed", m_cur, off);
+        m_off = BSP_QSPI_SECTOR;
+        m_prog = m_off;
+    }
+
+    LOG_INF("Log seq %d, sector %d + 0x%x", m_seq, m_cur, m_off);
+}
+
+/**
+ * @brief ring position -> sector, oldest data first
+ *
+ */
+static uint16_t tslog_oldest(uint16_t *count)
+{
+    uint16_t n = 0;
+    uint16_t s = m_cur;
+
+    if (m_seq == 0)
+    {
+        *count = 0;
+        return 0;
+    }
+
+    /* Valid sectors are consecutive in the ring and end at the open one */
+    while (n < TSLOG_SECTORS && m_idx[s].seq == m_seq - n && m_idx[s].seq != 0)
+    {
+        n++;
+        s = (s + TSLOG_SECTORS - 1) % TSLOG_SECTORS;
+    }
+
+    *count = n;
+    return (m_cur + TSLOG_SECTORS + 1 - n) % TSLOG_SECTORS;
+}
+
+static void tslog_update_stat(void)
+{
+    uint16_t n;
+    uint16_t first = tslog_oldest(&n);
+
+    g_Bsp.tslog.sectors = n;
+    g_Bsp.tslog.oldestMs = n ? m_idx[first].baseMs : 0;
+}
+
+static void tslog_task(void)
+{
+    tslog_entry_t e;
+    int64_t deadline = 0;
+
+    g_Bsp.tslog.mask = BSP_DEFAULT_TSLOG_MASK;
+    memset(m_stage, TSLOG_ERASED, sizeof(m_stage));
+
+    if (!device_is_ready(m_flash))
+    {
+        LOG_ERR("QSPI flash not ready");
+        return;
+    }
+
+    tslog_scan();
+    tslog_update_stat();
+    m_ready = true;
+
+    /* Boot marker once the first RTC sync is in, nothing is logged before */
+    for (int i = 0; i < TSLOG_BOOT_WAIT_MS / 100 && bsp_wall_now_ms() == 0; i++)
+    {
+        k_sleep(K_MSEC(100));
+    }
+    bsp_tslog_append(BSP_TSLOG_T_BOOT, &g_Bsp.nvs.boot_count, sizeof(g_Bsp.nvs.boot_count));
+
+    while (1)
+    {
+        k_timeout_t to = K_FOREVER;
+
+        if (m_off != m_prog)
+        {
+            to = K_MSEC(MAX(deadline - k_uptime_get(), 0));
+        }
+
+        if (k_msgq_get(&tslog_mq, &e, to) != 0)
+        {
+            tslog_program();
+            continue;
+        }
+
+        if (e.type == TSLOG_TYPE_FLUSH)
+        {
+            tslog_program();
+            k_sem_give(&m_flushed);
+            continue;
+        }
+        if (e.type == TSLOG_TYPE_QUERY)
+        {
+            int64_t to_ms;
+
+            memcpy(&to_ms, e.data, sizeof(to_ms));
+            tslog_program();
+            tslog_query_start(e.ts, to_ms);
+            continue;
+        }
+
+        if (m_off == m_prog)
+        {
+            deadline = k_uptime_get() + BSP_TSLOG_FLUSH_MS;
+        }
+        tslog_stage(&e);
+    }
+}
+
+/**
+ * @brief log one record, never blocks (any thread, ISR)
+ *
+ * @param type      BSP_TSLOG_T_xxx, dropped unless enabled in the mask
+ * @param data      payload
+ * @param len       up to BSP_TSLOG_MAX_PAYLOAD
+ * @return int      0 : OK, -1 : not logged
+ */
+int bsp_tslog_append(uint8_t type, const void *data, uint8_t len)
+{
+    tslog_entry_t e;
+
+    if (type == TSLOG_TYPE_FLUSH || type >= TSLOG_TYPE_QUERY || !(g_Bsp.tslog.mask & BIT(type)) ||
+        len > BSP_TSLOG_MAX_PAYLOAD)
+    {
+        return -1;
+    }
+
+    e.ts = bsp_wall_now_ms();
+    if (e.ts == 0 || !m_ready)
+    {
+        g_Bsp.tslog.dropped++;
+        return -1;
+    }
+    e.type = type;
+    e.len = len;
+    memcpy(e.data, data, len);
+
+    if (k_msgq_put(&tslog_mq, &e, K_NO_WAIT) != 0)
+    {
+        g_Bsp.tslog.dropped++;
+        return -1;
+    }
+    g_Bsp.tslog.records++;
+
+    return 0;
+}
+
+/**
+ * @brief record types to log, 0 : logging off
+ *
+ * @param mask  BIT(BSP_TSLOG_T_xxx)
+ */
+void bsp_tslog_set_mask(uint16_t mask)
+{
+    g_Bsp.tslog.mask = mask;
+    LOG_INF("Log mask 0x%04x", mask);
+}
+
+/**
+ * @brief program the staging buffer now, waits a little for the writer
+ *
+ * @return int  0 : OK, -1 : ERROR (writer busy or not running)
+ */
+int bsp_tslog_flush(void)
+{
+    tslog_entry_t e = {.type = TSLOG_TYPE_FLUSH};
+
+    k_sem_reset(&m_flushed);
+    if (!m_ready || k_msgq_put(&tslog_mq, &e, K_NO_WAIT) != 0)
+    {
+        return -1;
+    }
+
+    return k_sem_take(&m_flushed, K_MSEC(500)) == 0 ? 0 : -1;
+}
+
+static int tslog_read(uint32_t offset, uint8_t *buf, uint16_t len, void *ctx)
+{
+    uint16_t done = 0;
+
+    while (done < len)
+    {
+        uint32_t pos = (offset + done) / BSP_QSPI_SECTOR;
+        uint32_t in = (offset + done) % BSP_QSPI_SECTOR;
+        uint16_t s = (m_q.first + pos) % TSLOG_SECTORS;
+        uint16_t n = MIN(len - done, BSP_QSPI_SECTOR - in);
+
+        /* The writer took the sector back for new data while streaming */
+        if (m_idx[s].seq != m_q.seq + pos)
+        {
+            LOG_ERR("Log sector %d reused", s);
+            return -1;
+        }
+        if (flash_read(m_flash, TSLOG_SECT_OFF(s) + in, buf + done, n) < 0)
+        {
+            return -1;
+        }
+        done += n;
+    }
+
+    return len;
+}
+
+/**
+ * @brief sector bases in seq order never go down, false after the wall clock was set back
+ *
+ */
+static bool tslog_sorted(uint16_t first, uint16_t n)
+{
+    for (uint16_t i = 1; i < n; i++)
+    {
+        if (TSLOG_AT(first, i).baseMs < TSLOG_AT(first, i - 1).baseMs)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief first / last sector that may hold records in [from_ms, to_ms], one
+ *        pass in seq order. A sector followed by a lower base (clock set
+ *        back) may run to any time, it is kept.
+ *
+ * @return int  0 : OK, -1 : nothing in range
+ */
+static int tslog_find_linear(uint16_t first, uint16_t n, int64_t from_ms, int64_t to_ms, uint16_t *lo, uint16_t *last)
+{
+    bool found = false;
+
+    for (uint16_t i = 0; i < n; i++)
+    {
+        int64_t base = TSLOG_AT(first, i).baseMs;
+        int64_t end = INT64_MAX;
+
+        if (i + 1 < n && TSLOG_AT(first, i + 1).baseMs >= base)
+        {
+            end = TSLOG_AT(first, i + 1).baseMs;
+        }
+        if (base <= to_ms && end > from_ms)
+        {
+            if (!found)
+            {
+                *lo = i;
+                found = true;
+            }
+            *last = i;
+        }
+    }
+
+    return found ? 0 : -1;
+}
+
+/**
+ * @brief stream the sectors covering [from_ms, to_ms], writer thread, staged
+ *        records programmed
+ *
+ *  Binary search on the sector bases while they are in order, a linear
+ *  pass once the wall clock has been stepped back.
+ *
+ * @return int  0 : OK, -1 : ERROR
+ */
+static int tslog_query_start(int64_t from_ms, int64_t to_ms)
+{
+    uint16_t n, first, lo, hi, last;
+    uint32_t total;
+
+    first = tslog_oldest(&n);
+    if (n == 0)
+    {
+        LOG_ERR("Log empty");
+        return -1;
+    }
+    if (to_ms == 0)
+    {
+        to_ms = INT64_MAX;
+    }
+
+    if (!tslog_sorted(first, n))
+    {
+        if (tslog_find_linear(first, n, from_ms, to_ms, &lo, &last) != 0)
+        {
+            LOG_ERR("Log has nothing in range");
+            return -1;
+        }
+    }
+    else
+    {
+        /* Last sector starting at or before from_ms, then the one holding to_ms */
+        lo = 0;
+        hi = n - 1;
+        while (lo < hi)
+        {
+            uint16_t mid = (lo + hi + 1) / 2;
+
+            if (TSLOG_AT(first, mid).baseMs <= from_ms)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid - 1;
+            }
+        }
+
+        hi = n - 1;
+        last = lo;
+        while (last < hi)
+        {
+            uint16_t mid = (last + hi + 1) / 2;
+
+            if (TSLOG_AT(first, mid).baseMs <= to_ms)
+            {
+                last = mid;
+            }
+            else
+            {
+                hi = mid - 1;
+            }
+        }
+    }
+    m_q.first = (first + lo) % TSLOG_SECTORS;
+
+    m_q.seq = m_idx[m_q.first].seq;
+    total = (last - lo) * BSP_QSPI_SECTOR;
+    total += ((first + last) % TSLOG_SECTORS == m_cur) ? m_prog : BSP_QSPI_SECTOR;
+
+    LOG_INF("Log query, %d sectors, %d bytes", last - lo + 1, total);
+
+    return bsp_bulk_start(BSP_BULK_STREAM_TSLOG, total, tslog_read, NULL);
+}
+
+/**
+ * @brief stream the sectors covering [from_ms, to_ms] over the bulk path,
+ *        queued to the writer thread, never blocks
+ *
+ * @param from_ms   epoch ms, 0 : oldest
+ * @param to_ms     epoch ms, 0 : newest
+ * @return int      0 : queued, -1 : ERROR
+ */
+int bsp_tslog_query(int64_t from_ms, int64_t to_ms)
+{
+    tslog_entry_t e = {.type = TSLOG_TYPE_QUERY, .ts = from_ms, .len = sizeof(to_ms)};
+
+    if (bsp_bulk_busy())
+    {
+        LOG_ERR("Bulk busy");
+        return -1;
+    }
+    memcpy(e.data, &to_ms, sizeof(to_ms));
+    if (!m_ready || k_msgq_put(&tslog_mq, &e, K_NO_WAIT) != 0)
+    {
+        LOG_ERR("Log query not queued");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief NUS_MSG_NOTIFY_LOG_STAT
+ *
+ */
+void bsp_tslog_notify_stat(void)
+{
+    tslog_stat_packet_t packet;
+
+    packet.id = NUS_MSG_NOTIFY_LOG_STAT;
+    packet.len = sizeof(packet);
+    packet.mask = g_Bsp.tslog.mask;
+    packet.sectors = g_Bsp.tslog.sectors;
+    packet.records = g_Bsp.tslog.records;
+    packet.dropped = g_Bsp.tslog.dropped;
+    packet.oldestMs = g_Bsp.tslog.oldestMs;
+    packet.newestMs = g_Bsp.tslog.newestMs;
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
@@ -0,0 +1,344 @@
+/*
+    Wall clock service, PCF8563 disciplined uptime clock
+
+    The RTC is read at boot and by the BSP_PRD_JOB_WALL job (every
+    BSP_WALL_RESYNC_S by default), never on a request.
+    It only counts whole seconds, so a sync polls it every BSP_WALL_EDGE_POLL_MS
+    until the seconds register rolls over; the rollover is the anchor
+    (epoch ms <-> bsp_time_us), good to about half a poll period.
+    Between syncs wall time is extrapolated from the uptime clock, corrected
+    by the RTC rate measured against the first anchor (driftPpb improves as
+    the baseline grows). bsp_wall_now_ms() is a few multiplies under a
+    spinlock, usable from any context, and never steps backwards.
+    Device us timestamps (samples, events, clips) map to epoch ms with
+    bsp_wall_ms_at(), NUS_MSG_NOTIFY_WALL_CLOCK gives the central the same
+    mapping after each sync.
+*/
+#include <time.h>
+#include <zephyr/sys/timeutil.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(wall_clock, LOG_LEVEL_INF);
+
+#define WALL_EDGE_TIMEOUT_US 1500000 // seconds register did not move, RTC stopped
+#define WALL_DRIFT_MIN_US 60000000   // baseline before the first drift estimate
+#define WALL_DRIFT_MAX_PPB 500000    // beyond this the anchor is bad, not the crystal
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    int64_t epochMs;  // wall time at refUs
+    int64_t refUs;    // device time, bsp_time_us
+    int32_t driftPpb; // RTC rate vs device clock
+    int32_t stepMs;   // correction at the last sync
+    uint32_t syncs;
+} wall_packet_t;
+
+static void wall_sync_work(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(m_sync_work, wall_sync_work);
+static struct k_spinlock m_lock;
+
+/* First anchor of the current RTC time base, drift reference */
+static int64_t m_base_ms = 0;
+static int64_t m_base_us = 0;
+
+/* Edge hunt, 0xFF : idle */
+static uint8_t m_hunt_sec = 0xFF;
+static int64_t m_hunt_start_us;
+static int64_t m_prev_poll_us;
+
+static int64_t m_last_ms = 0; // monotonic now()
+static volatile bool m_restart = false;
+
+/**
+ * @brief RTC civil time -> epoch ms
+ *
+ */
+static int64_t wall_rtc_to_ms(const RTC_TIME_ST *t)
+{
+    struct tm tm = {0};
+
+    tm.tm_year = t->year + 100;
+    tm.tm_mon = t->mon - 1;
+    tm.tm_mday = t->day;
+    tm.tm_hour = t->hour;
+    tm.tm_min = t->min;
+    tm.tm_sec = t->sec;
+
+    return timeutil_timegm64(&tm) * 1000;
+}
+
+/**
+ * @brief epoch ms -> RTC civil time, weekday 0 : Sunday as the PCF8563 counts
+ *
+ */
+static void wall_ms_to_rtc(int64_t ms, RTC_TIME_ST *t)
+{
+    time_t sec = (time_t)(ms / 1000);
+    struct tm tm;
+
+    gmtime_r(&sec, &tm);
+
+    t->year = (uint8_t)(tm.tm_year - 100);
+    t->mon = (uint8_t)(tm.tm_mon + 1);
+    t->day = (uint8_t)tm.tm_mday;
+    t->weekday = (uint8_t)tm.tm_wday;
+    t->hour = (uint8_t)tm.tm_hour;
+    t->min = (uint8_t)tm.tm_min;
+    t->sec = (uint8_t)tm.tm_sec;
+}
+
+/* caller holds m_lock */
+static int64_t wall_extrapolate(int64_t device_us)
+{
+    int64_t dt = device_us - g_Bsp.wall.refUs;
+
+    return g_Bsp.wall.epochMs + (dt + dt * g_Bsp.wall.driftPpb / 1000000000LL) / 1000;
+}
+
+static void wall_notify(void)
+{
+    wall_packet_t packet;
+    k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+    packet.id = NUS_MSG_NOTIFY_WALL_CLOCK;
+    packet.len = sizeof(packet);
+    packet.epochMs = g_Bsp.wall.epochMs;
+    packet.refUs = g_Bsp.wall.refUs;
+    packet.driftPpb = g_Bsp.wall.driftPpb;
+    packet.stepMs = g_Bsp.wall.stepMs;
+    packet.syncs = g_Bsp.wall.syncs;
+    k_spin_unlock(&m_lock, key);
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
+
+/**
+ * @brief new anchor from a seconds edge of the RTC
+ *
+ * @param epoch_ms  RTC time just after the edge
+ * @param edge_us   device time of the edge
+ */
+static void wall_anchor(int64_t epoch_ms, int64_t edge_us)
+{
+    k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+    if (!g_Bsp.wall.valid || m_base_us == 0)
+    {
+        m_base_ms = epoch_ms;
+        m_base_us = edge_us;
+        g_Bsp.wall.stepMs = 0;
+    }
+    else
+    {
+        int64_t up = edge_us - m_base_us;
+
+        g_Bsp.wall.stepMs = (int32_t)(epoch_ms - wall_extrapolate(edge_us));
+
+        if (up >= WALL_DRIFT_MIN_US)
+        {
+            /* (RTC elapsed - device elapsed) / device elapsed */
+            int64_t ppb = ((epoch_ms - m_base_ms) * 1000 - up) * 1000000LL / (up / 1000);
+
+            if (ppb > -WALL_DRIFT_MAX_PPB && ppb < WALL_DRIFT_MAX_PPB)
+            {
+                g_Bsp.wall.driftPpb = (int32_t)ppb;
+            }
+            else
+            {
+                /* Someone moved the RTC behind our back, start a new baseline */
+                m_base_ms = epoch_ms;
+                m_base_us = edge_us;
+            }
+        }
+    }
+
+    g_Bsp.wall.epochMs = epoch_ms;
+    g_Bsp.wall.refUs = edge_us;
+    g_Bsp.wall.lastSyncUs = edge_us;
+    g_Bsp.wall.syncs++;
+    g_Bsp.wall.valid = 1;
+    k_spin_unlock(&m_lock, key);
+
+    wall_ms_to_rtc(epoch_ms, &g_Bsp.rtc);
+
+    LOG_INF("Wall clock sync %d, step %d ms, drift %d ppb", g_Bsp.wall.syncs, g_Bsp.wall.stepMs,
+            g_Bsp.wall.driftPpb);
+}
+
+/**
+ * @brief one step of the seconds edge hunt, reschedules itself
+ *
+ */
+static void wall_sync_work(struct k_work *work)
+{
+    RTC_TIME_ST t;
+    int64_t us;
+
+    if (m_restart)
+    {
+        m_restart = false;
+        m_hunt_sec = 0xFF;
+    }
+
+    if (bsp_rtc_get_time(&t) != 0)
+    {
+        LOG_ERR("RTC read failed");
+        g_Bsp.wall.errors++;
+        m_hunt_sec = 0xFF;
+        if (!g_Bsp.wall.valid)
+        {
+            bsp_evq_reschedule(&m_sync_work, K_SECONDS(5));
+        }
+        return;
+    }
+    us = bsp_time_us();
+
+    if (m_hunt_sec == 0xFF)
+    {
+        m_hunt_sec = t.sec;
+        m_hunt_start_us = us;
+    }
+    else if (t.sec != m_hunt_sec)
+    {
+        /* Rolled over between the previous poll and this one */
+        wall_anchor(wall_rtc_to_ms(&t), (m_prev_poll_us + us) / 2);
+        m_hunt_sec = 0xFF;
+        wall_notify();
+        return;
+    }
+    else if (us - m_hunt_start_us > WALL_EDGE_TIMEOUT_US)
+    {
+        LOG_ERR("RTC seconds not counting");
+        g_Bsp.wall.errors++;
+        m_hunt_sec = 0xFF;
+        if (!g_Bsp.wall.valid)
+        {
+            bsp_evq_reschedule(&m_sync_work, K_SECONDS(5));
+        }
+        return;
+    }
+
+    m_prev_poll_us = us;
+    bsp_evq_reschedule(&m_sync_work, K_MSEC(BSP_WALL_EDGE_POLL_MS));
+}
+
+/**
+ * @brief start the first RTC sync, wall time is valid about a second later
+ *
+ * @return int 0 : OK
+ */
+int bsp_wall_init(void)
+{
+    bsp_evq_reschedule(&m_sync_work, K_NO_WAIT);
+
+    return 0;
+}
+
+/**
+ * @brief wall time of a device timestamp
+ *
+ * @param device_us     bsp_time_us() base
+ * @return int64_t      epoch ms (UTC), 0 : not synced yet
+ */
+int64_t bsp_wall_ms_at(int64_t device_us)
+{
+    int64_t ms = 0;
+    k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+    if (g_Bsp.wall.valid)
+    {
+        ms = wall_extrapolate(device_us);
+    }
+    k_spin_unlock(&m_lock, key);
+
+    return ms;
+}
+
+/**
+ * @brief current wall time, non-blocking and monotonic across syncs
+ *
+ * @return int64_t epoch ms (UTC), 0 : not synced yet
+ */
+int64_t bsp_wall_now_ms(void)
+{
+    int64_t ms = 0;
+    k_spinlock_key_t key = k_spin_lock(&m_lock);
+
+    if (g_Bsp.wall.valid)
+    {
+        ms = MAX(wall_extrapolate(bsp_time_us()), m_last_ms);
+        m_last_ms = ms;
+    }
+    k_spin_unlock(&m_lock, key);
+
+    return ms;
+}
+
+/**
+ * @brief current civil time from the cache, no I2C
+ *
+ * @param time      out
+ * @return int      0 : OK, -1 : ERROR (not synced yet)
+ */
+int bsp_wall_get_time(RTC_TIME_ST *time)
+{
+    int64_t ms = bsp_wall_now_ms();
+
+    if (ms == 0)
+    {
+        return -1;
+    }
+    wall_ms_to_rtc(ms, time);
+
+    return 0;
+}
+
+/**
+ * @brief set the RTC and the wall clock, drift baseline restarts
+ *
+ * @param time      civil time (UTC)
+ * @return int      0 : OK, -1 : ERROR
+ */
+int bsp_wall_set_time(RTC_TIME_ST *time)
+{
+    int64_t ms = wall_rtc_to_ms(time);
+    int64_t us = bsp_time_us();
+    k_spinlock_key_t key;
+
+    if (bsp_rtc_set_time(time) != 0)
+    {
+        LOG_ERR("RTC write failed");
+        return -1;
+    }
+
+    /* Provisional anchor at the write, the edge hunt below refines it */
+    key = k_spin_lock(&m_lock);
+    g_Bsp.wall.epochMs = ms;
+    g_Bsp.wall.refUs = us;
+    g_Bsp.wall.valid = 1;
+    m_base_us = 0;
+    m_last_ms = ms;
+    k_spin_unlock(&m_lock, key);
+
+    m_restart = true;
+    bsp_evq_reschedule(&m_sync_work, K_NO_WAIT);
+
+    return 0;
+}
+
+/**
+ * @brief resync now and report, NUS_MSG_GET_WALL_CLOCK
+ *
+ */
+void bsp_wall_resync(void)
+{
+    /* During a hunt this only brings the next poll forward */
+    bsp_evq_reschedule(&m_sync_work, K_NO_WAIT);
+}
@@ -0,0 +1,111 @@
+/*
+    Battery voltage, SAADC AIN7 (P0.31) behind the XIAO 1M / 510k divider
+
+    P0.14 pulls the divider low end to ground. It stays enabled : with the
+    divider off P0.31 sees VBAT, above the pin rating when charging, and
+    the divider only draws ~3 uA. 4x oversampled 12 bit read, run by the
+    periodic scheduler (BSP_PRD_JOB_BATT), NUS_MSG_GET_BATT_ADC.
+*/
+#include <zephyr/drivers/adc.h>
+#include <zephyr/drivers/gpio.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(batt_adc, LOG_LEVEL_INF);
+
+#define BATT_NODE DT_PATH(zephyr_user)
+#define BATT_DIV_NUM 1510 // (1M + 510k) / 510k
+#define BATT_DIV_DEN 510
+
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint16_t mv;
+    int16_t raw;
+    uint32_t samples;
+} batt_packet_t;
+
+static const struct adc_dt_spec m_adc = ADC_DT_SPEC_GET_BY_IDX(BATT_NODE, 0);
+static const struct gpio_dt_spec m_vbat_en = GPIO_DT_SPEC_GET(BATT_NODE, vbat_en_gpios);
+static bool m_ready = false;
+
+/**
+ * @brief ADC channel and divider enable
+ *
+ * @return int 0 : OK, -1 : ERROR
+ */
+int bsp_batt_init(void)
+{
+    if (!adc_is_ready_dt(&m_adc) || adc_channel_setup_dt(&m_adc) < 0)
+    {
+        LOG_ERR("Battery ADC not ready");
+        return -1;
+    }
+    if (!gpio_is_ready_dt(&m_vbat_en) || gpio_pin_configure_dt(&m_vbat_en, GPIO_OUTPUT_ACTIVE) < 0)
+    {
+        LOG_ERR("VBAT divider enable failed");
+        return -1;
+    }
+
+    m_ready = true;
+
+    return 0;
+}
+
+/**
+ * @brief one battery reading into g_Bsp.batt_adc
+ *
+ * @return int  VBAT mV, -1 : ERROR
+ */
+int bsp_batt_sample(void)
+{
+    int16_t raw = 0;
+    int32_t mv;
+    struct adc_sequence seq = {
+        .buffer = &raw,
+        .buffer_size = sizeof(raw),
+    };
+
+    if (!m_ready)
+    {
+        return -1;
+    }
+
+    adc_sequence_init_dt(&m_adc, &seq);
+    if (adc_read_dt(&m_adc, &seq) < 0)
+    {
+        LOG_ERR("Battery ADC read failed");
+        return -1;
+    }
+
+    mv = MAX(raw, 0);
+    adc_raw_to_millivolts_dt(&m_adc, &mv);
+    mv = mv * BATT_DIV_NUM / BATT_DIV_DEN;
+
+    g_Bsp.batt_adc.value = raw;
+    g_Bsp.batt_adc.mv = (uint16_t)mv;
+    g_Bsp.batt_adc.samples++;
+
+    return mv;
+}
+
+/**
+ * @brief NUS_MSG_NOTIFY_BATT, last reading
+ *
+ */
+void bsp_batt_notify(void)
+{
+    batt_packet_t packet;
+
+    packet.id = NUS_MSG_NOTIFY_BATT;
+    packet.len = sizeof(packet);
+    packet.mv = g_Bsp.batt_adc.mv;
+    packet.raw = (int16_t)g_Bsp.batt_adc.value;
+    packet.samples = g_Bsp.batt_adc.samples;
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
@@ -1,5 +1,16 @@
 /*
-
+    NVS on the internal flash storage_partition
+
+    Sized from the partition at mount. Every write goes through
+    nvs_timed_end() : NVS writes at the sector tail and, when the sector is
+    full, moves to the next one and garbage collects (copy + erase) the
+    sector after it, inside the same nvs_write call. Only the public API is
+    used, so a GC is told by its time : a write that took BSP_NVS_GC_US or
+    more (a page erase alone is ~85 ms) is counted as a GC and goes to the
+    GC histogram. Free space is nvs_calc_free_space().
+    Lifetime erases are kept as a setting, the remaining life is that
+    against BSP_NVS_ENDURANCE cycles per sector (NVS wears the sectors
+    evenly). cli nvs_stat, NUS_MSG_GET_NVS_STAT.
 */
 #include <zephyr/drivers/flash.h>
 #include <zephyr/storage/flash_map.h>
@@ -11,7 +22,10 @@
 #define NVS_PARTITION_DEVICE FIXED_PARTITION_DEVICE(NVS_PARTITION)
 #define NVS_PARTITION_OFFSET FIXED_PARTITION_OFFSET(NVS_PARTITION)
 
-#define CONFIG_ID 1
+#define NVS_PARTITION_SIZE FIXED_PARTITION_SIZE(NVS_PARTITION)
+
+#define BLOB_CHUNK 1024 // one NVS entry, must stay below the sector size
+#define NVS_ATE_SIZE 8
 
 LOG_MODULE_REGISTER(nvs_sample, LOG_LEVEL_INF);
 
@@ -23,6 +37,104 @@ static bool m_nvs_ready = false;
 
 extern BSP_ST g_Bsp;
 
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t sectors;
+    uint16_t sectorSize;
+    uint32_t freeBytes;
+    uint32_t writes;
+    uint32_t gcs;
+    uint32_t erases;
+    uint16_t lifePermille;
+    uint32_t lifeDays;
+    uint32_t wrMaxUs;
+    uint32_t gcMaxUs;
+    uint16_t wrHist[BSP_NVS_HIST_BINS];
+    uint16_t gcHist[BSP_NVS_HIST_BINS];
+} nvs_stat_packet_t;
+
+static void nvs_hist_add(uint16_t *hist, uint32_t us)
+{
+    int bin = 0;
+
+    while (bin < BSP_NVS_HIST_BINS - 1 && us >= ((uint32_t)BSP_NVS_HIST_BASE_US << bin))
+    {
+        bin++;
+    }
+    if (hist[bin] < UINT16_MAX)
+    {
+        hist[bin]++;
+    }
+}
+
+/**
+ * @brief free space and life estimate, free space walks every ATE so not
+ *        on each write
+ *
+ */
+static void nvs_update_stat(void)
+{
+    NVS_STAT_ST *st = &g_Bsp.nvsStat;
+    uint32_t budget = (uint32_t)m_fs.sector_count * BSP_NVS_ENDURANCE;
+    ssize_t free = nvs_calc_free_space(&m_fs);
+    int64_t up_s = k_uptime_get() / 1000;
+
+    st->freeBytes = (free > 0) ? free : 0;
+
+    st->lifePermille = (st->erases < budget) ? (uint16_t)(1000 - (uint64_t)st->erases * 1000 / budget) : 0;
+
+    /* Days left at this boot's GC rate */
+    st->lifeDays = UINT32_MAX;
+    if (st->gcs && up_s > 0)
+    {
+        uint64_t left = (st->erases < budget) ? budget - st->erases : 0;
+
+        st->lifeDays = (uint32_t)MIN(left * up_s / st->gcs / 86400, UINT32_MAX - 1);
+    }
+}
+
+/**
+ * @brief account one nvs_write / nvs_delete
+ *
+ * @param t0        bsp_time_us() before the call
+ * @param rc        NVS result, 0 : data unchanged, nothing written
+ */
+static void nvs_timed_end(int64_t t0, ssize_t rc)
+{
+    NVS_STAT_ST *st = &g_Bsp.nvsStat;
+    uint32_t us = (uint32_t)(bsp_time_us() - t0);
+
+    if (rc > 0 && us >= BSP_NVS_GC_US)
+    {
+        st->gcs++;
+        st->erases++;
+        st->gcMaxUs = MAX(st->gcMaxUs, us);
+        nvs_hist_add(st->gcHist, us);
+        LOG_INF("NVS GC, %d us", us);
+        bsp_settings_touch(BSP_SET_NVS_ERASES);
+        nvs_update_stat();
+    }
+    else if (rc > 0)
+    {
+        st->writes++;
+        st->wrMaxUs = MAX(st->wrMaxUs, us);
+        nvs_hist_add(st->wrHist, us);
+    }
+}
+
+static ssize_t nvs_write_timed(uint16_t id, const void *p, size_t len)
+{
+    int64_t t0 = bsp_time_us();
+    ssize_t rc = nvs_write(&m_fs, id, p, len);
+
+    nvs_timed_end(t0, rc);
+
+    return rc;
+}
+
 /**
  * @brief initialize nRF flash NVS function area
  * 
@@ -54,8 +166,12 @@ int bsp_nvs_init(void)
 
     /* Configure sector size and count based on the partition size */
     m_fs.sector_size = info.size;
-    /* We use the sector count of the storage partition (usually 4KB or 4096 bytes per page on nRF) */
-    m_fs.sector_count = 3U;
+    m_fs.sector_count = NVS_PARTITION_SIZE / info.size;
+    if (m_fs.sector_count < 2)
+    {
+        LOG_ERR("storage_partition 0x%x too small for NVS", NVS_PARTITION_SIZE);
+        return -1;
+    }
 
     /* Mount the NVS file system */
     rc = nvs_mount(&m_fs);
@@ -67,69 +183,97 @@ int bsp_nvs_init(void)
 
     m_nvs_ready = true;
 
-    // g_Bsp.nvs.boot_count++;
+    g_Bsp.nvsStat.sectors = m_fs.sector_count;
+    g_Bsp.nvsStat.sectorSize = m_fs.sector_size;
+    nvs_update_stat();
 
-    LOG_INF("Flash init done");
+    LOG_INF("Flash init done, %d x %d B sectors, %d B free", m_fs.sector_count, m_fs.sector_size,
+            g_Bsp.nvsStat.freeBytes);
     return 0;
 }
 
 /**
- * @brief nRF flash NVS stored data read
+ * @brief read one NVS entry
  * 
- * @param p data pointer to read
- * @return int 0 : OK, -1 : ERROR
+ * @param id    NVS id
+ * @param p     data pointer to read
+ * @param len   size of p
+ * @return int  stored length, 0 or negative : not stored / ERROR
  */
-int bsp_nvs_read(NVS_INFO_ST *p)
+int bsp_nvs_read_id(uint16_t id, void *p, size_t len)
 {
-    int rc = 0;
-
     if (m_nvs_ready == false)
     {
         LOG_ERR("NVS not ready");
         return -1;
     }
 
-    // Attempt to read existing data
-    rc = nvs_read(&m_fs, CONFIG_ID, p, sizeof(NVS_INFO_ST));
+    return nvs_read(&m_fs, id, p, len);
+}
 
-    if (rc > 0)
-    {
-        /* Data found */
-        LOG_INF("Found data in NVS!");
-        LOG_INF("unique_id : 0x%04x", p->unique_id);
-        LOG_INF("boot_count : %d, %d", p->boot_count, g_Bsp.nvs.boot_count);
-        LOG_INF("prdTick : %d", p->prdTick);
+/**
+ * @brief write one NVS entry, NVS skips the write if the data is unchanged
+ * 
+ * @param id    NVS id
+ * @param p     data to store
+ * @param len   data length
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_nvs_write_id(uint16_t id, const void *p, size_t len)
+{
+    int rc = 0;
 
-        g_Bsp.prdTick = p->prdTick;
-        p->boot_count++;
+    if (m_nvs_ready == false)
+    {
+        LOG_ERR("NVS not ready");
+        return -1;
     }
-    else
+
+    rc = nvs_write_timed(id, p, len);
+    if (rc < 0)
     {
-        /* No data found (First boot), initialize defaults */
-        LOG_INF("No data found. Initializing defaults...");
-        p->unique_id = BSP_DEFAULT_UNIQUE_ID;
-        p->prdTick = BSP_DEFAULT_PRD_TICK_COUNT;
-        p->boot_count = BSP_DEFAULT_BOOT_COUNT;
+        LOG_ERR("Failed to write NVS 0x%x (Err: %d)", id, rc);
+        return -1;
+    }
 
-        // update BSP structure
-        g_Bsp.prdTick = p->prdTick;
-        /***************************************************/
+    return 0;
+}
 
-        bsp_nvs_write(p);
-        LOG_INF("NVS default data stored!!");
+/**
+ * @brief delete one NVS entry
+ * 
+ * @param id    NVS id
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_nvs_delete_id(uint16_t id)
+{
+    if (m_nvs_ready == false)
+    {
+        LOG_ERR("NVS not ready");
+        return -1;
     }
 
-    return 0;
+    int64_t t0 = bsp_time_us();
+    int rc = nvs_delete(&m_fs, id);
+
+    nvs_timed_end(t0, rc == 0 ? NVS_ATE_SIZE : rc);
+
+    return (rc == 0) ? 0 : -1;
 }
 
 /**
- * @brief nRF flash NVS data store to flash
+ * @brief store a blob bigger than one NVS entry
+ *        id : length, id + 1.. : BLOB_CHUNK sized pieces
  * 
+ * @param id    first NVS id of the blob, leave room for the chunks
  * @param p     data to store
- * @return int  data length to store
+ * @param len   data length
+ * @return int  0 : OK, -1 : ERROR
  */
-int bsp_nvs_write(NVS_INFO_ST *p)
+int bsp_nvs_write_blob(uint16_t id, const void *p, size_t len)
 {
+    const uint8_t *src = p;
+    uint32_t total = len;
     int rc = 0;
 
     if (m_nvs_ready == false)
@@ -138,27 +282,84 @@ int bsp_nvs_write(NVS_INFO_ST *p)
         return -1;
     }
 
-    p->prdTick = g_Bsp.prdTick;
-
-    // nvs_write returns the number of bytes written, or error code
-    rc = nvs_write(&m_fs, CONFIG_ID, p, sizeof(NVS_INFO_ST));
+    for (uint16_t n = 0; len > 0; n++)
+    {
+        size_t chunk = MIN(len, BLOB_CHUNK);
+
+        rc = nvs_write_timed(id + 1 + n, src, chunk);
+        if (rc < 0)
+        {
+            LOG_ERR("Failed to write blob 0x%x chunk %d (Err: %d)", id, n, rc);
+            return -1;
+        }
+        src += chunk;
+        len -= chunk;
+    }
 
+    /* Length last. Chunks are overwritten in place, so a blob interrupted
+     * while writing reads as the old length over partly new chunks : the
+     * owner checks the content (the ML model has its crc).
+     */
+    rc = nvs_write_timed(id, &total, sizeof(total));
     if (rc < 0)
     {
-        LOG_ERR("Failed to write to NVS (Err: %d)", rc);
+        LOG_ERR("Failed to write blob 0x%x (Err: %d)", id, rc);
         return -1;
     }
-    else
+
+    LOG_INF("Blob 0x%x stored, %d bytes", id, total);
+
+    return 0;
+}
+
+/**
+ * @brief read a blob stored by bsp_nvs_write_blob()
+ * 
+ * @param id    first NVS id of the blob
+ * @param p     data pointer to read
+ * @param max   size of p
+ * @return int  blob length, 0 : not stored, -1 : ERROR
+ */
+int bsp_nvs_read_blob(uint16_t id, void *p, size_t max)
+{
+    uint8_t *dst = p;
+    uint32_t total = 0;
+    size_t len;
+    int rc = 0;
+
+    if (m_nvs_ready == false)
     {
-        LOG_INF("NVS Stored");
-        LOG_INF("unique_id :  0x%04x", p->unique_id);
-        LOG_INF("boot_count : %d, %d", p->boot_count, g_Bsp.nvs.boot_count);
-        LOG_INF("prdTick : %d", p->prdTick);
+        LOG_ERR("NVS not ready");
+        return -1;
+    }
 
-        LOG_INF("Saved configuration to NVS");
+    rc = nvs_read(&m_fs, id, &total, sizeof(total));
+    if (rc != sizeof(total))
+    {
+        return 0;
+    }
+    if (total > max)
+    {
+        LOG_ERR("Blob 0x%x too big (%d > %d)", id, total, max);
+        return -1;
     }
 
-    return 0;
+    len = total;
+    for (uint16_t n = 0; len > 0; n++)
+    {
+        size_t chunk = MIN(len, BLOB_CHUNK);
+
+        rc = nvs_read(&m_fs, id + 1 + n, dst, chunk);
+        if (rc != chunk)
+        {
+            LOG_ERR("Blob 0x%x chunk %d missing", id, n);
+            return -1;
+        }
+        dst += chunk;
+        len -= chunk;
+    }
+
+    return total;
 }
 
 /**
@@ -193,3 +394,62 @@ int bsp_nvs_reset(void)
 
     return 0;
 }
+
+/**
+ * @brief refresh free space and the life estimate in g_Bsp.nvsStat
+ *
+ * @return int 0 : OK, -1 : ERROR
+ */
+int bsp_nvs_update_stat(void)
+{
+    if (m_nvs_ready == false)
+    {
+        return -1;
+    }
+    nvs_update_stat();
+
+    return 0;
+}
+
+/**
+ * @brief clear the latency histograms, the wear counters stay
+ *
+ */
+void bsp_nvs_reset_stat(void)
+{
+    NVS_STAT_ST *st = &g_Bsp.nvsStat;
+
+    st->wrMaxUs = 0;
+    st->gcMaxUs = 0;
+    memset(st->wrHist, 0, sizeof(st->wrHist));
+    memset(st->gcHist, 0, sizeof(st->gcHist));
+}
+
+/**
+ * @brief NUS_MSG_NOTIFY_NVS_STAT
+ *
+ */
+void bsp_nvs_notify_stat(void)
+{
+    NVS_STAT_ST *st = &g_Bsp.nvsStat;
+    nvs_stat_packet_t packet;
+
+    bsp_nvs_update_stat();
+
+    packet.id = NUS_MSG_NOTIFY_NVS_STAT;
+    packet.len = sizeof(packet);
+    packet.sectors = st->sectors;
+    packet.sectorSize = st->sectorSize;
+    packet.freeBytes = st->freeBytes;
+    packet.writes = st->writes;
+    packet.gcs = st->gcs;
+    packet.erases = st->erases;
+    packet.lifePermille = st->lifePermille;
+    packet.lifeDays = st->lifeDays;
+    packet.wrMaxUs = st->wrMaxUs;
+    packet.gcMaxUs = st->gcMaxUs;
+    memcpy(packet.wrHist, st->wrHist, sizeof(packet.wrHist));
+    memcpy(packet.gcHist, st->gcHist, sizeof(packet.gcHist));
+
+    ble_nus_send_data((char *)&packet, sizeof(packet));
+}
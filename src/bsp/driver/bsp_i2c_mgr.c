@@ -0,0 +1,270 @@
+/*
+    I2C transaction manager for the expansion board bus (i2c1)
+
+    Every user of the bus queues transactions here instead of calling the
+    driver from its own thread, one thread owns the bus.
+    Lanes  : the device decides the lane, SENSOR > RTC > DISP. The bus
+             thread always takes the highest non empty lane, so a sensor
+             transaction waits at most for the one in flight.
+    DISP   : transactions are capped at BSP_I2C_DISP_MAX_BYTES (a display
+             page + control byte, ~3 ms at 400 kHz). A frame is many small
+             transactions, sensors get in between them.
+    Batch  : back to back transactions of the same device in the same lane
+             go out as one i2c_transfer (one TWIM EasyDMA sequence, one
+             wake of the bus thread) up to BSP_I2C_BATCH_MSGS messages.
+    Stats  : per device queue wait and bus time (mean and max), g_Bsp.i2c.
+    On the Sense board the IMU sits alone on i2c0 behind the sensor driver,
+    the SENSOR lane is for sensors added to this bus.
+*/
+#include <zephyr/drivers/i2c.h>
+
+#include "bsp.h"
+
+LOG_MODULE_REGISTER(i2c_mgr, LOG_LEVEL_INF);
+
+#define I2C_LANE_DEPTH 8
+#define I2C_AVG_SHIFT 4 // stat means, 1/16 per transaction
+
+static void i2c_task(void);
+
+K_THREAD_DEFINE(thread_i2c, 1024, i2c_task, NULL, NULL, NULL, 6, 0, 0);
+
+K_MSGQ_DEFINE(i2c_lane_sensor, sizeof(BSP_I2C_XFER_ST *), I2C_LANE_DEPTH, 4);
+K_MSGQ_DEFINE(i2c_lane_rtc, sizeof(BSP_I2C_XFER_ST *), I2C_LANE_DEPTH, 4);
+K_MSGQ_DEFINE(i2c_lane_disp, sizeof(BSP_I2C_XFER_ST *), I2C_LANE_DEPTH, 4);
+
+static K_SEM_DEFINE(m_pending, 0, BSP_I2C_LANES * I2C_LANE_DEPTH);
+
+extern BSP_ST g_Bsp;
+
+typedef struct
+{
+    uint16_t addr;
+    uint8_t lane;
+} i2c_dev_t;
+
+static const struct device *const m_bus = DEVICE_DT_GET(DT_NODELABEL(i2c1));
+
+static struct k_msgq *const m_lane[BSP_I2C_LANES] = {&i2c_lane_sensor, &i2c_lane_rtc, &i2c_lane_disp};
+
+static const i2c_dev_t m_dev[BSP_I2C_DEVS] = {
+    [BSP_I2C_DEV_RTC] = {DT_REG_ADDR(DT_NODELABEL(pcf8563)), BSP_I2C_LANE_RTC},
+    [BSP_I2C_DEV_OLED] = {BSP_I2C_ADDR_OLED, BSP_I2C_LANE_DISP},
+};
+
+/* Batch being sent, bus thread only */
+static struct i2c_msg m_msgs[BSP_I2C_BATCH_MSGS];
+static BSP_I2C_XFER_ST *m_batch[BSP_I2C_BATCH_MSGS];
+
+static void i2c_stat_update(BSP_I2C_XFER_ST *x, uint32_t wait_us, uint32_t bus_us, uint8_t batched)
+{
+    I2C_STAT_ST *st = &g_Bsp.i2c[x->dev];
+
+    st->xfers++;
+    st->batched += batched;
+    st->errors += (x->result != 0);
+    st->waitMaxUs = MAX(st->waitMaxUs, wait_us);
+    st->busMaxUs = MAX(st->busMaxUs, bus_us);
+    st->waitAvgUs += ((int32_t)wait_us - (int32_t)st->waitAvgUs) >> I2C_AVG_SHIFT;
+    st->busAvgUs += ((int32_t)bus_us - (int32_t)st->busAvgUs) >> I2C_AVG_SHIFT;
+}
+
+/**
+ * @brief take the next transaction and the ones that batch with it
+ *
+ * @param nmsgs out, messages in m_msgs
+ * @return int  transactions in m_batch
+ */
+static int i2c_collect(uint8_t *nmsgs)
+{
+    BSP_I2C_XFER_ST *x = NULL;
+    struct k_msgq *q = NULL;
+    int n = 0;
+
+    for (int l = 0; l < BSP_I2C_LANES; l++)
+    {
+        if (k_msgq_get(m_lane[l], &x, K_NO_WAIT) == 0)
+        {
+            q = m_lane[l];
+            break;
+        }
+    }
+    if (q == NULL)
+    {
+        return 0;
+    }
+
+    *nmsgs = 0;
+    do
+    {
+        memcpy(&m_msgs[*nmsgs], x->msgs, x->num * sizeof(struct i2c_msg));
+        *nmsgs += x->num;
+        m_batch[n++] = x;
+
+        if (k_msgq_peek(q, &x) != 0 || x->dev != m_batch[0]->dev || *nmsgs + x->num > BSP_I2C_BATCH_MSGS)
+        {
+            break;
+        }
+        k_msgq_get(q, &x, K_NO_WAIT);
+        k_sem_take(&m_pending, K_NO_WAIT);
+    } while (1);
+
+    return n;
+}
+
+static void i2c_task(void)
+{
+    if (!device_is_ready(m_bus))
+    {
+        LOG_ERR("I2C bus not ready");
+        return;
+    }
+
+    while (1)
+    {
+        uint8_t nmsgs = 0;
+        int64_t t0, t1;
+        int rc, n;
+
+        k_sem_take(&m_pending, K_FOREVER);
+
+        n = i2c_collect(&nmsgs);
+        if (n == 0)
+        {
+            continue;
+        }
+
+        t0 = bsp_time_us();
+        rc = i2c_transfer(m_bus, m_msgs, nmsgs, m_dev[m_batch[0]->dev].addr);
+        t1 = bsp_time_us();
+
+        /* A failed batch fails every transaction in it, callers retry */
+        for (int i = 0; i < n; i++)
+        {
+            BSP_I2C_XFER_ST *x = m_batch[i];
+
+            x->result = rc;
+            i2c_stat_update(x, (uint32_t)(t0 - x->queuedUs), (uint32_t)((t1 - t0) / n), n > 1);
+
+            if (x->done)
+            {
+                x->done(x);
+            }
+            else
+            {
+                k_sem_give(&x->sem);
+            }
+        }
+    }
+}
+
+/**
+ * @brief queue a transaction, returns at once
+ *
+ *  x and its messages stay owned by the bus until done() runs (bus thread,
+ *  must not wait for another transaction) or x->sem is given (done NULL).
+ *
+ * @param x     msgs, num, dev, done, ctx set by the caller
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_i2c_submit(BSP_I2C_XFER_ST *x)
+{
+    const i2c_dev_t *d;
+
+    if (x->dev >= BSP_I2C_DEVS || x->num == 0 || x->num > BSP_I2C_BATCH_MSGS || !device_is_ready(m_bus))
+    {
+        return -1;
+    }
+    d = &m_dev[x->dev];
+
+    if (d->lane == BSP_I2C_LANE_DISP)
+    {
+        uint32_t bytes = 0;
+
+        for (int i = 0; i < x->num; i++)
+        {
+            bytes += x->msgs[i].len;
+        }
+        if (bytes > BSP_I2C_DISP_MAX_BYTES)
+        {
+            LOG_ERR("Display transaction %d B > %d B, split it", bytes, BSP_I2C_DISP_MAX_BYTES);
+            return -1;
+        }
+    }
+
+    if (x->done == NULL)
+    {
+        k_sem_init(&x->sem, 0, 1);
+    }
+    x->result = -EINPROGRESS;
+    x->queuedUs = bsp_time_us();
+
+    if (k_msgq_put(m_lane[d->lane], &x, K_NO_WAIT) != 0)
+    {
+        g_Bsp.i2c[x->dev].full++;
+        return -1;
+    }
+    k_sem_give(&m_pending);
+
+    return 0;
+}
+
+/**
+ * @brief queue and wait, drop in for i2c_write_read_dt and friends
+ *
+ * @return int  0 : OK, non-zero : ERROR
+ */
+static int i2c_sync(uint8_t dev, struct i2c_msg *msgs, uint8_t num)
+{
+    BSP_I2C_XFER_ST x = {0};
+
+    x.msgs = msgs;
+    x.num = num;
+    x.dev = dev;
+
+    if (bsp_i2c_submit(&x) != 0)
+    {
+        return -EBUSY;
+    }
+    k_sem_take(&x.sem, K_FOREVER);
+
+    return x.result;
+}
+
+/**
+ * @brief blocking write through the bus thread
+ *
+ * @param dev   BSP_I2C_DEV_xxx
+ * @return int  0 : OK, non-zero : ERROR
+ */
+int bsp_i2c_write(uint8_t dev, const uint8_t *buf, uint32_t len)
+{
+    struct i2c_msg msg = {(uint8_t *)buf, len, I2C_MSG_WRITE | I2C_MSG_STOP};
+
+    return i2c_sync(dev, &msg, 1);
+}
+
+/**
+ * @brief blocking write + repeated start read through the bus thread
+ *
+ * @param dev   BSP_I2C_DEV_xxx
+ * @return int  0 : OK, non-zero : ERROR
+ */
+int bsp_i2c_write_read(uint8_t dev, const uint8_t *wbuf, uint32_t wlen, uint8_t *rbuf, uint32_t rlen)
+{
+    struct i2c_msg msg[2] = {
+        {(uint8_t *)wbuf, wlen, I2C_MSG_WRITE},
+        {rbuf, rlen, I2C_MSG_RESTART | I2C_MSG_READ | I2C_MSG_STOP},
+    };
+
+    return i2c_sync(dev, msg, 2);
+}
+
+/**
+ * @brief clear the per device stats, cli i2c reset
+ *
+ */
+void bsp_i2c_reset_stat(void)
+{
+    memset(g_Bsp.i2c, 0, sizeof(g_Bsp.i2c));
+}
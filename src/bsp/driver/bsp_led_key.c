@@ -183,11 +183,22 @@ static struct gpio_callback button_cb_data;
 
 /* 3. The Interrupt Service Routine (ISR)
  * This function runs when the button is pressed. Keep it short!
+ * The rest runs from the event queue (bsp_key_event).
  */
 void button_pressed(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
 {
-    LOG_INF("Button pressed on %d, %s", pins, dev->name);
+    bsp_evq_post(BSP_EVT_BUTTON);
+}
+
+/**
+ * @brief button press, BSP_EVT_BUTTON
+ * 
+ */
+void bsp_key_event(void)
+{
+    LOG_INF("Button pressed on P0.%02d", button.pin);
     ble_nus_send_data("Button pressed", strlen("Button pressed"));
+    bsp_audio_clip_trigger(BSP_CLIP_TRIG_BUTTON);
 }
 
 /**
@@ -8,6 +8,7 @@
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/logging/log.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "bsp.h"
 
@@ -26,11 +27,67 @@ LOG_MODULE_REGISTER(imu, LOG_LEVEL_INF);
 /* Get the sensor device from the overlay alias */
 const struct device *imu_dev = DEVICE_DT_GET(DT_ALIAS(imu));
 static void imu_task(void);
-static int16_t convert_to_int16(struct sensor_value *val, double scale_factor);
+#ifndef BSP_IMU_RTIO_ENABLED
+static int16_t convert_to_int16(struct sensor_value *val, int32_t scale_factor);
+#endif
 
 /* Semaphore to signal data ready */
 K_SEM_DEFINE(imu_sem, 0, 1);
-K_THREAD_DEFINE(thread_imu, 2048, imu_task, NULL, NULL, NULL, 7, 0, 0);
+/* Data-ready time, captured as close to the interrupt as the driver lets us */
+static volatile uint32_t m_drdy_ts;
+static uint16_t m_seq;
+/* Acquisition runs above the consumer (imu_proc_task, 8) so I2C fetch timing
+ * does not depend on BLE.
+ */
+K_THREAD_DEFINE(thread_imu, 2048, imu_task, NULL, NULL, NULL, 6, 0, 0);
+
+#ifdef BSP_IMU_RTIO_ENABLED
+/* Read-and-decode API, accel + gyro frame in one submission */
+SENSOR_DT_READ_IODEV(imu_iodev, DT_ALIAS(imu), {SENSOR_CHAN_ACCEL_XYZ, 0}, {SENSOR_CHAN_GYRO_XYZ, 0});
+/* 4 submissions / completions in flight, 8 x 64 byte blocks for raw frames */
+RTIO_DEFINE_WITH_MEMPOOL(imu_rtio, 4, 4, 8, 64, 4);
+
+static const struct sensor_decoder_api *m_decoder;
+#endif
+
+/* Power mode changes talk to the sensor over I2C, so they run from the
+ * event queue (never from the trigger callback) and are serialized.
+ */
+K_MUTEX_DEFINE(imu_pwr_mutex);
+static void imu_wake_work_handler(struct k_work *work);
+static void imu_idle_work_handler(struct k_work *work);
+static K_WORK_DEFINE(m_wake_work, imu_wake_work_handler);
+static K_WORK_DELAYABLE_DEFINE(m_idle_work, imu_idle_work_handler);
+
+/* Drivers keep the trigger pointer, these must outlive the call */
+static const struct sensor_trigger m_trig_drdy = {
+    .type = SENSOR_TRIG_DATA_READY,
+    .chan = SENSOR_CHAN_ACCEL_XYZ,
+};
+static const struct sensor_trigger m_trig_wom = {
+    .type = SENSOR_TRIG_DELTA,
+    .chan = SENSOR_CHAN_ACCEL_XYZ,
+};
+static const struct sensor_trigger *m_trig_cur = NULL;
+
+/* Previous accel, consumer (bsp_imu_activity) owned */
+static int16_t m_act_prev[3];
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint8_t mode;         // BSP_IMU_MODE_xxx
+    uint8_t state;        // new BSP_IMU_STATE_xxx
+    uint32_t prevStateMs; // time spent in the state we just left
+    uint32_t transitions;
+} imu_power_packet_t;
+
+static IMU_BENCH_ST m_bench;
+static uint64_t m_bench_cycles_start;
+static uint64_t m_bench_busy_start;
+static volatile bool m_bench_reset = true;
 
 /* * This function is called by the system thread when the interrupt triggers.
  * Keep it fast. Just signal the main loop.
@@ -38,92 +95,279 @@ K_THREAD_DEFINE(thread_imu, 2048, imu_task, NULL, NULL, NULL, 7, 0, 0);
 static void trigger_handler(const struct device *dev,
                             const struct sensor_trigger *trig)
 {
+    uint32_t ts = (uint32_t)bsp_time_us();
+
+    if (trig->type == SENSOR_TRIG_DELTA)
+    {
+        /* Wake-on-motion, switch to streaming outside of this callback */
+        bsp_evq_submit(&m_wake_work);
+        return;
+    }
+
+#ifdef BSP_IMU_RTIO_ENABLED
+    /* Queue the read and return, imu_task picks up the completion.
+     * The timestamp rides along as userdata.
+     */
+    if (sensor_read_async_mempool(&imu_iodev, &imu_rtio, (void *)(uintptr_t)ts) < 0)
+    {
+        m_bench.errors++;
+    }
+#else
+    m_drdy_ts = ts;
+
     /* Signal the main loop that data is ready */
     k_sem_give(&imu_sem);
+#endif
 }
 
-typedef struct PACKED
+#ifdef BSP_IMU_RTIO_ENABLED
+/* q31 with shift (value = q * 2^shift / 2^31) to our int16 scale */
+static int16_t q31_to_int16(q31_t q, int8_t shift, int32_t scale_factor)
 {
-    uint16_t id;
-    uint16_t len; // total length of message includes id + len
+    int64_t scaled = (int64_t)q * scale_factor;
 
-    int16_t acc_x;
-    int16_t acc_y;
-    int16_t acc_z;
-    int16_t gyro_x;
-    int16_t gyro_y;
-    int16_t gyro_z;
-} sensor_packet_t;
+    if (shift <= 31)
+    {
+        scaled >>= (31 - shift);
+    }
+    else
+    {
+        scaled <<= (shift - 31);
+    }
 
-static void imu_task(void)
+    if (scaled > INT16_MAX)
+    {
+        return INT16_MAX;
+    }
+    if (scaled < INT16_MIN)
+    {
+        return INT16_MIN;
+    }
+    return (int16_t)scaled;
+}
+
+/**
+ * @brief wait for one completed read and decode it
+ *
+ * @param sample    decoded sample, ts comes from the submission
+ * @return int      0 : OK, -1 : ERROR
+ */
+static int imu_read_rtio(IMU_SAMPLE_ST *sample)
+{
+    struct rtio_cqe *cqe;
+    struct sensor_three_axis_data data;
+    uint8_t *buf = NULL;
+    uint32_t buf_len = 0;
+    uint32_t fit;
+    int rc;
+
+    /* Sleep on the completion queue, the bus transfer is not done by this thread */
+    cqe = rtio_cqe_consume_block(&imu_rtio);
+    rc = cqe->result;
+    sample->ts = (uint32_t)(uintptr_t)cqe->userdata;
+    if (rc >= 0)
+    {
+        rc = rtio_cqe_get_mempool_buffer(&imu_rtio, cqe, &buf, &buf_len);
+    }
+    rtio_cqe_release(&imu_rtio, cqe);
+
+    if (rc < 0)
+    {
+        LOG_ERR("Async read failed (%d)", rc);
+        return -1;
+    }
+
+    fit = 0;
+    rc = m_decoder->decode(buf, (struct sensor_chan_spec){SENSOR_CHAN_ACCEL_XYZ, 0}, &fit, 1, &data);
+    if (rc > 0)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            sample->acc[i] = q31_to_int16(data.readings[0].values[i], data.shift, BSP_IMU_ACC_SCALE);
+        }
+
+        fit = 0;
+        rc = m_decoder->decode(buf, (struct sensor_chan_spec){SENSOR_CHAN_GYRO_XYZ, 0}, &fit, 1, &data);
+        for (int i = 0; i < 3; i++)
+        {
+            sample->gyro[i] = q31_to_int16(data.readings[0].values[i], data.shift, BSP_IMU_GYRO_SCALE);
+        }
+    }
+
+    rtio_release_buffer(&imu_rtio, buf, buf_len);
+
+    return (rc > 0) ? 0 : -1;
+}
+#else
+/**
+ * @brief blocking read, this thread waits on I2C
+ *
+ * @param sample    converted sample, ts must already be set
+ * @return int      0 : OK, -1 : ERROR, 1 : logged only (no IMU_RAW_DATA_FORMAT)
+ */
+static int imu_read_blocking(IMU_SAMPLE_ST *sample)
 {
     struct sensor_value accel[3];
     struct sensor_value gyro[3];
-    sensor_packet_t packet;
+
+    /* Fetch and Print Data (Safe to do I2C here) */
+    if (sensor_sample_fetch(imu_dev) < 0)
+    {
+        LOG_ERR("Sample fetch failed");
+        return -1;
+    }
+
+    sensor_channel_get(imu_dev, SENSOR_CHAN_ACCEL_XYZ, accel);
+    sensor_channel_get(imu_dev, SENSOR_CHAN_GYRO_XYZ, gyro);
+
+#ifdef IMU_RAW_DATA_FORMAT
+    // Scaling Factor:
+    // Zephyr returns m/s^2. We want to pass compact integers.
+    // Let's multiply by 100 so 9.81 m/s^2 becomes 981.
+    // Max int16 is 32767, so 327.67 m/s^2 (~33 Gs) is our max range. Sufficient.
+    sample->acc[0] = convert_to_int16(&accel[0], BSP_IMU_ACC_SCALE);
+    sample->acc[1] = convert_to_int16(&accel[1], BSP_IMU_ACC_SCALE);
+    sample->acc[2] = convert_to_int16(&accel[2], BSP_IMU_ACC_SCALE);
+
+    // Gyro (Zephyr returns radians/sec), x1000 keeps 0.06 deg/s resolution
+    // for fusion, 32.7 rad/s (~1870 dps) max.
+    sample->gyro[0] = convert_to_int16(&gyro[0], BSP_IMU_GYRO_SCALE);
+    sample->gyro[1] = convert_to_int16(&gyro[1], BSP_IMU_GYRO_SCALE);
+    sample->gyro[2] = convert_to_int16(&gyro[2], BSP_IMU_GYRO_SCALE);
+
+    return 0;
+#else
+
+    g_Bsp.imu.accel[0] = accel[0];
+    g_Bsp.imu.accel[1] = accel[1];
+    g_Bsp.imu.accel[2] = accel[2];
+
+    g_Bsp.imu.gyro[0] = gyro[0];
+    g_Bsp.imu.gyro[1] = gyro[1];
+    g_Bsp.imu.gyro[2] = gyro[2];
+
+    LOG_INF("MOTION! | A: X=%.2f Y=%.2f Z=%.2f | G: X=%.2f Y=%.2f Z=%.2f\n",
+            sensor_value_to_double(&g_Bsp.imu.accel[0]),
+            sensor_value_to_double(&g_Bsp.imu.accel[1]),
+            sensor_value_to_double(&g_Bsp.imu.accel[2]),
+            sensor_value_to_double(&g_Bsp.imu.gyro[0]),
+            sensor_value_to_double(&g_Bsp.imu.gyro[1]),
+            sensor_value_to_double(&g_Bsp.imu.gyro[2]));
+
+    return 1;
+#endif
+}
+#endif
+
+/**
+ * @brief CPU cycles this thread has run so far
+ *
+ * @return uint64_t execution cycles (CONFIG_THREAD_RUNTIME_STATS)
+ */
+static uint64_t imu_thread_cycles(void)
+{
+    k_thread_runtime_stats_t rt;
+
+    k_thread_runtime_stats_get(k_current_get(), &rt);
+
+    return rt.execution_cycles;
+}
+
+/**
+ * @brief non-idle CPU cycles of the whole system so far
+ *
+ * @return uint64_t all threads and ISRs (CONFIG_SCHED_THREAD_USAGE_ALL)
+ */
+static uint64_t imu_busy_cycles(void)
+{
+    k_thread_runtime_stats_t rt;
+
+    k_thread_runtime_stats_all_get(&rt);
+
+    return rt.total_cycles;
+}
+
+static void imu_task(void)
+{
+    IMU_SAMPLE_ST sample;
+    uint32_t lat;
+    int rc;
 
     while (1)
     {
+#ifdef BSP_IMU_RTIO_ENABLED
+        sample.seq = m_seq++;
+        rc = imu_read_rtio(&sample);
+#else
         /* Wait here until the interrupt fires */
         k_sem_take(&imu_sem, K_FOREVER);
 
-        /* Fetch and Print Data (Safe to do I2C here) */
-        if (sensor_sample_fetch(imu_dev) < 0)
+        sample.ts = m_drdy_ts;
+        sample.seq = m_seq++;
+        rc = imu_read_blocking(&sample);
+#endif
+        if (rc != 0)
         {
-            LOG_ERR("Sample fetch failed");
+            m_bench.errors += (rc < 0);
             continue;
         }
 
-        sensor_channel_get(imu_dev, SENSOR_CHAN_ACCEL_XYZ, accel);
-        sensor_channel_get(imu_dev, SENSOR_CHAN_GYRO_XYZ, gyro);
+        bsp_imu_cal_apply(&sample);
 
-#ifdef IMU_RAW_DATA_FORMAT
-        // Scaling Factor:
-        // Zephyr returns m/s^2. We want to send compact integers.
-        // Let's multiply by 100 so 9.81 m/s^2 becomes 981.
-        // Max int16 is 32767, so 327.67 m/s^2 (~33 Gs) is our max range. Sufficient.
-        double scale = 100.0;
-
-        packet.id = NUS_MSG_NOTIFY_IMU;
-        packet.len = 16;
-        packet.acc_x = convert_to_int16(&accel[0], scale);
-        packet.acc_y = convert_to_int16(&accel[1], scale);
-        packet.acc_z = convert_to_int16(&accel[2], scale);
-
-        // Do the same for Gyro (Zephyr returns radians/sec)
-        // 1 rad/sec ~ 57 degrees/sec. Multiply by 100 to keep precision.
-        packet.gyro_x = convert_to_int16(&gyro[0], scale);
-        packet.gyro_y = convert_to_int16(&gyro[1], scale);
-        packet.gyro_z = convert_to_int16(&gyro[2], scale);
-
-        g_Bsp.imu.acc_x = packet.acc_x;
-        g_Bsp.imu.acc_y = packet.acc_y;
-        g_Bsp.imu.acc_z = packet.acc_z;
-        g_Bsp.imu.gyro_x = packet.gyro_x;
-        g_Bsp.imu.gyro_y = packet.gyro_y;
-        g_Bsp.imu.gyro_z = packet.gyro_z;
-
-        ble_nus_send_data((uint8_t *)&packet, sizeof(packet));
-#else
+        /* Never wait for the consumer (BLE), the ring counts drops */
+        bsp_imu_ring_push(&sample);
 
-        g_Bsp.imu.accel[0] = accel[0];
-        g_Bsp.imu.accel[1] = accel[1];
-        g_Bsp.imu.accel[2] = accel[2];
-
-        g_Bsp.imu.gyro[0] = gyro[0];
-        g_Bsp.imu.gyro[1] = gyro[1];
-        g_Bsp.imu.gyro[2] = gyro[2];
-
-        LOG_INF("MOTION! | A: X=%.2f Y=%.2f Z=%.2f | G: X=%.2f Y=%.2f Z=%.2f\n",
-                sensor_value_to_double(&g_Bsp.imu.accel[0]),
-                sensor_value_to_double(&g_Bsp.imu.accel[1]),
-                sensor_value_to_double(&g_Bsp.imu.accel[2]),
-                sensor_value_to_double(&g_Bsp.imu.gyro[0]),
-                sensor_value_to_double(&g_Bsp.imu.gyro[1]),
-                sensor_value_to_double(&g_Bsp.imu.gyro[2]));
-#endif
+        /* Benchmark: data-ready to ring latency and CPU time of this thread */
+        if (m_bench_reset)
+        {
+            m_bench_reset = false;
+            memset(&m_bench, 0, sizeof(m_bench));
+            m_bench_cycles_start = imu_thread_cycles();
+            m_bench_busy_start = imu_busy_cycles();
+            continue;
+        }
+        lat = (uint32_t)bsp_time_us() - sample.ts;
+        m_bench.samples++;
+        m_bench.latSumUs += lat;
+        m_bench.latMaxUs = MAX(m_bench.latMaxUs, lat);
+        m_bench.cpuCycles = imu_thread_cycles() - m_bench_cycles_start;
     }
 }
 
+/**
+ * @brief acquisition path benchmark counters
+ *
+ * @param b copy destination
+ */
+void bsp_imu_bench_get(IMU_BENCH_ST *b)
+{
+    *b = m_bench;
+
+    /* The fetch does not run in imu_task on the RTIO fallback (work queue pool)
+       nor the trigger (system work queue), only the system total counts both
+       paths alike */
+    b->busyCycles = b->samples ? imu_busy_cycles() - m_bench_busy_start : 0;
+
+    /* imu_task + sensor trigger thread, the RTIO fallback adds its work queue pool */
+#ifdef BSP_IMU_RTIO_ENABLED
+    b->rtio = 1;
+    b->threads = 2 + CONFIG_RTIO_WORKQ_THREADS_POOL_MAX;
+#else
+    b->rtio = 0;
+    b->threads = 2;
+#endif
+}
+
+/**
+ * @brief restart the benchmark window
+ *
+ */
+void bsp_imu_bench_reset(void)
+{
+    /* imu_task clears the counters and takes a new cycle base on the next sample */
+    m_bench_reset = true;
+}
+
 /**
  * @brief Enable/Disable IMU power source via GPIO control
  *
@@ -160,6 +404,276 @@ static int enable_sensor_power(int conoff)
     return 0;
 }
 
+/**
+ * @brief set accel or gyro output data rate
+ *
+ * @param chan      SENSOR_CHAN_ACCEL_XYZ or SENSOR_CHAN_GYRO_XYZ
+ * @param hz        ODR, 0 powers the sensor block down
+ * @return int      0 : OK, 0 > : ERROR
+ */
+static int imu_set_odr(enum sensor_channel chan, uint16_t hz)
+{
+    struct sensor_value odr;
+
+    odr.val1 = hz;
+    odr.val2 = 0;
+
+    return sensor_attr_set(imu_dev, chan, SENSOR_ATTR_SAMPLING_FREQUENCY, &odr);
+}
+
+/**
+ * @brief program ODR/threshold/trigger for one power state
+ *
+ * @param state     BSP_IMU_STATE_xxx
+ * @return int      0 : OK, 0 > : ERROR
+ */
+static int imu_power_config(uint8_t state)
+{
+    const struct sensor_trigger *trig;
+    struct sensor_value val;
+    int rc;
+
+    /* Drop the current callback before the sensor is reprogrammed */
+    if (m_trig_cur != NULL)
+    {
+        sensor_trigger_set(imu_dev, m_trig_cur, NULL);
+        m_trig_cur = NULL;
+    }
+
+    if (state == BSP_IMU_STATE_STREAM)
+    {
+        rc = imu_set_odr(SENSOR_CHAN_ACCEL_XYZ, g_Bsp.imuPwr.odrHz);
+
+        /* If you skip this, the Gyro remains off, and you will read zeros. */
+        rc |= imu_set_odr(SENSOR_CHAN_GYRO_XYZ, g_Bsp.imuPwr.odrHz);
+        trig = &m_trig_drdy;
+    }
+    else
+    {
+        /* Gyro powered down, accel alone at low ODR feeds the slope detector */
+        rc = imu_set_odr(SENSOR_CHAN_GYRO_XYZ, 0);
+        rc |= imu_set_odr(SENSOR_CHAN_ACCEL_XYZ, BSP_IMU_WOM_ODR_HZ);
+
+        val.val1 = g_Bsp.imuPwr.wakeThr / 100;
+        val.val2 = (g_Bsp.imuPwr.wakeThr % 100) * 10000;
+        rc |= sensor_attr_set(imu_dev, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SLOPE_TH, &val);
+
+        /* Require 1 sample over threshold to trigger (Instant reaction) */
+        val.val1 = 1;
+        val.val2 = 0;
+        sensor_attr_set(imu_dev, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SLOPE_DUR, &val);
+        trig = &m_trig_wom;
+    }
+
+    if (rc < 0)
+    {
+        return rc;
+    }
+
+    rc = sensor_trigger_set(imu_dev, trig, trigger_handler);
+    if (rc == 0)
+    {
+        m_trig_cur = trig;
+    }
+
+    return rc;
+}
+
+/**
+ * @brief switch power state, account time-in-state and report the transition
+ *
+ * @param state     BSP_IMU_STATE_xxx
+ * @return int      0 : OK, -1 : ERROR
+ */
+static int imu_power_apply(uint8_t state)
+{
+    IMU_POWER_ST *pwr = &g_Bsp.imuPwr;
+    imu_power_packet_t packet;
+    uint8_t prev;
+    bool first;
+    int64_t now;
+    int rc;
+
+    k_mutex_lock(&imu_pwr_mutex, K_FOREVER);
+
+    /* Nothing to account for on the initial configuration */
+    first = (m_trig_cur == NULL && pwr->transitions == 0);
+    prev = pwr->state;
+
+    rc = imu_power_config(state);
+    if (rc < 0 && state == BSP_IMU_STATE_SLEEP)
+    {
+        LOG_ERR("Wake-on-motion not available (%d), back to continuous", rc);
+        pwr->mode = BSP_IMU_MODE_CONTINUOUS;
+        state = BSP_IMU_STATE_STREAM;
+        rc = imu_power_config(state);
+    }
+    if (rc < 0)
+    {
+        LOG_ERR("Could not set trigger. Check GPIO/IRQ config.");
+        k_mutex_unlock(&imu_pwr_mutex);
+        return -1;
+    }
+
+    now = k_uptime_get();
+    packet.prevStateMs = (uint32_t)(now - pwr->stateStartMs);
+    if (!first)
+    {
+        pwr->stateMs[prev] += packet.prevStateMs;
+        if (state != prev)
+        {
+            pwr->transitions++;
+        }
+    }
+    pwr->state = state;
+    pwr->stateStartMs = now;
+
+    k_mutex_unlock(&imu_pwr_mutex);
+
+    LOG_INF("IMU %s, %s at %dHz", (pwr->mode == BSP_IMU_MODE_WOM) ? "wake-on-motion" : "continuous",
+            (state == BSP_IMU_STATE_STREAM) ? "streaming" : "armed",
+            (state == BSP_IMU_STATE_STREAM) ? pwr->odrHz : BSP_IMU_WOM_ODR_HZ);
+
+    if (!first && state != prev)
+    {
+        packet.id = NUS_MSG_NOTIFY_IMU_POWER;
+        packet.len = sizeof(packet);
+        packet.mode = pwr->mode;
+        packet.state = state;
+        packet.transitions = pwr->transitions;
+        ble_nus_send_data((char *)&packet, sizeof(packet));
+    }
+
+    return 0;
+}
+
+static void imu_wake_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&imu_pwr_mutex, K_FOREVER);
+
+    if (g_Bsp.imuPwr.mode == BSP_IMU_MODE_WOM)
+    {
+        if (g_Bsp.imuPwr.state == BSP_IMU_STATE_SLEEP)
+        {
+            imu_power_apply(BSP_IMU_STATE_STREAM);
+        }
+        bsp_evq_reschedule(&m_idle_work, K_MSEC(g_Bsp.imuPwr.idleMs));
+    }
+
+    k_mutex_unlock(&imu_pwr_mutex);
+}
+
+static void imu_idle_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&imu_pwr_mutex, K_FOREVER);
+
+    if (g_Bsp.imuPwr.mode == BSP_IMU_MODE_WOM && g_Bsp.imuPwr.state == BSP_IMU_STATE_STREAM)
+    {
+        imu_power_apply(BSP_IMU_STATE_SLEEP);
+    }
+
+    k_mutex_unlock(&imu_pwr_mutex);
+}
+
+/**
+ * @brief select IMU power mode
+ *
+ * @param mode      BSP_IMU_MODE_xxx
+ * @param odr_hz    streaming ODR, 0 keeps the current one
+ * @param idle_ms   WOM idle timeout, 0 keeps the current one
+ * @return int      0 : OK, -1 : ERROR
+ */
+int bsp_imu_set_mode(uint8_t mode, uint16_t odr_hz, uint16_t idle_ms)
+{
+    IMU_POWER_ST *pwr = &g_Bsp.imuPwr;
+    int rc;
+
+    if (mode > BSP_IMU_MODE_WOM)
+    {
+        LOG_ERR("Unknown IMU mode %d", mode);
+        return -1;
+    }
+    if (odr_hz != 0 && odr_hz < g_Bsp.imu.fusionRateHz)
+    {
+        LOG_ERR("ODR %d < fusion rate %d", odr_hz, g_Bsp.imu.fusionRateHz);
+        return -1;
+    }
+
+    k_mutex_lock(&imu_pwr_mutex, K_FOREVER);
+
+    pwr->mode = mode;
+    pwr->odrHz = odr_hz ? odr_hz : pwr->odrHz;
+    pwr->idleMs = idle_ms ? idle_ms : pwr->idleMs;
+
+    if (mode == BSP_IMU_MODE_WOM)
+    {
+        /* Arm right away, the next motion brings streaming back */
+        k_work_cancel_delayable(&m_idle_work);
+        rc = imu_power_apply(BSP_IMU_STATE_SLEEP);
+    }
+    else
+    {
+        k_work_cancel_delayable(&m_idle_work);
+        rc = imu_power_apply(BSP_IMU_STATE_STREAM);
+    }
+
+    k_mutex_unlock(&imu_pwr_mutex);
+
+    if (rc == 0)
+    {
+        bsp_settings_touch(BSP_SET_IMU_MODE);
+        bsp_settings_touch(BSP_SET_IMU_ODR);
+        bsp_settings_touch(BSP_SET_IMU_IDLE);
+    }
+
+    return rc;
+}
+
+/**
+ * @brief consumer side activity check, keeps WOM streaming while moving
+ *
+ * @param s sample from the IMU ring
+ */
+void bsp_imu_activity(const IMU_SAMPLE_ST *s)
+{
+    bool active = false;
+
+    if (g_Bsp.imuPwr.mode != BSP_IMU_MODE_WOM)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (abs(s->gyro[i]) > BSP_DEFAULT_IMU_ACT_GYRO_THR ||
+            abs(s->acc[i] - m_act_prev[i]) > g_Bsp.imuPwr.wakeThr)
+        {
+            active = true;
+        }
+        m_act_prev[i] = s->acc[i];
+    }
+
+    if (active)
+    {
+        bsp_evq_reschedule(&m_idle_work, K_MSEC(g_Bsp.imuPwr.idleMs));
+    }
+}
+
+/**
+ * @brief power mode, counters and time-in-state including the current one
+ *
+ * @param pwr copy destination
+ */
+void bsp_imu_power_get(IMU_POWER_ST *pwr)
+{
+    k_mutex_lock(&imu_pwr_mutex, K_FOREVER);
+
+    *pwr = g_Bsp.imuPwr;
+    pwr->stateMs[pwr->state] += (uint32_t)(k_uptime_get() - pwr->stateStartMs);
+
+    k_mutex_unlock(&imu_pwr_mutex);
+}
+
 /**
  * @brief lsm6ds3tr-c sensor init
  *
@@ -184,54 +698,75 @@ int bsp_lsm6ds3tr_init(void *p)
         return -1;
     }
 
-    /* 3. Configure the Data Ready Trigger */
-    struct sensor_trigger trig = {
-        .type = SENSOR_TRIG_DELTA, // SENSOR_TRIG_DATA_READY,
-        .chan = SENSOR_CHAN_ACCEL_XYZ,
-    };
-
-    /* Register the callback function */
-    if (sensor_trigger_set(imu_dev, &trig, trigger_handler) < 0)
+#ifdef BSP_IMU_RTIO_ENABLED
+    /* Drivers without their own decoder get the default one */
+    if (sensor_get_decoder(imu_dev, &m_decoder) < 0)
     {
-        LOG_ERR("Could not set trigger. Check GPIO/IRQ config.");
+        LOG_ERR("No sensor decoder");
         return -1;
     }
+#endif
 
-    /* * Optional: Set Output Data Rate (ODR)
-     * If ODR is 0, the sensor might not generate interrupts.
-     * Set to 26 Hz for this test.
-     */
-    struct sensor_value odr_attr;
-    odr_attr.val1 = 26; // 26 Hz
-    odr_attr.val2 = 0;
-    sensor_attr_set(imu_dev, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SAMPLING_FREQUENCY, &odr_attr);
+    if (g_Bsp.imu.outMask == 0 && g_Bsp.imu.fusionRateHz == 0)
+    {
+        g_Bsp.imu.outMask = BSP_DEFAULT_IMU_OUT_MASK;
+        g_Bsp.imu.fusionRateHz = BSP_DEFAULT_FUSION_RATE_HZ;
+    }
+    if (g_Bsp.imuPwr.odrHz == 0)
+    {
+        g_Bsp.imuPwr.mode = BSP_DEFAULT_IMU_MODE;
+        g_Bsp.imuPwr.odrHz = BSP_IMU_ODR_HZ;
+        g_Bsp.imuPwr.idleMs = BSP_DEFAULT_IMU_IDLE_MS;
+        g_Bsp.imuPwr.wakeThr = BSP_DEFAULT_IMU_WAKE_THR;
+    }
 
-    /* Set Gyroscope ODR to 26 Hz (CRITICAL STEP)
-     * If you skip this, the Gyro remains off, and you will read zeros.
+    /* 3. Configure ODR and trigger for the power mode
+     * Continuous streams on data-ready (fusion needs every sample at the ODR),
+     * wake-on-motion arms the slope (DELTA) trigger with the gyro off.
      */
-    sensor_attr_set(imu_dev, SENSOR_CHAN_GYRO_XYZ, SENSOR_ATTR_SAMPLING_FREQUENCY, &odr_attr);
+    if (imu_power_apply((g_Bsp.imuPwr.mode == BSP_IMU_MODE_WOM) ? BSP_IMU_STATE_SLEEP : BSP_IMU_STATE_STREAM) < 0)
+    {
+        return -1;
+    }
 
-    /* Configure Sensitivity (Slope Threshold)
-     * This controls how hard you have to shake it.
-     * 0.12 G is a good middle ground. Increase to 0.5 G to make it less sensitive.
-     */
-    sensor_value_from_double(&odr_attr, 0.5);
-    if (sensor_attr_set(imu_dev, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SLOPE_TH, &odr_attr) < 0)
+    bsp_imu_fusion_init(0);
+    bsp_motion_detect_init();
+
+    g_Bsp.imu.isInit = 1;
+
+    return 0;
+}
+
+/**
+ * @brief select which IMU notifications are sent to the central
+ *
+ * @param mask      BSP_IMU_OUT_xxx bits
+ * @param rate_hz   quaternion/euler notify rate, 0 keeps the current one
+ * @return int      0 : OK, -1 : ERROR
+ */
+int bsp_imu_set_output(uint8_t mask, uint8_t rate_hz)
+{
+    if (rate_hz > g_Bsp.imuPwr.odrHz)
     {
-        LOG_ERR("Cannot set slope threshold");
+        LOG_ERR("Fusion rate %d > ODR %d", rate_hz, g_Bsp.imuPwr.odrHz);
         return -1;
     }
 
-    /* Configure Duration (Filter)
-     * Require 1 sample over threshold to trigger (Instant reaction)
-     */
-    odr_attr.val1 = 1;
-    odr_attr.val2 = 0;
-    sensor_attr_set(imu_dev, SENSOR_CHAN_ACCEL_XYZ, SENSOR_ATTR_SLOPE_DUR, &odr_attr);
+    if ((mask & BSP_IMU_OUT_FUSION) && !(g_Bsp.imu.outMask & BSP_IMU_OUT_FUSION))
+    {
+        /* Filter was idle, restart from identity instead of a stale attitude */
+        bsp_imu_fusion_init(0);
+    }
 
-    LOG_INF("IMU (Accel + Gyro) running at 26Hz. Waiting for data...");
+    g_Bsp.imu.outMask = mask;
+    if (rate_hz != 0)
+    {
+        g_Bsp.imu.fusionRateHz = rate_hz;
+    }
+    bsp_settings_touch(BSP_SET_IMU_OUT);
+    bsp_settings_touch(BSP_SET_IMU_FUSION_RATE);
 
-    g_Bsp.imu.isInit = 1;
+    LOG_INF("IMU output mask 0x%02x, fusion rate %d Hz", g_Bsp.imu.outMask, g_Bsp.imu.fusionRateHz);
 
     return 0;
 }
@@ -282,15 +817,23 @@ int bsp_lsm6ds3tr_read(void *p)
     return 0;
 }
 
+#ifndef BSP_IMU_RTIO_ENABLED
 // Helper: Convert Zephyr sensor_value (m/s^2) back to int16 raw-like scale
 // This saves bandwidth. We reverse the driver's conversion essentially.
-static int16_t convert_to_int16(struct sensor_value *val, double scale_factor)
+// Integer only, this runs for every axis of every sample.
+static int16_t convert_to_int16(struct sensor_value *val, int32_t scale_factor)
 {
-    // sensor_value_to_double is a Zephyr helper
-    double real_val = sensor_value_to_double(val);
+    // Example: scale 100 maps 9.81 m/s^2 to 981
+    int64_t scaled = ((int64_t)val->val1 * 1000000 + val->val2) * scale_factor / 1000000;
 
-    // Scale it back up.
-    // Example: If 1G = 9.8m/s^2, and we want 1G = 1000 in our int16, scale = 1000/9.8
-    // Or simpler: Just map m/s^2 directly to int16 with a multiplier (e.g. x100)
-    return (int16_t)(real_val * scale_factor);
+    if (scaled > INT16_MAX)
+    {
+        return INT16_MAX;
+    }
+    if (scaled < INT16_MIN)
+    {
+        return INT16_MIN;
+    }
+    return (int16_t)scaled;
 }
+#endif
@@ -1,5 +1,21 @@
 /*
+    MSM261D PDM microphone, 16 kHz mono, zero-copy block pipeline
 
+    audio thread : dmic_read() -> VAD -> one AUDIO_BLK_ST per attached sink
+    sinks        : BLE stream (here), clip recorder, level meter, event detector,
+                   each on its own msgq
+
+    The DMIC slab blocks are never copied. Every sink queue entry holds a
+    reference, the block goes back to the slab when the last holder calls
+    bsp_audio_block_release(). Gated sinks only get voice blocks (VAD on),
+    so silence costs no airtime. Capture runs while any sink is attached.
+
+    BLE sink : IMA-ADPCM 4:1 -> MTU sized NUS_MSG_NOTIFY_AUDIO frames
+    Frame : SEQ(2) | PRED(2) | INDEX(1) | 4 bit codes, the header carries the
+    encoder state at the first sample so a lost frame does not break the next.
+    As many 10 ms blocks per frame as the negotiated MTU takes (1 block needs
+    ATT MTU 92, 2 blocks 172). Budget : 64 kbps of codes + frame headers.
+    Started/stopped with NUS_MSG_SET_AUDIO_STREAM or cli audio.
 */
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
@@ -11,56 +27,169 @@ LOG_MODULE_REGISTER(audio_mq_app, LOG_LEVEL_INF);
 
 /* --- Configuration --- */
 #define AUDIO_STACK_SIZE 1024
-#define AUDIO_PRIORITY 5
+#define AUDIO_PRIORITY 7     // producer, short work per 10 ms block
+#define AUDIO_BLE_PRIORITY 9 // encoder + notify, below imu_proc
 
-#define PCM_BLOCK_SIZE 320 // 160 samples * 2 bytes
-#define QUEUE_DEPTH 10     // Can hold 10 pending audio buffers
+#define PCM_BLOCK_SIZE (BSP_AUDIO_BLOCK_SAMPLES * 2) // 160 samples * 2 bytes
+#define PCM_BLOCKS 16 // DMIC driver + sink queues
+#define QUEUE_DEPTH 8 // BLE sink
 
-/* 1. Define the Memory Slab (The pool of raw data buffers) */
-K_MEM_SLAB_DEFINE(mem_slab, PCM_BLOCK_SIZE, 12, 4);
+#define AUDIO_HDR_LEN 9 // id + len + seq + pred + index
+#define AUDIO_BLOCK_BYTES (BSP_AUDIO_BLOCK_SAMPLES / 2)
+#define AUDIO_STAT_FRAMES 100 // NUS_MSG_NOTIFY_AUDIO_STAT period
 
-/* 2. Define the Message Queue
- * We are passing pointers (void*), so item_size is sizeof(void*)
- */
-K_MSGQ_DEFINE(audio_mq, sizeof(void *), QUEUE_DEPTH, 4);
+/* The pool of raw data buffers, filled by the DMIC driver */
+K_MEM_SLAB_DEFINE(mem_slab, PCM_BLOCK_SIZE, PCM_BLOCKS, 4);
+
+/* BLE sink queue, AUDIO_BLK_ST by value (pointer + flags) */
+K_MSGQ_DEFINE(audio_ble_mq, sizeof(AUDIO_BLK_ST), QUEUE_DEPTH, 4);
+
+/* Producer sleeps here while no sink is attached */
+K_SEM_DEFINE(audio_run_sem, 0, 1);
+
+K_MUTEX_DEFINE(audio_mutex);
 
 const struct device *dmic_dev;
 
+extern BSP_ST g_Bsp;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint16_t seq;
+    int16_t pred; // encoder state at the first sample of this frame
+    uint8_t index;
+    uint8_t data[BSP_AUDIO_MAX_BLOCKS_PER_FRAME * AUDIO_BLOCK_BYTES];
+} audio_packet_t;
+
+typedef struct PACKED
+{
+    uint16_t id;
+    uint16_t len; // total length of message includes id + len
+
+    uint32_t blocks;
+    uint32_t dropped;
+    uint32_t gated;
+    uint32_t budgetBps;
+    uint32_t actualBps;
+} audio_stat_packet_t;
+
+typedef struct
+{
+    struct k_msgq *q; // NULL : detached
+    bool gated;
+    bool open; // last block passed the gate
+} audio_sink_t;
+
+static audio_sink_t m_sink[BSP_AUDIO_SINKS];
+static atomic_t m_ref[PCM_BLOCKS];
+
+/* Counted from the audio and BLE sink threads, g_Bsp.audio is packed so they
+   live here and bsp_audio_get_stat() copies them out */
+static atomic_t m_blocks;
+static atomic_t m_dropped;
+static atomic_t m_gated;
+
+static volatile bool m_running = false; // DMIC triggered
+static volatile bool m_configured = false;
+static volatile bool m_restart = false; // BLE sink drops its partial frame and encoder state
+static volatile uint8_t m_vad = 0;
+
+static atomic_t *audio_block_ref(void *pcm)
+{
+    return &m_ref[((char *)pcm - mem_slab.buffer) / PCM_BLOCK_SIZE];
+}
+
+/**
+ * @brief drop one reference, the last one frees the slab block
+ *
+ * @param pcm AUDIO_BLK_ST.pcm
+ */
+void bsp_audio_block_release(void *pcm)
+{
+    if (atomic_dec(audio_block_ref(pcm)) == 1)
+    {
+        k_mem_slab_free(&mem_slab, pcm);
+    }
+}
+
+/**
+ * @brief hand one block to every attached sink, no copy
+ *
+ * @param blk   block, the caller keeps its own reference
+ */
+static void audio_dispatch(AUDIO_BLK_ST *blk)
+{
+    for (int i = 0; i < BSP_AUDIO_SINKS; i++)
+    {
+        audio_sink_t *s = &m_sink[i];
+        struct k_msgq *q = s->q;
+        bool pass;
+
+        if (q == NULL)
+        {
+            continue;
+        }
+
+        pass = !s->gated || blk->voice;
+        blk->start = pass && !s->open;
+        s->open = pass;
+        if (!pass)
+        {
+            if (i == BSP_AUDIO_SINK_BLE)
+            {
+                atomic_inc(&m_gated);
+            }
+            continue;
+        }
+
+        atomic_inc(audio_block_ref(blk->pcm));
+        if (k_msgq_put(q, blk, K_NO_WAIT) != 0)
+        {
+            /* Sink is behind, drop rather than stall the DMIC */
+            atomic_inc(&m_dropped);
+            bsp_audio_block_release(blk->pcm);
+        }
+    }
+}
+
 /* --- The Audio Thread (Producer) --- */
 static void audio_thread_entry(void *p1, void *p2, void *p3)
 {
+    AUDIO_BLK_ST blk;
     void *buffer;
-    uint32_t size;
+    size_t size;
     int ret;
 
-    if (!device_is_ready(dmic_dev))
-        return;
-
     LOG_INF("Audio Producer Thread Started");
 
     while (1)
     {
-        /* Read from hardware (Blocking) */
-        ret = dmic_read(
-            dmic_dev, 0, &buffer, &size, K_FOREVER);
-
-        if (ret == 0)
+        if (!m_running)
         {
-            /* Send the POINTER to the main thread via Queue.
-             * K_NO_WAIT: If the queue is full (Main thread is stuck),
-             * we drop the packet immediately to keep the hardware running.
-             */
-            ret = k_msgq_put(&audio_mq, &buffer, K_NO_WAIT);
+            k_sem_take(&audio_run_sem, K_FOREVER);
+            continue;
+        }
 
-            if (ret != 0)
-            {
-                LOG_WRN("Queue full! Dropping audio packet.");
-                /* CRITICAL: If we don't send it, WE must free it here
-                 * or we run out of memory.
-                 */
-                k_mem_slab_free(&mem_slab, &buffer);
-            }
+        /* Read from hardware (Blocking), timeout so a stop is noticed */
+        ret = dmic_read(dmic_dev, 0, &buffer, &size, 100);
+        if (ret != 0)
+        {
+            continue;
         }
+
+        /* Producer reference, held over the dispatch */
+        atomic_set(audio_block_ref(buffer), 1);
+        atomic_inc(&m_blocks);
+
+        blk.pcm = buffer;
+        blk.ts = (uint32_t)bsp_time_us();
+        blk.voice = m_vad ? bsp_audio_vad_process((const int16_t *)buffer, BSP_AUDIO_BLOCK_SAMPLES) : 1;
+        audio_dispatch(&blk);
+
+        bsp_audio_block_release(buffer);
     }
 }
 
@@ -69,18 +198,228 @@ K_THREAD_DEFINE(audio_tid, AUDIO_STACK_SIZE,
                 audio_thread_entry, NULL, NULL, NULL,
                 AUDIO_PRIORITY, 0, 0);
 
-/* --- The Main Thread (Consumer) --- */
+/**
+ * @brief run the DMIC while any sink is attached, audio_mutex held
+ *
+ * @return int  0 : OK, -1 : ERROR
+ */
+static int audio_capture_update(void)
+{
+    bool need = false;
+
+    for (int i = 0; i < BSP_AUDIO_SINKS; i++)
+    {
+        need |= (m_sink[i].q != NULL);
+    }
+    if (need == m_running)
+    {
+        return 0;
+    }
+
+    if (need)
+    {
+        if (dmic_trigger(dmic_dev, DMIC_TRIGGER_START) < 0)
+        {
+            LOG_ERR("DMIC start failed");
+            return -1;
+        }
+        m_running = true;
+        k_sem_give(&audio_run_sem);
+    }
+    else
+    {
+        m_running = false;
+        dmic_trigger(dmic_dev, DMIC_TRIGGER_STOP);
+    }
+    LOG_INF("DMIC %s", need ? "started" : "stopped");
+
+    return 0;
+}
+
+/**
+ * @brief attach a sink queue, capture starts with the first sink
+ *
+ * @param sink  BSP_AUDIO_SINK_xxx
+ * @param q     msgq of AUDIO_BLK_ST, the sink releases every block it gets
+ * @param gated 1 : voice blocks only (when the VAD is on)
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_audio_sink_attach(uint8_t sink, struct k_msgq *q, uint8_t gated)
+{
+    int ret;
+
+    if (sink >= BSP_AUDIO_SINKS || q == NULL || !m_configured)
+    {
+        LOG_ERR("DMIC not ready");
+        return -1;
+    }
+
+    k_mutex_lock(&audio_mutex, K_FOREVER);
+    m_sink[sink].gated = gated;
+    m_sink[sink].open = false;
+    m_sink[sink].q = q;
+    ret = audio_capture_update();
+    if (ret < 0)
+    {
+        m_sink[sink].q = NULL;
+    }
+    k_mutex_unlock(&audio_mutex);
+
+    return ret;
+}
+
+/**
+ * @brief detach a sink, blocks still queued to it are released
+ *
+ * @param sink  BSP_AUDIO_SINK_xxx
+ */
+void bsp_audio_sink_detach(uint8_t sink)
+{
+    struct k_msgq *q;
+    AUDIO_BLK_ST blk;
+
+    if (sink >= BSP_AUDIO_SINKS)
+    {
+        return;
+    }
+
+    k_mutex_lock(&audio_mutex, K_FOREVER);
+    q = m_sink[sink].q;
+    m_sink[sink].q = NULL;
+    audio_capture_update();
+    k_mutex_unlock(&audio_mutex);
+
+    while (q != NULL && k_msgq_get(q, &blk, K_NO_WAIT) == 0)
+    {
+        bsp_audio_block_release(blk.pcm);
+    }
+}
+
+static void audio_stat_notify(void)
+{
+    audio_stat_packet_t packet;
+    AUDIO_STAT_ST st;
+
+    bsp_audio_get_stat(&st);
+
+    packet.id = NUS_MSG_NOTIFY_AUDIO_STAT;
+    packet.len = sizeof(packet);
+    packet.blocks = st.blocks;
+    packet.dropped = st.dropped;
+    packet.gated = st.gated;
+    packet.budgetBps = st.budgetBps;
+    packet.actualBps = st.actualBps;
+
+    ble_nus_send_frame((const uint8_t *)&packet, sizeof(packet));
+}
+
+/**
+ * @brief start/stop microphone streaming over NUS
+ *
+ * @param on    1 : start, 0 : stop
+ * @param vad   1 : send voice blocks only
+ * @return int  0 : OK, -1 : ERROR
+ */
+int bsp_audio_stream(uint8_t on, uint8_t vad)
+{
+    if (!m_configured)
+    {
+        LOG_ERR("DMIC not ready");
+        return -1;
+    }
+    if (on && g_Bsp.audio.running)
+    {
+        return 0;
+    }
+
+    if (on)
+    {
+        int bpf = (ble_nus_get_payload_len() - AUDIO_HDR_LEN) / AUDIO_BLOCK_BYTES;
+
+        if (bpf < 1)
+        {
+            LOG_ERR("MTU too small for audio");
+            return -1;
+        }
+        g_Bsp.audio.blocksPerFrame = MIN(bpf, BSP_AUDIO_MAX_BLOCKS_PER_FRAME);
+        g_Bsp.audio.startMs = k_uptime_get();
+        atomic_set(&m_blocks, 0);
+        atomic_set(&m_dropped, 0);
+        atomic_set(&m_gated, 0);
+        g_Bsp.audio.voiceBlocks = 0;
+        g_Bsp.audio.frames = 0;
+        g_Bsp.audio.bytes = 0;
+        g_Bsp.audio.vad = vad;
+        bsp_audio_vad_reset();
+        m_vad = vad;
+        m_restart = true;
+
+        if (bsp_audio_sink_attach(BSP_AUDIO_SINK_BLE, &audio_ble_mq, vad) < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        bsp_audio_sink_detach(BSP_AUDIO_SINK_BLE);
+    }
+
+    g_Bsp.audio.running = on;
+    LOG_INF("Audio stream %s, vad %d, %d blocks/frame", on ? "started" : "stopped", vad,
+            g_Bsp.audio.blocksPerFrame);
+
+    if (!on)
+    {
+        audio_stat_notify();
+    }
+
+    return 0;
+}
+
+/**
+ * @brief streaming counters, rates over the time since start
+ *
+ * @param st copy destination
+ */
+void bsp_audio_get_stat(AUDIO_STAT_ST *st)
+{
+    uint32_t ms = (uint32_t)(k_uptime_get() - g_Bsp.audio.startMs);
+
+    *st = g_Bsp.audio;
+    st->blocks = (uint32_t)atomic_get(&m_blocks);
+    st->dropped = (uint32_t)atomic_get(&m_dropped);
+    st->gated = (uint32_t)atomic_get(&m_gated);
+
+    /* Budget : 4 bit codes at the sample rate plus one header per frame */
+    st->budgetBps = BSP_AUDIO_RATE_HZ * 4;
+    if (st->blocksPerFrame)
+    {
+        st->budgetBps += (BSP_AUDIO_RATE_HZ / BSP_AUDIO_BLOCK_SAMPLES) * AUDIO_HDR_LEN * 8 / st->blocksPerFrame;
+    }
+    st->actualBps = (ms > 0) ? (uint32_t)((uint64_t)st->bytes * 8 * 1000 / ms) : 0;
+}
+
+/* --- BLE sink (Consumer) --- */
 static int audio_push_thread(void)
 {
-    void *pcm_buffer;
+    static audio_packet_t packet;
+    ADPCM_STATE_ST enc = {0};
+    AUDIO_BLK_ST blk;
+    int nblk = 0;
+    int bpf = 1;
 
     dmic_dev = DEVICE_DT_GET(DT_NODELABEL(pdm0));
     if (!device_is_ready(dmic_dev))
+    {
+        LOG_ERR("DMIC device not ready");
         return 0;
+    }
 
     /* DMIC Config */
     struct pcm_stream_cfg stream_cfg = {
+        .pcm_rate = BSP_AUDIO_RATE_HZ,
         .pcm_width = 16,
+        .block_size = PCM_BLOCK_SIZE,
         .mem_slab = &mem_slab,
     };
     struct dmic_cfg cfg = {
@@ -93,31 +432,67 @@ static int audio_push_thread(void)
         },
     };
 
-    dmic_configure(dmic_dev, &cfg);
-    dmic_trigger(dmic_dev, DMIC_TRIGGER_START);
-
-    LOG_INF("Main Thread waiting for audio...");
+    if (dmic_configure(dmic_dev, &cfg) < 0)
+    {
+        LOG_ERR("DMIC configure failed");
+        return 0;
+    }
+    m_configured = true;
 
     while (1)
     {
-        /* 3. Wait for a message in the queue
-         * This sleeps the main thread until audio arrives.
-         */
-        if (k_msgq_get(&audio_mq, &pcm_buffer, K_FOREVER) == 0)
+        if (k_msgq_get(&audio_ble_mq, &blk, K_FOREVER) != 0)
+        {
+            continue;
+        }
+
+        /* New stream or speech after a gap, a partial frame would splice audio */
+        if (m_restart)
+        {
+            m_restart = false;
+            enc.predictor = 0;
+            enc.index = 0;
+            nblk = 0;
+        }
+        else if (blk.start)
+        {
+            nblk = 0;
+        }
+
+        if (nblk == 0)
         {
+            bpf = g_Bsp.audio.blocksPerFrame;
+            packet.pred = enc.predictor;
+            packet.index = enc.index;
+        }
+        bsp_adpcm_encode(&enc, (const int16_t *)blk.pcm, BSP_AUDIO_BLOCK_SAMPLES,
+                         &packet.data[nblk * AUDIO_BLOCK_BYTES]);
 
-            /* --- PROCESS DATA HERE --- */
-            int16_t *samples = (int16_t *)pcm_buffer;
+        bsp_audio_block_release(blk.pcm);
 
-            // Example: Check first sample
-            LOG_INF("Received Audio! Sample[0]: %d", samples[0]);
+        if (++nblk < bpf)
+        {
+            continue;
+        }
+        nblk = 0;
 
-            /* Example: Send to BLE or write to Flash here */
+        packet.id = NUS_MSG_NOTIFY_AUDIO;
+        packet.len = AUDIO_HDR_LEN + bpf * AUDIO_BLOCK_BYTES;
+        packet.seq = g_Bsp.audio.frames;
+
+        /* No retry, late audio is useless, the gap shows in SEQ */
+        if (ble_nus_send_frame((const uint8_t *)&packet, packet.len) == 0)
+        {
+            g_Bsp.audio.bytes += packet.len;
+        }
+        else
+        {
+            atomic_add(&m_dropped, bpf);
+        }
 
-            /* 4. CRITICAL: Free the buffer
-             * The Audio Thread allocated it, we are responsible for cleaning it up.
-             */
-            k_mem_slab_free(&mem_slab, &pcm_buffer);
+        if (++g_Bsp.audio.frames % AUDIO_STAT_FRAMES == 0)
+        {
+            audio_stat_notify();
         }
     }
     return 0;
@@ -125,4 +500,4 @@ static int audio_push_thread(void)
 
 K_THREAD_DEFINE(audio_pusht, AUDIO_STACK_SIZE,
                 audio_push_thread, NULL, NULL, NULL,
-                AUDIO_PRIORITY, 0, 0);
+                AUDIO_BLE_PRIORITY, 0, 0);
@@ -1,15 +1,14 @@
 /*
 
 */
-#include <zephyr/drivers/i2c.h>
 #include "bsp.h"
 
-#define I2C_NODE DT_NODELABEL(pcf8563)
-static const struct i2c_dt_spec dev_i2c = I2C_DT_SPEC_GET(I2C_NODE);
+/* All bus access goes through the I2C manager (RTC lane), see bsp_i2c_mgr.c */
 
 LOG_MODULE_REGISTER(rtc_pcf8563, LOG_LEVEL_INF);
 
 /* PCF8563 Register Map */
+#define PCF8563_REG_CTRL2 0x01
 #define PCF8563_REG_SEC 0x02
 #define PCF8563_REG_MIN 0x03
 #define PCF8563_REG_HOUR 0x04
@@ -17,6 +16,20 @@ LOG_MODULE_REGISTER(rtc_pcf8563, LOG_LEVEL_INF);
 #define PCF8563_REG_WEEKDAY 0x06
 #define PCF8563_REG_MON 0x07
 #define PCF8563_REG_YEAR 0x08
+#define PCF8563_REG_ALARM_MIN 0x09
+#define PCF8563_REG_CLKOUT 0x0D
+#define PCF8563_REG_TIMER_CTRL 0x0E
+#define PCF8563_REG_TIMER 0x0F
+
+/* Control_status_2 bits, flags are cleared by writing 0 */
+#define PCF8563_CTRL2_TIE 0x01
+#define PCF8563_CTRL2_AIE 0x02
+#define PCF8563_CTRL2_TF 0x04
+#define PCF8563_CTRL2_AF 0x08
+
+#define PCF8563_ALARM_OFF 0x80 // AE bit, alarm register not compared
+#define PCF8563_TIMER_TE 0x80
+#define PCF8563_CLKOUT_FE 0x80
 
 /* BCD Conversion Helpers */
 static uint8_t dec_to_bcd(uint8_t val)
@@ -29,6 +42,18 @@ static uint8_t bcd_to_dec(uint8_t val)
     return ((val >> 4) * 10) + (val & 0x0F);
 }
 
+static int pcf8563_read(uint8_t reg, uint8_t *val)
+{
+    return bsp_i2c_write_read(BSP_I2C_DEV_RTC, &reg, 1, val, 1);
+}
+
+static int pcf8563_write(uint8_t reg, uint8_t val)
+{
+    uint8_t buf[2] = {reg, val};
+
+    return bsp_i2c_write(BSP_I2C_DEV_RTC, buf, sizeof(buf));
+}
+
 /* In main() check: */
 // if (!device_is_ready(dev_i2c.bus))
 // {
@@ -57,7 +82,7 @@ int bsp_rtc_set_time(RTC_TIME_ST *time)
     buffer[6] = dec_to_bcd(time->mon);
     buffer[7] = dec_to_bcd(time->year);
 
-    return i2c_write_dt(&dev_i2c, buffer, sizeof(buffer));
+    return bsp_i2c_write(BSP_I2C_DEV_RTC, buffer, sizeof(buffer));
 }
 
 /* * FUNCTION: Get Time
@@ -70,7 +95,7 @@ int bsp_rtc_get_time(RTC_TIME_ST *time)
 
     // Write the register address we want to start reading from
     // Then restart and read 7 bytes
-    int ret = i2c_write_read_dt(&dev_i2c, &start_addr, 1, regs, sizeof(regs));
+    int ret = bsp_i2c_write_read(BSP_I2C_DEV_RTC, &start_addr, 1, regs, sizeof(regs));
     if (ret != 0)
     {
         return ret;
@@ -87,3 +112,114 @@ int bsp_rtc_get_time(RTC_TIME_ST *time)
 
     return 0;
 }
+
+/**
+ * @brief daily alarm on INT at hour:min, AF stays set until bsp_rtc_get_irq
+ *
+ * @param hour      0..23, < 0 : alarm off
+ * @param min       0..59
+ * @return int      0 : OK, non-zero : ERROR
+ */
+int bsp_rtc_set_alarm(int8_t hour, int8_t min)
+{
+    uint8_t buf[5];
+    uint8_t ctrl;
+    int ret;
+
+    buf[0] = PCF8563_REG_ALARM_MIN;
+    buf[1] = (hour < 0) ? PCF8563_ALARM_OFF : dec_to_bcd(min);
+    buf[2] = (hour < 0) ? PCF8563_ALARM_OFF : dec_to_bcd(hour);
+    buf[3] = PCF8563_ALARM_OFF; // any day
+    buf[4] = PCF8563_ALARM_OFF; // any weekday
+
+    ret = bsp_i2c_write(BSP_I2C_DEV_RTC, buf, sizeof(buf));
+    if (ret == 0)
+    {
+        ret = pcf8563_read(PCF8563_REG_CTRL2, &ctrl);
+    }
+    if (ret == 0)
+    {
+        /* Writing 1 leaves a flag alone : TF stays pending, a stale AF is dropped */
+        ctrl = (ctrl & PCF8563_CTRL2_TIE) | PCF8563_CTRL2_TF;
+        ctrl |= (hour < 0) ? 0 : PCF8563_CTRL2_AIE;
+        ret = pcf8563_write(PCF8563_REG_CTRL2, ctrl);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief repeating countdown timer on INT
+ *
+ * @param freq      timer source, BSP_RTC_TIMER_xxx
+ * @param count     periods of the source, 0 : timer off
+ * @return int      0 : OK, non-zero : ERROR
+ */
+int bsp_rtc_set_timer(uint8_t freq, uint8_t count)
+{
+    uint8_t ctrl;
+    int ret;
+
+    /* Stop before loading, the count is reloaded on every expiry */
+    ret = pcf8563_write(PCF8563_REG_TIMER_CTRL, freq & 0x03);
+    if (ret == 0 && count)
+    {
+        ret = pcf8563_write(PCF8563_REG_TIMER, count);
+    }
+    if (ret == 0 && count)
+    {
+        ret = pcf8563_write(PCF8563_REG_TIMER_CTRL, PCF8563_TIMER_TE | (freq & 0x03));
+    }
+    if (ret == 0)
+    {
+        ret = pcf8563_read(PCF8563_REG_CTRL2, &ctrl);
+    }
+    if (ret == 0)
+    {
+        /* AF stays pending, a stale TF is dropped */
+        ctrl = (ctrl & PCF8563_CTRL2_AIE) | PCF8563_CTRL2_AF;
+        ctrl |= count ? PCF8563_CTRL2_TIE : 0;
+        ret = pcf8563_write(PCF8563_REG_CTRL2, ctrl);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief read and clear the alarm/timer flags, releases INT
+ *
+ * @param flags     out, BSP_RTC_IRQ_ALARM | BSP_RTC_IRQ_TIMER
+ * @return int      0 : OK, non-zero : ERROR
+ */
+int bsp_rtc_get_irq(uint8_t *flags)
+{
+    uint8_t ctrl;
+    int ret = pcf8563_read(PCF8563_REG_CTRL2, &ctrl);
+
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    *flags = ((ctrl & PCF8563_CTRL2_AF) ? BSP_RTC_IRQ_ALARM : 0) | ((ctrl & PCF8563_CTRL2_TF) ? BSP_RTC_IRQ_TIMER : 0);
+    if (*flags)
+    {
+        /* 0 clears the flags we read set, 1 leaves alone one that got set since the read */
+        ret = pcf8563_write(PCF8563_REG_CTRL2, (ctrl & (PCF8563_CTRL2_AIE | PCF8563_CTRL2_TIE)) |
+                                                   (~ctrl & (PCF8563_CTRL2_AF | PCF8563_CTRL2_TF)));
+    }
+
+    return ret;
+}
+
+/**
+ * @brief CLKOUT pin, 32768 Hz after power up, off saves the RTC a few uA
+ *
+ * @param on        1 : output on
+ * @param freq      0 : 32768 Hz, 1 : 1024 Hz, 2 : 32 Hz, 3 : 1 Hz
+ * @return int      0 : OK, non-zero : ERROR
+ */
+int bsp_rtc_set_clkout(uint8_t on, uint8_t freq)
+{
+    return pcf8563_write(PCF8563_REG_CLKOUT, (on ? PCF8563_CLKOUT_FE : 0) | (freq & 0x03));
+}
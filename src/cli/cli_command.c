@@ -82,18 +82,18 @@ static CliJte cliCommandTable[] =
 
         /** Periodic Task **/
         {"prd_set",
-         "prd_set 1000 // set 1000ms periodic task",
-         "Set PRD task period in ms",
+         "prd_set 1000 [job] // job period in ms (default job 0, heartbeat), 0 : off",
+         "Set PRD job period in ms",
          CLI_CMD_PRD_SET_TICK,
-         2,
+         -1,
          NULL,
          0,
          &cliCommandInterpreter},
         {"prd_get",
-         "prd_get",
-         "Get PRD task period in ms",
+         "prd_get [reset] // jobs, periods, jitter / run time / overruns",
+         "Get PRD jobs and stats",
          CLI_CMD_PRD_GET_TICK,
-         1,
+         -1,
          NULL,
          0,
          &cliCommandInterpreter},
@@ -183,7 +183,7 @@ static CliJte cliCommandTable[] =
          &cliCommandInterpreter},
          {"nvs_get",
          NULL,
-         "NVS Read",
+         "Settings keys and flush stats",
          CLI_CMD_NVS_GET,
          1,
          NULL,
@@ -191,12 +191,44 @@ static CliJte cliCommandTable[] =
          &cliCommandInterpreter},
          {"nvs_set",
          NULL,
-         "NVS write info",
+         "Flush dirty settings now",
          CLI_CMD_NVS_SET,
          1,
          NULL,
          0,
          &cliCommandInterpreter},
+         {"nvs_stat",
+         "nvs_stat [reset] // free space, GC, write / GC latency histograms, life estimate",
+         "NVS wear and latency",
+         CLI_CMD_NVS_STAT,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+         {"ret",
+         NULL,
+         "Retained RAM : boot count, reset cause, this / previous run counters, last fault",
+         CLI_CMD_RET,
+         1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+         {"evq",
+         "evq [reset | ping 100] // event queue latency, run time, stack; ping : 100 probes 10 ms apart",
+         "Event queue stats",
+         CLI_CMD_EVQ,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+         {"reboot",
+         NULL,
+         "Clean shutdown (retained block and settings to NVS) and reset",
+         CLI_CMD_REBOOT,
+         1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
          {"nvs_reset",
          NULL,
          "NVS reset so clear NVS",
@@ -213,6 +245,151 @@ static CliJte cliCommandTable[] =
          NULL,
          0,
          &cliCommandInterpreter},
+        //////////////////////////////////////////////////////
+        {"imu_out",
+         "imu_out 6 5 // mask(1:raw 2:quat 4:euler 8:motion 16:vib 32:class) fusion rate hz",
+         "Set IMU notify outputs and fusion rate",
+         CLI_CMD_IMU_OUTPUT,
+         3,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"imu_ring",
+         "imu_ring [reset]",
+         "Show IMU ring counters, reset clears overflow/high-water",
+         CLI_CMD_IMU_RING,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"motion",
+         "motion 800 300 250 800 // tap ff step shake thr in m/s^2 x100, 0 keeps",
+         "Set motion event thresholds and show counters",
+         CLI_CMD_MOTION_THR,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"imu_bench",
+         "imu_bench [reset]",
+         "Show IMU acquisition CPU time/latency per sample",
+         CLI_CMD_IMU_BENCH,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"imu_mode",
+         "imu_mode 1 26 10000 // mode(0:continuous 1:wake-on-motion) odr hz, idle ms, 0 keeps",
+         "Set IMU power mode and show time per state",
+         CLI_CMD_IMU_MODE,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"imu_cal",
+         "imu_cal 0 // 0:gyro 1..6:+x -x +y -y +z -z up 7:save 8:abort 9:clear",
+         "Run IMU calibration step and show stored calibration",
+         CLI_CMD_IMU_CAL,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"vib",
+         "vib 256 // window samples, power of 2 (imu_out 16 enables)",
+         "Set vibration window and show last features",
+         CLI_CMD_VIB,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"ml",
+         "ml [reset] // imu_out 32 enables",
+         "Show classifier model, latency and arena use",
+         CLI_CMD_ML,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"imu_hist",
+         "imu_hist 10000 0 // send from..to ms ago over bulk, no args shows fill",
+         "Show IMU history buffer, stream a time range to the central",
+         CLI_CMD_IMU_HIST,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"decim",
+         "decim 0 50 // sub(0:raw notify 1:history) rate hz, 0 off, 65535 full ODR",
+         "Set decimation bank output rate and show subscribers",
+         CLI_CMD_DECIM,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"audio",
+         "audio 1 1 // 1 start, 0 stop, [vad 1 : voice only], no arg : stats",
+         "Microphone IMA-ADPCM streaming over NUS",
+         CLI_CMD_AUDIO,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"slm",
+         "slm 1000 // report interval ms, 0 off, no arg : last levels",
+         "Sound level meter, LAeq / peak / octave bands in dB SPL",
+         CLI_CMD_SLM,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"clip",
+         "clip arm 2000 3000 | clip off | clip trig | clip get 3 // get 0 lists",
+         "Pre-trigger audio clips on QSPI flash",
+         CLI_CMD_CLIP,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"aed",
+         "aed 1 8 50 3100 960 // on, impulse thr, tone %, up to 4 tone hz",
+         "Acoustic event detector (knock, clap, alarm tone)",
+         CLI_CMD_AED,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"wall",
+         "wall [sync] // RTC disciplined wall clock, sync : resync now",
+         "Wall clock status",
+         CLI_CMD_WALL,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"rsched",
+         "rsched [alarm 7 30 1 | every 600 1] // hour (-1 off) min act, sec (0 off) act",
+         "RTC alarm / timer jobs",
+         CLI_CMD_RSCHED,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"i2c",
+         "i2c [reset] // per device queue wait / bus time on i2c1",
+         "I2C manager stats",
+         CLI_CMD_I2C,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
+        {"tslog",
+         "tslog [mask 0x6e | flush | get 0 0] // record types, program staged records, stream from..to epoch ms",
+         "Time-series log on QSPI flash",
+         CLI_CMD_TSLOG,
+         -1,
+         NULL,
+         0,
+         &cliCommandInterpreter},
 };
 
 void cliCommandsInitialise(void)
@@ -274,7 +451,7 @@ static Bool cliCommandInterpreter(int command, int argc, char **argv)
     date.min = min;
     date.sec = sec;
 
-    bsp_rtc_set_time(&date);
+    bsp_wall_set_time(&date);
 #endif
 
     CLI_PRINT("RTC Set %04d-%02d-%02d, %02d:%02d:%02d\n", year, mon, day, hour, min, sec);
@@ -284,7 +461,10 @@ static Bool cliCommandInterpreter(int command, int argc, char **argv)
 #if 1
     RTC_TIME_ST gdate = {0};
 
-    bsp_rtc_get_time(&gdate);
+    if (bsp_wall_get_time(&gdate) != 0)
+    {
+      bsp_rtc_get_time(&gdate); // not synced yet
+    }
     CLI_PRINT("RTC Get 20%02d-%02d-%02d, %02d:%02d:%02d\n", gdate.year, gdate.mon, gdate.day, gdate.hour, gdate.min, gdate.sec);
 #endif
     break;
@@ -293,12 +473,32 @@ static Bool cliCommandInterpreter(int command, int argc, char **argv)
   /********************************************************/
   //  PRD Command
   case CLI_CMD_PRD_SET_TICK:
-    g_Bsp.prdTick = atoi(argv[1]);
-    CLI_PRINT("Periodic tick set to %d ms", g_Bsp.prdTick);
+    if (argc < 2)
+    {
+      result = FALSE;
+      break;
+    }
+    u32 = (uint32_t)atoi(argv[1]);
+    if (bsp_prd_set_period((argc > 2) ? (uint8_t)atoi(argv[2]) : BSP_PRD_JOB_HEARTBEAT, u32) == 0)
+    {
+      CLI_PRINT("Periodic job set to %d ms\n", (int)u32);
+    }
     break;
 
   case CLI_CMD_PRD_GET_TICK:
+    CLI_PRINT("job %-10s %8s %8s %6s %14s %14s\n", "", "ms", "runs", "over", "jitter avg/max", "run avg/max");
+    for (int j = 0; j < BSP_PRD_JOBS; j++)
+    {
+      PRD_JOB_STAT_ST *pst = &g_Bsp.prdStat[j];
 
+      CLI_PRINT("%d   %-10s %8d %8d %6d %6d/%-7d %6d/%-7d\n", j, bsp_prd_name(j), g_Bsp.prdPeriodMs[j], pst->runs,
+                pst->overruns, pst->jitAvgUs, pst->jitMaxUs, pst->runAvgUs, pst->runMaxUs);
+    }
+    CLI_PRINT("batt %d mV (raw %d, %d samples)\n", g_Bsp.batt_adc.mv, g_Bsp.batt_adc.value, g_Bsp.batt_adc.samples);
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+      bsp_prd_reset_stat();
+    }
     break;
 #endif
 #if 0
@@ -362,13 +562,100 @@ static Bool cliCommandInterpreter(int command, int argc, char **argv)
     break;
 
   case CLI_CMD_NVS_GET:
-    bsp_nvs_read(&g_Bsp.nvs);
-    CLI_PRINT("NVS read");
+    for (int k = 0; k < BSP_SET_KEYS; k++)
+    {
+      CLI_PRINT("%-12s %s\n", bsp_settings_name(k), (bsp_settings_dirty() & BIT(k)) ? "dirty" : "stored");
+    }
+    CLI_PRINT("boot %d, prd tick %d ms, %d/%d keys found at boot\n", g_Bsp.nvs.boot_count, g_Bsp.prdTick,
+              g_Bsp.settings.stored, g_Bsp.settings.keys);
+    CLI_PRINT("flushes %d, writes %d, deferred %d ms, errors %d\n", g_Bsp.settings.flushes, g_Bsp.settings.writes,
+              g_Bsp.settings.deferredMs, g_Bsp.settings.errors);
     break;
 
   case CLI_CMD_NVS_SET:
-    bsp_nvs_write(&g_Bsp.nvs);
-    CLI_PRINT("NVS write");
+    CLI_PRINT("NVS write, %d keys\n", bsp_settings_flush());
+    break;
+
+  case CLI_CMD_NVS_STAT:
+#if 1
+    NVS_STAT_ST *nst = &g_Bsp.nvsStat;
+
+    bsp_nvs_update_stat();
+    CLI_PRINT("%d x %d B sectors, free %d B\n", nst->sectors, nst->sectorSize, nst->freeBytes);
+    CLI_PRINT("writes %d, GC %d (lifetime erases %d), life %d.%d %%, ~%u days at this rate\n", nst->writes, nst->gcs,
+              nst->erases, nst->lifePermille / 10, nst->lifePermille % 10, nst->lifeDays);
+    CLI_PRINT("max write %d us, max GC %d us\n", nst->wrMaxUs, nst->gcMaxUs);
+    CLI_PRINT("   < us    write       GC\n");
+    for (int i = 0; i < BSP_NVS_HIST_BINS; i++)
+    {
+      if (i < BSP_NVS_HIST_BINS - 1)
+      {
+        CLI_PRINT("%7d %8d %8d\n", BSP_NVS_HIST_BASE_US << i, nst->wrHist[i], nst->gcHist[i]);
+      }
+      else
+      {
+        CLI_PRINT("%7s %8d %8d\n", "more", nst->wrHist[i], nst->gcHist[i]);
+      }
+    }
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+      bsp_nvs_reset_stat();
+    }
+#endif
+    break;
+
+  case CLI_CMD_RET:
+#if 1
+    RETAINED_ST ret;
+
+    bsp_retained_get(&ret);
+    CLI_PRINT("boot %d, reset cause 0x%x, up %d s (%d s before), faults %d\n", ret.bootCount, ret.resetCause,
+              ret.run.uptimeS, ret.totalUptimeS, ret.faults);
+    for (int i = 0; i < 2; i++)
+    {
+      RET_RUN_ST *r = i ? &ret.prev : &ret.run;
+
+      CLI_PRINT("%s : up %d s, ble tx %d (err %d, %d B), drops audio %d imu %d tslog %d i2c %d, nvs gc %d\n",
+                i ? "prev" : "this", r->uptimeS, r->bleTx, r->bleTxErr, r->bleTxBytes, r->audioDropped,
+                r->imuOverflow, r->tslogDropped, r->i2cFull, r->nvsGcs);
+    }
+    if (ret.faults)
+    {
+      CLI_PRINT("last fault : boot %d at %d s, reason %d, pc 0x%08x, lr 0x%08x, thread %s\n", ret.fault.bootCount,
+                ret.fault.uptimeS, ret.fault.reason, ret.fault.pc, ret.fault.lr, ret.fault.thread);
+    }
+#endif
+    break;
+
+  case CLI_CMD_EVQ:
+    if (argc > 2 && strcmp(argv[1], "ping") == 0)
+    {
+      for (int i = 0; i < atoi(argv[2]); i++)
+      {
+        bsp_evq_post(BSP_EVT_PING);
+        k_msleep(10);
+      }
+    }
+    bsp_evq_update_stat();
+    CLI_PRINT("stack %d B, %d used, main stack %d B, %d used\n", g_Bsp.evq.stackSize, g_Bsp.evq.stackUsed,
+              g_Bsp.evq.mainStackSize, g_Bsp.evq.mainStackUsed);
+    CLI_PRINT("%-8s %8s %8s %14s %8s\n", "event", "posted", "runs", "lat avg/max us", "run max");
+    for (int e = 0; e < BSP_EVTS; e++)
+    {
+      EVQ_EVT_STAT_ST *est = &g_Bsp.evq.evt[e];
+
+      CLI_PRINT("%-8s %8d %8d %6d/%-7d %8d\n", bsp_evq_name(e), est->posted, est->runs, est->latAvgUs, est->latMaxUs,
+                est->runMaxUs);
+    }
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+      bsp_evq_reset_stat();
+    }
+    break;
+
+  case CLI_CMD_REBOOT:
+    CLI_PRINT("Rebooting\n");
+    bsp_retained_shutdown();
     break;
 
   case CLI_CMD_NVS_RESET:
@@ -383,6 +670,291 @@ static Bool cliCommandInterpreter(int command, int argc, char **argv)
     CLI_PRINT("Buzzer freq : %d hz, duration : %d ms\n", (int)u32, (int)duration);
     break;
 
+  case CLI_CMD_IMU_OUTPUT:
+    u8 = (uint8_t)atoi(argv[1]);
+    u16 = (uint16_t)atoi(argv[2]);
+    bsp_imu_set_output(u8, (uint8_t)u16);
+    CLI_PRINT("IMU output mask 0x%02x, fusion rate %d hz\n", g_Bsp.imu.outMask, g_Bsp.imu.fusionRateHz);
+    CLI_PRINT("Quat %d %d %d %d, Euler %d %d %d (0.01 deg)\n",
+              g_Bsp.fusion.q[0], g_Bsp.fusion.q[1], g_Bsp.fusion.q[2], g_Bsp.fusion.q[3],
+              g_Bsp.fusion.euler[0], g_Bsp.fusion.euler[1], g_Bsp.fusion.euler[2]);
+    break;
+
+  case CLI_CMD_IMU_RING:
+    IMU_RING_STAT_ST ring;
+
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+      bsp_imu_ring_reset_stat();
+    }
+    bsp_imu_ring_get_stat(&ring);
+    CLI_PRINT("IMU ring size %d, pushed %u, popped %u, overflow %u, high-water %d\n",
+              ring.size, ring.pushed, ring.popped, ring.overflow, ring.highWater);
+    break;
+
+  case CLI_CMD_MOTION_THR:
+    if (argc >= 5)
+    {
+      bsp_motion_detect_set_thr(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+    }
+    CLI_PRINT("Motion thr tap %d, ff %d, step %d, shake %d\n",
+              g_Bsp.motion.cfg.tapThr, g_Bsp.motion.cfg.ffThr, g_Bsp.motion.cfg.stepThr, g_Bsp.motion.cfg.shakeThr);
+    CLI_PRINT("Motion steps %d, events %d, last %d\n",
+              (int)g_Bsp.motion.stepCount, (int)g_Bsp.motion.evtCount, g_Bsp.motion.lastEvt);
+    break;
+
+  case CLI_CMD_IMU_BENCH:
+    IMU_BENCH_ST bench;
+
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+      bsp_imu_bench_reset();
+      CLI_PRINT("IMU bench reset\n");
+      break;
+    }
+    bsp_imu_bench_get(&bench);
+    CLI_PRINT("IMU path %s, threads %d, samples %u, errors %u\n",
+              bench.rtio ? "rtio" : "blocking", bench.threads, bench.samples, bench.errors);
+    if (bench.samples)
+    {
+      CLI_PRINT("cpu %u cycles/sample (imu_task), %u cycles/sample (system), latency avg %u us, max %u us\n",
+                (uint32_t)(bench.cpuCycles / bench.samples), (uint32_t)(bench.busyCycles / bench.samples),
+                bench.latSumUs / bench.samples, bench.latMaxUs);
+    }
+    break;
+
+  case CLI_CMD_IMU_MODE:
+    IMU_POWER_ST pwr;
+
+    if (argc > 1)
+    {
+      bsp_imu_set_mode((uint8_t)atoi(argv[1]),
+                       (argc > 2) ? (uint16_t)atoi(argv[2]) : 0,
+                       (argc > 3) ? (uint16_t)atoi(argv[3]) : 0);
+    }
+    bsp_imu_power_get(&pwr);
+    CLI_PRINT("IMU mode %s, %s, odr %d hz, idle %d ms\n",
+              (pwr.mode == BSP_IMU_MODE_WOM) ? "wake-on-motion" : "continuous",
+              (pwr.state == BSP_IMU_STATE_STREAM) ? "streaming" : "armed", pwr.odrHz, pwr.idleMs);
+    CLI_PRINT("transitions %u, armed %u ms, streaming %u ms\n",
+              pwr.transitions, pwr.stateMs[BSP_IMU_STATE_SLEEP], pwr.stateMs[BSP_IMU_STATE_STREAM]);
+    break;
+
+  case CLI_CMD_IMU_CAL:
+    if (argc > 1)
+    {
+      bsp_imu_cal_cmd((uint8_t)atoi(argv[1]));
+    }
+    CLI_PRINT("IMU cal %s, steps done 0x%02x\n", g_Bsp.imuCal.valid ? "valid" : "none", bsp_imu_cal_done());
+    CLI_PRINT("gyro bias %d %d %d, acc offset %d %d %d, gain %d %d %d (Q14)\n",
+              g_Bsp.imuCal.gyroBias[0], g_Bsp.imuCal.gyroBias[1], g_Bsp.imuCal.gyroBias[2],
+              g_Bsp.imuCal.accOffset[0], g_Bsp.imuCal.accOffset[1], g_Bsp.imuCal.accOffset[2],
+              g_Bsp.imuCal.accGain[0], g_Bsp.imuCal.accGain[1], g_Bsp.imuCal.accGain[2]);
+    break;
+
+  case CLI_CMD_VIB:
+    if (argc > 1)
+    {
+      bsp_imu_vib_set_win((uint16_t)atoi(argv[1]));
+    }
+    CLI_PRINT("Vibration window %d, odr %d hz, windows %u\n", g_Bsp.vib.win, g_Bsp.imuPwr.odrHz, g_Bsp.vib.windows);
+    for (int i = 0; i < 3; i++)
+    {
+      VIB_FEAT_ST *f = &g_Bsp.vib.feat[i];
+
+      CLI_PRINT("%c rms %d peak %d crest %d kurt %d | bands",
+                'x' + i, f->rms, f->peak, f->crest, f->kurt);
+      for (int b = 0; b < BSP_VIB_BANDS; b++)
+      {
+        CLI_PRINT(" %d", f->band[b]);
+      }
+      CLI_PRINT("\n");
+    }
+    break;
+
+  case CLI_CMD_ML:
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+      g_Bsp.ml.latMaxUs = 0;
+      g_Bsp.ml.inferences = 0;
+    }
+    CLI_PRINT("Model %s, %d bytes, %d classes, window %d hop %d\n",
+              g_Bsp.ml.loaded ? "loaded" : "none", g_Bsp.ml.modelSize, g_Bsp.ml.classes, g_Bsp.ml.winLen, g_Bsp.ml.hop);
+    CLI_PRINT("inferences %u, latency %u us (max %u), arena %d/%d bytes, last class %d (%d%%)\n",
+              g_Bsp.ml.inferences, g_Bsp.ml.latUs, g_Bsp.ml.latMaxUs,
+              g_Bsp.ml.arenaUsed, g_Bsp.ml.arenaSize, g_Bsp.ml.lastClass, g_Bsp.ml.lastConf);
+    break;
+
+  case CLI_CMD_IMU_HIST:
+    IMU_HIST_STAT_ST hist;
+
+    if (argc > 2)
+    {
+      CLI_PRINT("History query, %d samples\n", bsp_imu_hist_query(atoi(argv[1]), atoi(argv[2])));
+    }
+    bsp_imu_hist_get_stat(&hist);
+    CLI_PRINT("IMU history %u/%u samples, %u ms, bulk %s\n",
+              hist.count, hist.capacity, hist.spanMs, bsp_bulk_busy() ? "busy" : "idle");
+    break;
+
+  case CLI_CMD_DECIM:
+    IMU_DECIM_STAT_ST decim;
+
+    if (argc > 2)
+    {
+      bsp_imu_decim_set_rate((uint8_t)atoi(argv[1]), (uint16_t)atoi(argv[2]));
+    }
+    for (int i = 0; i < BSP_DECIM_SUBS; i++)
+    {
+      if (bsp_imu_decim_get(i, &decim) < 0 || !decim.used)
+      {
+        continue;
+      }
+      CLI_PRINT("sub %d, req %d hz, odr %d hz / %d (cic %d x fir %d, %d taps), outputs %d\n",
+                i, decim.reqHz, decim.odrHz, decim.factor, decim.cic, decim.fir, decim.taps, decim.outputs);
+    }
+    break;
+
+  case CLI_CMD_AUDIO:
+    AUDIO_STAT_ST audio;
+
+    if (argc > 1)
+    {
+      bsp_audio_stream((uint8_t)atoi(argv[1]), (argc > 2) ? (uint8_t)atoi(argv[2]) : 0);
+    }
+    bsp_audio_get_stat(&audio);
+    CLI_PRINT("audio %s, %d blocks/frame, blocks %d, dropped %d, frames %d\n",
+              audio.running ? "on" : "off", audio.blocksPerFrame, audio.blocks, audio.dropped, audio.frames);
+    CLI_PRINT("vad %d (%s), voice blocks %d, gated %d, floor %d\n",
+              audio.vad, audio.voice ? "voice" : "silence", audio.voiceBlocks, audio.gated, audio.vadFloor);
+    CLI_PRINT("budget %d bps, actual %d bps\n", audio.budgetBps, audio.actualBps);
+    break;
+
+  case CLI_CMD_SLM:
+    if (argc > 1)
+    {
+      bsp_audio_slm_set_interval((uint16_t)atoi(argv[1]));
+    }
+    CLI_PRINT("slm every %d ms, reports %d\n", g_Bsp.slm.intervalMs, g_Bsp.slm.reports);
+    CLI_PRINT("LAeq %d.%02d dB, Lpeak %d.%02d dB\n", g_Bsp.slm.laeq / 100, abs(g_Bsp.slm.laeq % 100),
+              g_Bsp.slm.lpeak / 100, abs(g_Bsp.slm.lpeak % 100));
+    for (int i = 0; i < BSP_SLM_BANDS; i++)
+    {
+      CLI_PRINT("band %d : %d.%02d dB\n", i, g_Bsp.slm.band[i] / 100, abs(g_Bsp.slm.band[i] % 100));
+    }
+    break;
+
+  case CLI_CMD_CLIP:
+    if (argc > 1 && strcmp(argv[1], "arm") == 0)
+    {
+      bsp_audio_clip_arm(1, (argc > 2) ? (uint16_t)atoi(argv[2]) : 0, (argc > 3) ? (uint16_t)atoi(argv[3]) : 0);
+    }
+    else if (argc > 1 && strcmp(argv[1], "off") == 0)
+    {
+      bsp_audio_clip_arm(0, 0, 0);
+    }
+    else if (argc > 1 && strcmp(argv[1], "trig") == 0)
+    {
+      bsp_audio_clip_trigger(BSP_CLIP_TRIG_MANUAL);
+    }
+    else if (argc > 2 && strcmp(argv[1], "get") == 0)
+    {
+      bsp_audio_clip_get((uint32_t)atoi(argv[2]));
+    }
+    CLI_PRINT("clip %s%s, pre %d ms, post %d ms, stored %d, last id %d\n", g_Bsp.clip.armed ? "armed" : "off",
+              g_Bsp.clip.busy ? " (writing)" : "", g_Bsp.clip.preMs, g_Bsp.clip.postMs, g_Bsp.clip.clips,
+              g_Bsp.clip.lastId);
+    CLI_PRINT("triggers %d, ignored %d, overruns %d\n", g_Bsp.clip.triggers, g_Bsp.clip.ignored, g_Bsp.clip.overruns);
+    break;
+
+  case CLI_CMD_AED:
+    if (argc > 1)
+    {
+      uint16_t tone[BSP_AED_TONES] = {0};
+
+      for (int i = 0; i < BSP_AED_TONES && i + 4 < argc; i++)
+      {
+        tone[i] = (uint16_t)atoi(argv[i + 4]);
+      }
+      bsp_audio_aed_set((uint8_t)atoi(argv[1]), (argc > 2) ? (uint8_t)atoi(argv[2]) : 0,
+                        (argc > 3) ? (uint8_t)atoi(argv[3]) : 0, (argc > 4) ? tone : NULL);
+    }
+    CLI_PRINT("aed %s, impulse x%d, tone %d %%, events %d (last %d), %d us/block\n", g_Bsp.aed.on ? "on" : "off",
+              g_Bsp.aed.impulseThr, g_Bsp.aed.tonePct, g_Bsp.aed.events, g_Bsp.aed.lastEvt, g_Bsp.aed.cpuUs);
+    for (int i = 0; i < BSP_AED_TONES; i++)
+    {
+      CLI_PRINT("tone %d : %d hz\n", i, g_Bsp.aed.toneHz[i]);
+    }
+    break;
+
+  case CLI_CMD_WALL:
+    if (argc > 1 && strcmp(argv[1], "sync") == 0)
+    {
+      bsp_wall_resync();
+    }
+#if 1
+    RTC_TIME_ST wdate = {0};
+    int64_t wall_ms = bsp_wall_now_ms();
+
+    bsp_wall_get_time(&wdate);
+    CLI_PRINT("wall %s, %lld ms, 20%02d-%02d-%02d %02d:%02d:%02d UTC\n", g_Bsp.wall.valid ? "synced" : "not synced",
+              wall_ms, wdate.year, wdate.mon, wdate.day, wdate.hour, wdate.min, wdate.sec);
+    CLI_PRINT("syncs %d (errors %d), last %lld s ago, step %d ms, drift %d ppb\n", g_Bsp.wall.syncs, g_Bsp.wall.errors,
+              (bsp_time_us() - g_Bsp.wall.lastSyncUs) / 1000000, g_Bsp.wall.stepMs, g_Bsp.wall.driftPpb);
+#endif
+    break;
+
+  case CLI_CMD_RSCHED:
+    if (argc > 3 && strcmp(argv[1], "alarm") == 0)
+    {
+      bsp_rtc_sched_alarm((int8_t)atoi(argv[2]), (int8_t)atoi(argv[3]),
+                          (argc > 4) ? (uint8_t)atoi(argv[4]) : BSP_RSCHED_ACT_NOTIFY);
+    }
+    else if (argc > 2 && strcmp(argv[1], "every") == 0)
+    {
+      bsp_rtc_sched_every((uint16_t)atoi(argv[2]), (argc > 3) ? (uint8_t)atoi(argv[3]) : BSP_RSCHED_ACT_NOTIFY);
+    }
+    CLI_PRINT("rsched INT %s, alarm %d:%02d act 0x%02x, every %d s act 0x%02x\n", g_Bsp.rsched.hasInt ? "ok" : "none",
+              g_Bsp.rsched.alarmHour, g_Bsp.rsched.alarmMin, g_Bsp.rsched.alarmAct, g_Bsp.rsched.everySec,
+              g_Bsp.rsched.timerAct);
+    CLI_PRINT("alarms %d, timers %d, last src %d at %lld ms\n", g_Bsp.rsched.alarms, g_Bsp.rsched.timers,
+              g_Bsp.rsched.lastSrc, g_Bsp.rsched.lastMs);
+    break;
+
+  case CLI_CMD_I2C:
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+      bsp_i2c_reset_stat();
+    }
+    for (int i = 0; i < BSP_I2C_DEVS; i++)
+    {
+      I2C_STAT_ST *ist = &g_Bsp.i2c[i];
+
+      CLI_PRINT("dev %d : xfers %d (batched %d), err %d, full %d, wait %d/%d us, bus %d/%d us (avg/max)\n", i,
+                ist->xfers, ist->batched, ist->errors, ist->full, ist->waitAvgUs, ist->waitMaxUs, ist->busAvgUs,
+                ist->busMaxUs);
+    }
+    break;
+
+  case CLI_CMD_TSLOG:
+    if (argc > 2 && strcmp(argv[1], "mask") == 0)
+    {
+      bsp_tslog_set_mask((uint16_t)strtoul(argv[2], NULL, 0));
+    }
+    else if (argc > 1 && strcmp(argv[1], "flush") == 0)
+    {
+      CLI_PRINT("flush %s\n", bsp_tslog_flush() == 0 ? "done" : "failed");
+    }
+    else if (argc > 3 && strcmp(argv[1], "get") == 0)
+    {
+      bsp_tslog_query(strtoll(argv[2], NULL, 0), strtoll(argv[3], NULL, 0));
+    }
+    CLI_PRINT("tslog mask 0x%04x, %d sectors, %lld..%lld ms\n", g_Bsp.tslog.mask, g_Bsp.tslog.sectors,
+              g_Bsp.tslog.oldestMs, g_Bsp.tslog.newestMs);
+    CLI_PRINT("records %d, dropped %d, page writes %d, erases %d\n", g_Bsp.tslog.records, g_Bsp.tslog.dropped,
+              g_Bsp.tslog.flushes, g_Bsp.tslog.erases);
+    break;
+
   default:
     // Unknown command! We should never get here...
     CLI_PRINT("Unknown command, %d\n", command);
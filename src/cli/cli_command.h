@@ -42,3 +42,26 @@
 
 #define CLI_CMD_PWM_INIT         (CLI_CMD_OFFSET + 50)
 #define CLI_CMD_PWM_SET_DUTY     (CLI_CMD_OFFSET + 51)
+
+#define CLI_CMD_IMU_OUTPUT       (CLI_CMD_OFFSET + 60)
+#define CLI_CMD_IMU_RING         (CLI_CMD_OFFSET + 61)
+#define CLI_CMD_MOTION_THR       (CLI_CMD_OFFSET + 62)
+#define CLI_CMD_IMU_BENCH        (CLI_CMD_OFFSET + 63)
+#define CLI_CMD_IMU_MODE         (CLI_CMD_OFFSET + 64)
+#define CLI_CMD_IMU_CAL          (CLI_CMD_OFFSET + 65)
+#define CLI_CMD_VIB              (CLI_CMD_OFFSET + 66)
+#define CLI_CMD_ML               (CLI_CMD_OFFSET + 67)
+#define CLI_CMD_IMU_HIST         (CLI_CMD_OFFSET + 68)
+#define CLI_CMD_DECIM            (CLI_CMD_OFFSET + 69)
+#define CLI_CMD_AUDIO            (CLI_CMD_OFFSET + 70)
+#define CLI_CMD_SLM              (CLI_CMD_OFFSET + 71)
+#define CLI_CMD_CLIP             (CLI_CMD_OFFSET + 72)
+#define CLI_CMD_AED              (CLI_CMD_OFFSET + 73)
+#define CLI_CMD_WALL             (CLI_CMD_OFFSET + 74)
+#define CLI_CMD_RSCHED           (CLI_CMD_OFFSET + 75)
+#define CLI_CMD_I2C              (CLI_CMD_OFFSET + 76)
+#define CLI_CMD_TSLOG            (CLI_CMD_OFFSET + 77)
+#define CLI_CMD_NVS_STAT         (CLI_CMD_OFFSET + 78)
+#define CLI_CMD_RET              (CLI_CMD_OFFSET + 79)
+#define CLI_CMD_REBOOT           (CLI_CMD_OFFSET + 80)
+#define CLI_CMD_EVQ              (CLI_CMD_OFFSET + 81)
@@ -3,6 +3,7 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/byteorder.h>
 #include <bluetooth/services/nus.h>
 
 #include <zephyr/logging/log.h>
@@ -27,12 +28,27 @@ static void bt_receive_cb(struct bt_conn *conn, const uint8_t *const data, uint1
 {
 	struct nus_msg_packet send_data;
 
+	/* Receive time for time sync (T2), as early as we can get it */
+	send_data.rx_us = bsp_time_us();
+
+	/* The MTU allows writes above the packet size, LEN must not claim more than arrived */
+	if (len < 4 || len - 4 > BSP_MAX_MSG_LEN)
+	{
+		LOG_ERR("Rejected %u bytes write", len);
+		return;
+	}
+
 	LOG_INF("Received %u bytes over BLE. First byte: 0x%02x", len, data[0]);
 
 	send_data.id = ((data[0] << 8) | data[1]);
 	send_data.len = ((data[2] << 8) | data[3]);
-	// memset(send_data.message, 0, BSP_MAX_MSG_LEN);
-	memcpy(send_data.message, &data[4], len - 4);
+	if (send_data.len < 4 || send_data.len > len)
+	{
+		LOG_ERR("Bad LEN %u for %u bytes", send_data.len, len);
+		return;
+	}
+	memcpy(send_data.message, &data[4], send_data.len - 4);
+	memset(&send_data.message[send_data.len - 4], 0, BSP_MAX_MSG_LEN - (send_data.len - 4));
 
 	int err = bsp_nus_msg_send_to_rcv_task(&send_data, len); // len + sizeof id + sizeof len
 	if (err < 0)
@@ -50,6 +66,15 @@ static struct bt_nus_cb nus_cb = {
 };
 
 // 2. Track connection status
+static void mtu_exchange_cb(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+	LOG_INF("MTU exchange %s, MTU %d", err ? "failed" : "done", bt_gatt_get_mtu(conn));
+}
+
+static struct bt_gatt_exchange_params mtu_params = {
+	.func = mtu_exchange_cb,
+};
+
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	if (err)
@@ -59,11 +84,18 @@ static void connected(struct bt_conn *conn, uint8_t err)
 	}
 	LOG_INF("Connected!");
 	current_conn = bt_conn_ref(conn);
+
+	/* IMU/time sync notifications are longer than the default 20 byte payload */
+	bt_gatt_exchange_mtu(conn, &mtu_params);
+
+	ble_conn_profile_apply();
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	LOG_INF("Disconnected (reason %u)", reason);
+	/* The next central has its own clock */
+	bsp_time_sync_reset();
 	if (current_conn)
 	{
 		bt_conn_unref(current_conn);
@@ -118,14 +150,102 @@ void ble_nus_send_data(char *p, int len)
 	if (err)
 	{
 		// LOG_ERR("Failed to send data (err %d)", err);
+		g_Bsp.ble.txErr++;
 	}
 	else
 	{
+		g_Bsp.ble.tx++;
+		g_Bsp.ble.txBytes += len;
 		// LOG_INF("Sent: %s", p);
 		LOG_HEXDUMP_WRN(p, len, "Sent:");
 	}
 }
 
+/**
+ * @brief send one bulk frame, no logging and the error goes back to the caller
+ * 
+ * @param p 	frame pointer to send
+ * @param len 	frame length, up to ble_nus_get_payload_len()
+ * @return int 	0 : OK, -ENOTCONN : no central, others : bt_nus_send() error
+ */
+int ble_nus_send_frame(const uint8_t *p, int len)
+{
+	if (!current_conn)
+	{
+		return -ENOTCONN;
+	}
+
+	int err = bt_nus_send(current_conn, p, len);
+	if (err)
+	{
+		g_Bsp.ble.txErr++;
+	}
+	else
+	{
+		g_Bsp.ble.tx++;
+		g_Bsp.ble.txBytes += len;
+	}
+
+	return err;
+}
+
+/**
+ * @brief largest notification payload on the current connection
+ * 
+ * @return int 	ATT MTU - 3, 0 if not connected
+ */
+int ble_nus_get_payload_len(void)
+{
+	if (!current_conn)
+	{
+		return 0;
+	}
+
+	return bt_nus_get_mtu(current_conn);
+}
+
+/**
+ * @brief connection parameter ranges of the Core spec
+ * 
+ * @param prof 	intMax 0 : leave it to the central, valid
+ * @return true 	interval 7.5 ms..4 s, intMin <= intMax, latency <= 499,
+ * 					timeout 100 ms..32 s and above (1 + latency) x intMax x 2
+ */
+bool ble_conn_profile_valid(const CONN_PROFILE_ST *prof)
+{
+	if (prof->intMax == 0)
+	{
+		return true;
+	}
+
+	return prof->intMin >= 6 && prof->intMin <= prof->intMax && prof->intMax <= 3200 && prof->latency <= 499 &&
+		   prof->timeout >= 10 && prof->timeout <= 3200 &&
+		   (uint32_t)prof->timeout * 4 > (1 + (uint32_t)prof->latency) * prof->intMax; // 10 ms vs 2 x 1.25 ms units
+}
+
+/**
+ * @brief request the stored connection profile (g_Bsp.connProfile)
+ * 
+ * @return int 	0 : OK or nothing to do, others : bt_conn_le_param_update() error
+ */
+int ble_conn_profile_apply(void)
+{
+	const CONN_PROFILE_ST *prof = &g_Bsp.connProfile;
+
+	if (!current_conn || prof->intMax == 0)
+	{
+		return 0;
+	}
+	if (!ble_conn_profile_valid(prof))
+	{
+		LOG_WRN("Stored connection profile out of range, not applied");
+		return -EINVAL;
+	}
+
+	return bt_conn_le_param_update(current_conn,
+								   BT_LE_CONN_PARAM(prof->intMin, prof->intMax, prof->latency, prof->timeout));
+}
+
 /* --- Bluetooth Initialization --- */
 
 static const struct bt_data ad[] = {
@@ -133,37 +253,74 @@ static const struct bt_data ad[] = {
 	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_NUS_VAL),
 };
 
+/* Company 0xFFFF (test) | VBAT_MV(2) | BOOT_COUNT(2), little endian, BSP_PRD_JOB_ADV */
+static uint8_t adv_mfg[6] = {0xFF, 0xFF};
+
 static const struct bt_data sd[] = {
 	BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME, sizeof(CONFIG_BT_DEVICE_NAME) - 1),
+	BT_DATA(BT_DATA_MANUFACTURER_DATA, adv_mfg, sizeof(adv_mfg)),
 };
 
-int main(void)
+/**
+ * @brief refresh the scan response data, restart advertising if it stopped
+ *        while nobody is connected (BSP_PRD_JOB_ADV)
+ * 
+ */
+void ble_adv_refresh(void)
 {
 	int err;
-	int led_offset = 0;
+
+	sys_put_le16(g_Bsp.batt_adc.mv, &adv_mfg[2]);
+	sys_put_le16((uint16_t)g_Bsp.nvs.boot_count, &adv_mfg[4]);
+
+	err = bt_le_adv_update_data(ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+	if (err && !current_conn)
+	{
+		err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+		LOG_INF("Advertising restarted (err %d)", err);
+	}
+}
+
+/**
+ * @brief NUS alive message, BSP_PRD_JOB_ALIVE (was the main loop)
+ * 
+ */
+void ble_nus_alive(void)
+{
+	static int alive_count = 0;
 	char buffer[32];
 
-	LOG_INF("Starting NUS Simple Example (No UART)");
+	sprintf(buffer, "NUS send %d", alive_count++);
+	ble_nus_send_data(buffer, strlen(buffer));
+}
+
+/**
+ * @brief BT and board init, first work on the event queue (its stack, not main's)
+ * 
+ */
+static void app_init_handler(struct k_work *work)
+{
+	int err;
 
 	err = bt_enable(NULL);
 	if (err)
 	{
 		LOG_ERR("Bluetooth init failed (err %d)", err);
-		return -1;
+		return;
 	}
 
 	err = bt_nus_init(&nus_cb);
 	if (err)
 	{
 		LOG_ERR("Failed to init NUS (err %d)", err);
-		return -1;
+		return;
 	}
 
 	err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
 	if (err)
 	{
 		LOG_ERR("Advertising failed (err %d)", err);
-		return -1;
+		return;
 	}
 
 	LOG_INF("Advertising started. Waiting for connection...");
@@ -171,17 +328,24 @@ int main(void)
 	bsp_init();
 	bsp_led_init();
 	bsp_nvs_init();
-	bsp_nvs_read(&g_Bsp.nvs);
+	bsp_settings_load();
+	bsp_retained_init();
+	bsp_imu_ml_load();
+	bsp_prd_start();
+}
 
-	/* Main Loop: Sends data every 5 seconds */
-	while (1)
-	{
-		k_sleep(K_SECONDS(5));
-		// send_test_data();
+static K_WORK_DEFINE(m_init_work, app_init_handler);
 
-		sprintf(buffer, "NUS send %d", led_offset++);
-		ble_nus_send_data(buffer, strlen(buffer));
-	}
+int main(void)
+{
+	LOG_INF("Starting NUS Simple Example (No UART)");
+
+	/* Before anything posts to it : NUS RX, bsp_init */
+	bsp_evq_init();
+	bsp_evq_submit(&m_init_work);
 
+	/* Nothing left for main, the event queue and the jobs take it from here.
+	 * Its stack only has to cover the driver init before main (CONFIG_MAIN_STACK_SIZE).
+	 */
 	return 0;
 }